@@ -8,18 +8,21 @@
 layout(binding = 0) uniform sampler2D in_textures;
 layout(location = 10) uniform bool in_horizontal;
 layout(location = 11) uniform vec2 in_resolution;
+layout(location = 12) uniform vec2 in_renderResolution;
 
 layout (location = 0) out vec4 out_color;
 
 void main()
 {
+	// in_resolution is the texture's size, only its lower left in_renderResolution texels hold this frame
 	const vec2 texCoord = gl_FragCoord.xy / in_resolution;
 	const vec2 offset = in_horizontal ? vec2(1.2 / in_resolution.x, 0.0) : vec2(0.0, 1.2/in_resolution.y);
+	const vec2 maxTexCoord = (in_renderResolution - 0.5) / in_resolution;
 	vec3 color = vec3(0);
 
 	color += texture(in_textures, texCoord - offset).xyz * 5.0/16.0;
 	color += texture(in_textures, texCoord).xyz * 6.0/16.0;
-	color += texture(in_textures, texCoord + offset).xyz * 5.0/16.0;
+	color += texture(in_textures, min(texCoord + offset, maxTexCoord)).xyz * 5.0/16.0;
 
 	out_color = vec4(color, 1.0);
 }
@@ -4,13 +4,14 @@
 #extension GL_GOOGLE_include_directive : enable
 
 layout(binding = 0) uniform sampler2D in_texture;
-layout(location = 1) uniform vec2 in_resolution;
 
 layout (location = 0) out vec4 out_color;
 
 void main()
 {
-	const vec2 texCoord = gl_FragCoord.xy / in_resolution;
+	// Each pixel lands on the corner between the 2x2 texels it covers, so the bilinear fetch averages them. Works in
+	// texels so it only ever reads the part of in_texture the scene was drawn to
+	const vec2 texCoord = gl_FragCoord.xy * 2.0 / vec2(textureSize(in_texture, 0));
 	const vec3 color = texture(in_texture, texCoord).xyz;
 
 	out_color = vec4(color, 1.0);
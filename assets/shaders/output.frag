@@ -5,19 +5,40 @@
 
 #include "/pbr_lighting.glsl"
 #include "/scene_defines.glsl"
+#include "/upscale.glsl"
+
+#define UPSCALE_SHARPNESS 0.8
 
 layout(binding = 0) uniform sampler2D in_textures[BLOOM_BLUR_PASSES+1];
 layout(location = 11) uniform vec2 in_resolution;
+layout(location = 12) uniform vec2 in_renderResolution;
 
 layout (location = 0) out vec4 out_color;
 
 void main()
 {
-	const vec2 texCoord = gl_FragCoord.xy / in_resolution;
-	vec3 color = vec3(0);
+	// The scene and bloom passes drew into the lower left of their textures, at in_renderResolution and its halvings
+	const vec2 pixel = gl_FragCoord.xy / in_resolution;
+	vec3 color;
+
+	if (in_renderResolution == in_resolution)
+	{
+		color = texelFetch(in_textures[0], ivec2(gl_FragCoord.xy), 0).xyz;
+	}
+	else
+	{
+		color = Upscale_EASU(in_textures[0], in_renderResolution, pixel);
+		color = Upscale_RCAS(in_textures[0], in_renderResolution, pixel, color, UPSCALE_SHARPNESS);
+	}
+
+	for(uint p=1; p<BLOOM_BLUR_PASSES + 1; ++p)
+	{
+		const vec2 texRes = vec2(textureSize(in_textures[p], 0));
+		const vec2 passRes = vec2(uvec2(in_renderResolution) >> (p - 1));
+		const vec2 texCoord = min(pixel * passRes, passRes - 0.5) / texRes;
 
-	for(uint p=0; p<BLOOM_BLUR_PASSES + 1; ++p)
 		color += texture(in_textures[p], texCoord).xyz;
+	}
 
 	color = Tonemap_ACES(color);
 	out_color = vec4(color, 1.0);//vec4(GammaCorrectColor(color), 1.0);
@@ -10,13 +10,14 @@
 #include "/raymarch.glsl"
 #include "/scene_meshes.glsl"
 #include "/bvh_node.glsl"
+#include "/scene_entry.glsl"
 
 const float g_camNear = 1.0;
 const float g_camFar = 100.0;
 
 layout(std140, binding=0) buffer SceneEntryBuffer
 {
-	mat4 in_entries[];
+	SceneEntry in_entries[];
 };
 
 layout(std140, binding=1) buffer SceneBVHBuffer
@@ -41,6 +42,87 @@ uint g_rayHitSceneEntryCount = 0;
 
 float g_timeSec;
 
+// Grows the refined leaf bounds so soft shadows still see near misses
+#define LEAF_BOUND_MARGIN 0.05
+
+bool LeafBound_RaySphere(in const vec3 rayOrigin, in const vec3 rayDir, in const float radius)
+{
+	const float t = max(dot(-rayOrigin, rayDir) / dot(rayDir, rayDir), 0.0);
+	const vec3 closest = rayDir*t + rayOrigin;
+	const float r = radius + LEAF_BOUND_MARGIN;
+
+	return dot(closest, closest) <= r*r;
+}
+
+bool LeafBound_RayBox(in const vec3 rayOrigin, in const vec3 invDir, in const vec3 boxMin, in const vec3 boxMax)
+{
+	const vec3 tEnter = (boxMin - LEAF_BOUND_MARGIN - rayOrigin) * invDir;
+	const vec3 tExit = (boxMax + LEAF_BOUND_MARGIN - rayOrigin) * invDir;
+	const vec3 tMin = min(tEnter, tExit);
+	const vec3 tMax = max(tEnter, tExit);
+
+	return min(min(tMax.x, tMax.y), tMax.z) >= max(max(max(tMin.x, tMin.y), tMin.z), 0.0);
+}
+
+// Moves a world space point or direction into an entry's local space, undoing its rotation about z
+vec3 EntryToLocal(in const vec2 cosSinRot, in const vec3 v)
+{
+	return vec3(cosSinRot.x*v.x + cosSinRot.y*v.y, cosSinRot.x*v.y - cosSinRot.y*v.x, v.z);
+}
+
+vec2 EntryCosSinRot(in const uint typeRotation)
+{
+	const float rot = float(typeRotation & SCENE_ENTRY_ROTATION_MASK) * (6.28318530718 / 65536.0);
+	return vec2(cos(rot), sin(rot));
+}
+
+uint EntryType(in const uint typeRotation)
+{
+	return (typeRotation >> SCENE_ENTRY_TYPE_SHIFT) & SCENE_ENTRY_TYPE_MASK;
+}
+
+float EntryTypeFrac(in const uint typeRotation)
+{
+	return float((typeRotation >> SCENE_ENTRY_SUB_TYPE_SHIFT) & SCENE_ENTRY_SUB_TYPE_MASK) * (1.0 / 256.0);
+}
+
+// Refined test of a leaf whose world space box was hit. The ray is moved into the entry's local space and tested
+// against a tighter per mesh type bound, so rotated objects and the sparse platform set stop gathering false hits.
+bool BVHLeafRayTest(in const uint entryIndex, in const vec3 rayDir, in const vec3 rayOrigin)
+{
+	const SceneEntry entry = in_entries[entryIndex];
+	const uint type = EntryType(entry.typeRotation);
+	const vec2 cosSinRot = EntryCosSinRot(entry.typeRotation);
+
+	const vec3 localOrigin = EntryToLocal(cosSinRot, rayOrigin - entry.position);
+	const vec3 localDir = EntryToLocal(cosSinRot, rayDir);
+	const vec3 localInvDir = 1.0 / localDir;
+
+	switch(type)
+	{
+	case MESH_TYPE_PLAYER:		return LeafBound_RayBox(localOrigin, localInvDir, vec3(PLAYER_WIDTH*-0.5, 0.0, PLAYER_WIDTH*-0.5), vec3(PLAYER_WIDTH*0.5, PLAYER_HEIGHT, PLAYER_WIDTH*0.5));
+	case MESH_TYPE_HELPER:		return LeafBound_RaySphere(localOrigin, localDir, HELPER_RADIUS);
+	case MESH_TYPE_SNOW_FLAKE:	return LeafBound_RaySphere(localOrigin, localDir, SNOWFLAKE_RADIUS);
+	case MESH_TYPE_SNOW_BALL:	return LeafBound_RaySphere(localOrigin, localDir, SNOWBALL_RADIUS*1.3);
+	case MESH_TYPE_FIRE_BALL:	return LeafBound_RaySphere(localOrigin, localDir, FIREBALL_RADIUS*2.0);
+	case MESH_TYPE_STATIC_PLATFORMS:
+		// Mirrors Mesh_StaticPlatforms: one box per platform, reflected across x = 0
+		for(uint platformIndex=0; platformIndex<PLATFORM_COUNT; ++platformIndex)
+		{
+			const vec3 halfExtent = vec3(BOTTOM_PLATFORM_WIDTH - float(platformIndex)*PLATFORM_WIDTH_DROP, PLATFORM_DIM, PLATFORM_DIM);
+			const vec3 center = vec3(BOTTOM_LEFT_PLATFORM_X, BOTTOM_LEFT_PLATFORM_Y + float(platformIndex)*PLATFORM_VERTICAL_SPACE, 0.0);
+			const vec3 mirroredCenter = vec3(-center.x, center.yz);
+
+			if(LeafBound_RayBox(localOrigin, localInvDir, center - halfExtent, center + halfExtent) ||
+			   LeafBound_RayBox(localOrigin, localInvDir, mirroredCenter - halfExtent, mirroredCenter + halfExtent))
+				return true;
+		}
+		return false;
+	}
+
+	return true;
+}
+
 void BVHRayGatherSceneEntries(in const vec3 rayDir, in const vec3 rayOrigin)
 {
 	const uint MAX_STACK = 8;
@@ -83,9 +165,11 @@ void BVHRayGatherSceneEntries(in const vec3 rayDir, in const vec3 rayOrigin)
 			{
 				if((childOffset & LEAF_NODE_MASK) == LEAF_NODE_MASK)
 				{
-					if(g_rayHitSceneEntryCount < MAX_HIT_SCENE_ENTRIES)
+					const uint entryIndex = childOffset & (~LEAF_NODE_MASK);
+
+					if(g_rayHitSceneEntryCount < MAX_HIT_SCENE_ENTRIES && BVHLeafRayTest(entryIndex, rayDir, rayOrigin))
 					{
-						g_rayHitSceneEntries[g_rayHitSceneEntryCount++] = childOffset & (~LEAF_NODE_MASK);
+						g_rayHitSceneEntries[g_rayHitSceneEntryCount++] = entryIndex;
 					}
 				}
 				else
@@ -104,14 +188,11 @@ vec2 RayMarch_SceneFunc(in vec3 pos)
 
 	for(uint i=0; i<g_rayHitSceneEntryCount; ++i)
 	{
-		mat4 invTransform = in_entries[g_rayHitSceneEntries[i]];
-		float typeVal = invTransform[3][3];
-		float typeFrac = fract(typeVal);
-		uint type = uint(typeVal);
-
-		invTransform[3][3] = 1.0;
+		const SceneEntry entry = in_entries[g_rayHitSceneEntries[i]];
+		float typeFrac = EntryTypeFrac(entry.typeRotation);
+		uint type = EntryType(entry.typeRotation);
 
-		vec3 objPos = (invTransform*vec4(pos, 1.0)).xyz;
+		vec3 objPos = EntryToLocal(EntryCosSinRot(entry.typeRotation), pos - entry.position);
 		vec2 objDist;
 
 		switch(type)
@@ -0,0 +1,17 @@
+#ifndef SCENE_ENTRY
+#define SCENE_ENTRY
+
+// Bit layout of SceneEntry::typeRotation
+#define SCENE_ENTRY_ROTATION_MASK 0xffffu // rotation about z, as a fraction of a turn
+#define SCENE_ENTRY_TYPE_SHIFT 16u
+#define SCENE_ENTRY_TYPE_MASK 0xffu // mesh type
+#define SCENE_ENTRY_SUB_TYPE_SHIFT 24u
+#define SCENE_ENTRY_SUB_TYPE_MASK 0xffu // sub type, as a fraction of 256
+
+struct SceneEntry
+{
+	vec3 position;
+	uint typeRotation;
+};
+
+#endif //#ifdef SCENE_ENTRY
@@ -0,0 +1,167 @@
+#ifndef UPSCALE_GLSL
+#define UPSCALE_GLSL
+
+// Edge adaptive spatial upsampling and robust contrast adaptive sharpening, after AMD's FidelityFX Super Resolution 1.
+// Both work in a single pass straight off the low resolution texture, so there is no upscaled intermediate for the
+// sharpen to read. Expects colors in [0, 1].
+
+#define RCAS_LIMIT (0.25 - (1.0 / 16.0))
+
+float Upscale_Luma(const vec3 c)
+{
+	return c.b * 0.5 + (c.r * 0.5 + c.g);
+}
+
+// Accumulates one inner texel's share of the edge direction and length from its cross neighbors, ala FSR's FsrEasuSetF
+void Upscale_EdgeDirection(inout vec2 dir, inout float len, const float w, const float lL, const float lR, const float lU, const float lD, const float lC)
+{
+	const float dc = lD - lC;
+	const float cb = lC - lU;
+	const float dirY = lD - lU;
+	float lenY = clamp(abs(dirY) / max(max(abs(dc), abs(cb)), 1.0 / 65536.0), 0.0, 1.0);
+
+	const float ec = lR - lC;
+	const float ca = lC - lL;
+	const float dirX = lR - lL;
+	float lenX = clamp(abs(dirX) / max(max(abs(ec), abs(ca)), 1.0 / 65536.0), 0.0, 1.0);
+
+	lenX *= lenX;
+	lenY *= lenY;
+
+	dir += vec2(dirX, dirY) * w;
+	len += (lenX + lenY) * w;
+}
+
+// Lanczos 2 approximation, stretched along the edge and squeezed across it
+void Upscale_Tap(inout vec3 color, inout float weight, const vec2 offset, const vec2 dir, const vec2 len2, const float lob, const float clp, const vec3 c)
+{
+	vec2 v = vec2(offset.x * dir.x + offset.y * dir.y, offset.x * -dir.y + offset.y * dir.x);
+	v *= len2;
+
+	const float d2 = min(dot(v, v), clp);
+	float wB = 0.4 * d2 - 1.0;
+	float wA = lob * d2 - 1.0;
+
+	wB *= wB;
+	wA *= wA;
+	wB = (25.0 / 16.0) * wB - (25.0 / 16.0 - 1.0);
+
+	const float w = wB * wA;
+
+	color += c * w;
+	weight += w;
+}
+
+vec3 Upscale_Fetch(sampler2D tex, const ivec2 texel, const ivec2 maxTexel)
+{
+	return texelFetch(tex, clamp(texel, ivec2(0), maxTexel), 0).rgb;
+}
+
+// tex holds the scene in its lower left renderRes texels, pixel is the output pixel's position in [0, 1]
+vec3 Upscale_EASU(sampler2D tex, const vec2 renderRes, const vec2 pixel)
+{
+	// 12 tap footprint around the 2x2 quad f g j k nearest the sample
+	//    b c
+	//  e f g h
+	//  i j k l
+	//    n o
+	const vec2 pos = pixel * renderRes - 0.5;
+	const vec2 fp = floor(pos);
+	const vec2 pp = pos - fp;
+	const ivec2 f = ivec2(fp);
+	const ivec2 maxTexel = ivec2(renderRes) - 1;
+
+	const vec3 b = Upscale_Fetch(tex, f + ivec2(0, -1), maxTexel);
+	const vec3 c = Upscale_Fetch(tex, f + ivec2(1, -1), maxTexel);
+	const vec3 e = Upscale_Fetch(tex, f + ivec2(-1, 0), maxTexel);
+	const vec3 fC = Upscale_Fetch(tex, f, maxTexel);
+	const vec3 g = Upscale_Fetch(tex, f + ivec2(1, 0), maxTexel);
+	const vec3 h = Upscale_Fetch(tex, f + ivec2(2, 0), maxTexel);
+	const vec3 i = Upscale_Fetch(tex, f + ivec2(-1, 1), maxTexel);
+	const vec3 j = Upscale_Fetch(tex, f + ivec2(0, 1), maxTexel);
+	const vec3 k = Upscale_Fetch(tex, f + ivec2(1, 1), maxTexel);
+	const vec3 l = Upscale_Fetch(tex, f + ivec2(2, 1), maxTexel);
+	const vec3 n = Upscale_Fetch(tex, f + ivec2(0, 2), maxTexel);
+	const vec3 o = Upscale_Fetch(tex, f + ivec2(1, 2), maxTexel);
+
+	const float bL = Upscale_Luma(b);
+	const float cL = Upscale_Luma(c);
+	const float eL = Upscale_Luma(e);
+	const float fL = Upscale_Luma(fC);
+	const float gL = Upscale_Luma(g);
+	const float hL = Upscale_Luma(h);
+	const float iL = Upscale_Luma(i);
+	const float jL = Upscale_Luma(j);
+	const float kL = Upscale_Luma(k);
+	const float lL = Upscale_Luma(l);
+	const float nL = Upscale_Luma(n);
+	const float oL = Upscale_Luma(o);
+
+	// Bilinearly weight each inner texel's edge direction and length
+	vec2 dir = vec2(0.0);
+	float len = 0.0;
+
+	Upscale_EdgeDirection(dir, len, (1.0 - pp.x) * (1.0 - pp.y), eL, gL, bL, jL, fL);
+	Upscale_EdgeDirection(dir, len, pp.x * (1.0 - pp.y), fL, hL, cL, kL, gL);
+	Upscale_EdgeDirection(dir, len, (1.0 - pp.x) * pp.y, iL, kL, fL, nL, jL);
+	Upscale_EdgeDirection(dir, len, pp.x * pp.y, jL, lL, gL, oL, kL);
+
+	const float dirR = dot(dir, dir);
+	const bool zero = dirR < (1.0 / 32768.0);
+
+	dir = zero ? vec2(1.0, 0.0) : dir * inversesqrt(dirR);
+	len = len * 0.5;
+	len *= len;
+
+	// Stretch the kernel along the edge, up to sqrt(2) for diagonals, and shrink its negative lobe as the edge sharpens
+	const float stretch = dot(dir, dir) / max(abs(dir.x), abs(dir.y));
+	const vec2 len2 = vec2(1.0 + (stretch - 1.0) * len, 1.0 - 0.5 * len);
+	const float lob = 0.5 + ((1.0 / 4.0 - 0.04) - 0.5) * len;
+	const float clp = 1.0 / lob;
+
+	vec3 color = vec3(0.0);
+	float weight = 0.0;
+
+	Upscale_Tap(color, weight, vec2(0.0, -1.0) - pp, dir, len2, lob, clp, b);
+	Upscale_Tap(color, weight, vec2(1.0, -1.0) - pp, dir, len2, lob, clp, c);
+	Upscale_Tap(color, weight, vec2(-1.0, 1.0) - pp, dir, len2, lob, clp, i);
+	Upscale_Tap(color, weight, vec2(0.0, 1.0) - pp, dir, len2, lob, clp, j);
+	Upscale_Tap(color, weight, vec2(0.0, 0.0) - pp, dir, len2, lob, clp, fC);
+	Upscale_Tap(color, weight, vec2(-1.0, 0.0) - pp, dir, len2, lob, clp, e);
+	Upscale_Tap(color, weight, vec2(1.0, 1.0) - pp, dir, len2, lob, clp, k);
+	Upscale_Tap(color, weight, vec2(2.0, 1.0) - pp, dir, len2, lob, clp, l);
+	Upscale_Tap(color, weight, vec2(2.0, 0.0) - pp, dir, len2, lob, clp, h);
+	Upscale_Tap(color, weight, vec2(1.0, 0.0) - pp, dir, len2, lob, clp, g);
+	Upscale_Tap(color, weight, vec2(1.0, 2.0) - pp, dir, len2, lob, clp, o);
+	Upscale_Tap(color, weight, vec2(0.0, 2.0) - pp, dir, len2, lob, clp, n);
+
+	// Dering against the inner quad
+	const vec3 minColor = min(min(fC, g), min(j, k));
+	const vec3 maxColor = max(max(fC, g), max(j, k));
+
+	return clamp(color / weight, minColor, maxColor);
+}
+
+// Sharpens the upscaled color against its low resolution cross neighbors, with the lobe limited so it can't push any
+// channel out of the neighborhood's range. sharpness is in [0, 1], 1 being the strongest
+vec3 Upscale_RCAS(sampler2D tex, const vec2 renderRes, const vec2 pixel, const vec3 color, const float sharpness)
+{
+	const ivec2 center = ivec2(pixel * renderRes);
+	const ivec2 maxTexel = ivec2(renderRes) - 1;
+
+	const vec3 b = Upscale_Fetch(tex, center + ivec2(0, -1), maxTexel);
+	const vec3 d = Upscale_Fetch(tex, center + ivec2(-1, 0), maxTexel);
+	const vec3 f = Upscale_Fetch(tex, center + ivec2(1, 0), maxTexel);
+	const vec3 h = Upscale_Fetch(tex, center + ivec2(0, 1), maxTexel);
+
+	const vec3 mn4 = min(min(b, d), min(f, h));
+	const vec3 mx4 = max(max(b, d), max(f, h));
+	const vec3 hitMin = min(mn4, color) / (4.0 * mx4 + 1.0 / 65536.0);
+	const vec3 hitMax = (1.0 - max(mx4, color)) / (4.0 * mn4 - 4.0 - 1.0 / 65536.0);
+	const vec3 lobeRGB = max(-hitMin, hitMax);
+	const float lobe = max(-RCAS_LIMIT, min(max(lobeRGB.r, max(lobeRGB.g, lobeRGB.b)), 0.0)) * sharpness;
+
+	return clamp((lobe * (b + d + f + h) + color) / (4.0 * lobe + 1.0), 0.0, 1.0);
+}
+
+#endif //#ifndef UPSCALE_GLSL
@@ -0,0 +1,522 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+#include <cmath>
+#include <malloc.h>
+#include "bvh/box_partitioner.h"
+#include "shaders/scene_defines.glsl"
+
+namespace
+{
+	static const unsigned MIN_BOX_COUNT = 16;
+	static const unsigned DEFAULT_MAX_BOX_COUNT = 1 << 20;
+	static const unsigned BOX_COUNT_STEP = 4;
+	static const unsigned KS[] = { 2, 4, 8, 16 };
+	static const unsigned RUN_BOX_BUDGET = 1 << 20; // Small counts get more runs, so every row costs about the same
+	static const unsigned MIN_RUN_COUNT = 3;
+	static const unsigned MAX_RUN_COUNT = 32;
+	static const unsigned TREE_COUNT = 14; // As in main.cpp
+
+	enum class Distribution
+	{
+		Uniform,
+		Clustered,
+		NestedLarge,
+		Scene,
+		Count
+	};
+
+	static const char* DistributionName(Distribution dist)
+	{
+		switch (dist)
+		{
+		case Distribution::Uniform: return "uniform";
+		case Distribution::Clustered: return "clustered";
+		case Distribution::NestedLarge: return "nested_large";
+		case Distribution::Scene: return "scene";
+		default: return "unknown";
+		}
+	}
+
+	static const char* MethodName(PartitionMethod method)
+	{
+		switch (method)
+		{
+		case PartitionMethod::Exhaustive: return "exhaustive";
+		case PartitionMethod::Bounded: return "bounded";
+		case PartitionMethod::Balanced: return "balanced";
+		default: return "unknown";
+		}
+	}
+
+	struct Box3
+	{
+		float mins[3];
+		float maxs[3];
+	};
+
+	static Box3 MakeBox(float x, float y, float z, float hx, float hy, float hz)
+	{
+		return Box3{ { x - hx, y - hy, z - hz }, { x + hx, y + hy, z + hz } };
+	}
+
+	static Box3 MakeBounds(float minX, float minY, float minZ, float maxX, float maxY, float maxZ)
+	{
+		return Box3{ { minX, minY, minZ }, { maxX, maxY, maxZ } };
+	}
+
+	// Same bounds Graphics hands the scene BVH: the one-off meshes, then flakes, snowballs and fireballs in the game's
+	// 256:16:16 mix filling out the rest of the boxes.
+	static void BuildSceneBoxes(unsigned boxCount, std::mt19937* rng, std::vector<Box3>* outBoxes)
+	{
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		const float platformXOffs = -BOTTOM_LEFT_PLATFORM_X + BOTTOM_PLATFORM_WIDTH;
+		const float platformYMin = -BOTTOM_LEFT_PLATFORM_Y + PLATFORM_DIM;
+		const float platformYMax = -platformYMin + (PLATFORM_VERTICAL_SPACE * PLATFORM_COUNT) + PLATFORM_DIM;
+
+		outBoxes->push_back(MakeBox(0.0f, -7.9f, 0.0f, 100.0f, 1.5f, 100.0f));
+		outBoxes->push_back(MakeBounds(-platformXOffs, -platformYMin, -PLATFORM_DIM, platformXOffs, platformYMax, PLATFORM_DIM));
+		outBoxes->push_back(MakeBounds(SNOWMAN_X - SNOWMAN_BOT_RADIUS, SNOWMAN_BOT_Y - SNOWMAN_BOT_RADIUS, SNOWMAN_Z - SNOWMAN_BOT_RADIUS,
+			SNOWMAN_X + SNOWMAN_BOT_RADIUS, SNOWMAN_TOP_Y + SNOWMAN_TOP_RADIUS, SNOWMAN_Z + SNOWMAN_BOT_RADIUS));
+		outBoxes->push_back(MakeBounds(-8.0f - PLAYER_WIDTH * 0.5f, -6.0f, -PLAYER_WIDTH * 0.5f, -8.0f + PLAYER_WIDTH * 0.5f, -6.0f + PLAYER_HEIGHT, PLAYER_WIDTH * 0.5f));
+		outBoxes->push_back(MakeBox(0.0f, 4.0f, 0.0f, HELPER_RADIUS, HELPER_RADIUS, HELPER_RADIUS));
+
+		for (unsigned treeIndex = 0; treeIndex < TREE_COUNT; ++treeIndex)
+		{
+			const float treeZ = -(unit(*rng) * 30.0f + 25.0f);
+			const float treeX = (unit(*rng) - 0.5f) * treeZ * 1.25f;
+			const float treeY = -7.5f;
+
+			outBoxes->push_back(MakeBounds(treeX - 2.0f, treeY - 2.0f, treeZ - 2.0f, treeX + 2.0f, treeY + 5.0f, treeZ + 2.0f));
+		}
+
+		for (unsigned entityIndex = 0; outBoxes->size() < boxCount; ++entityIndex)
+		{
+			const unsigned mixIndex = entityIndex % (256 + 16 + 16);
+
+			if (mixIndex < 256)
+			{
+				const float x = (unit(*rng) - 0.5f) * BOUNDS_HALF_WIDTH * 2.0f;
+				const float y = (unit(*rng) - 0.5f) * BOUNDS_HALF_HEIGHT * 2.0f;
+
+				outBoxes->push_back(MakeBox(x, y, 0.0f, SNOWFLAKE_RADIUS, SNOWFLAKE_RADIUS, SNOWFLAKE_RADIUS));
+			}
+			else if (mixIndex < 256 + 16)
+			{
+				const float x = (unit(*rng) - 0.5f) * 4.0f;
+				const float y = -BOUNDS_HALF_HEIGHT + 1.0f + unit(*rng) * 6.0f;
+				const float radius = SNOWBALL_RADIUS * 1.3f;
+
+				outBoxes->push_back(MakeBox(x, y, 0.0f, radius, radius, radius));
+			}
+			else
+			{
+				const float side = ((*rng)() & 1) ? 1.0f : -1.0f;
+				const unsigned row = (*rng)() % 3;
+				const float x = side * (BOUNDS_HALF_WIDTH + 4.0f + FIREBALL_RADIUS) * unit(*rng);
+				const float y = row * 1.5f - (BOUNDS_HALF_HEIGHT - (1.5f + FIREBALL_RADIUS));
+				const float radius = FIREBALL_RADIUS * 2.0f;
+
+				outBoxes->push_back(MakeBox(x, y, 0.0f, radius, radius, radius));
+			}
+		}
+
+		outBoxes->resize(boxCount);
+	}
+
+	// 3D boxes for every distribution. Lower dimensions take the leading axes, 4D sweeps them through time.
+	static std::vector<Box3> BuildBoxes(Distribution dist, unsigned boxCount, unsigned seed)
+	{
+		static const unsigned CLUSTER_COUNT = 16;
+		static const unsigned SMALL_PER_LARGE = 63;
+		std::mt19937 rng(seed);
+		std::uniform_real_distribution<float> world(-100.0f, 100.0f);
+		std::uniform_real_distribution<float> smallExtent(0.05f, 1.0f);
+		std::vector<Box3> boxes;
+
+		boxes.reserve(boxCount);
+
+		switch (dist)
+		{
+		case Distribution::Uniform:
+			while (boxes.size() < boxCount)
+				boxes.push_back(MakeBox(world(rng), world(rng), world(rng), smallExtent(rng), smallExtent(rng), smallExtent(rng)));
+			break;
+
+		case Distribution::Clustered:
+		{
+			std::normal_distribution<float> spread(0.0f, 4.0f);
+			float centers[CLUSTER_COUNT][3];
+
+			for (float(&center)[3] : centers)
+				for (float& coord : center)
+					coord = world(rng);
+
+			while (boxes.size() < boxCount)
+			{
+				const float(&center)[3] = centers[rng() % CLUSTER_COUNT];
+
+				boxes.push_back(MakeBox(center[0] + spread(rng), center[1] + spread(rng), center[2] + spread(rng), smallExtent(rng), smallExtent(rng), smallExtent(rng)));
+			}
+		}
+		break;
+
+		// A few large boxes each holding a crowd of small ones, like a level's static meshes around its props
+		case Distribution::NestedLarge:
+		{
+			std::uniform_real_distribution<float> largeExtent(10.0f, 40.0f);
+			std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+			while (boxes.size() < boxCount)
+			{
+				const Box3 large = MakeBox(world(rng), world(rng), world(rng), largeExtent(rng), largeExtent(rng), largeExtent(rng));
+
+				boxes.push_back(large);
+
+				for (unsigned smallIndex = 0; smallIndex < SMALL_PER_LARGE && boxes.size() < boxCount; ++smallIndex)
+				{
+					float center[3];
+
+					for (unsigned d = 0; d < 3; ++d)
+						center[d] = large.mins[d] + (large.maxs[d] - large.mins[d]) * unit(rng);
+
+					boxes.push_back(MakeBox(center[0], center[1], center[2], smallExtent(rng), smallExtent(rng), smallExtent(rng)));
+				}
+			}
+
+			std::shuffle(boxes.begin(), boxes.end(), rng);
+		}
+		break;
+
+		case Distribution::Scene:
+			BuildSceneBoxes(boxCount, &rng, &boxes);
+			std::shuffle(boxes.begin(), boxes.end(), rng);
+			break;
+
+		default:
+			break;
+		}
+
+		return boxes;
+	}
+
+	struct Box4
+	{
+		float mins[4];
+		float maxs[4];
+	};
+
+	// The same boxes moving over a short time window each, as their swept bounds with time on the fourth axis
+	static std::vector<Box4> SweepBoxes(const std::vector<Box3>& boxes, unsigned seed)
+	{
+		static const float TIME_SPAN = 8.0f;
+		std::mt19937 rng(seed);
+		std::uniform_real_distribution<float> velocity(-4.0f, 4.0f);
+		std::uniform_real_distribution<float> startTime(0.0f, TIME_SPAN);
+		std::uniform_real_distribution<float> duration(0.05f, 0.5f);
+		std::vector<Box4> swept(boxes.size());
+
+		for (size_t boxIndex = 0; boxIndex < boxes.size(); ++boxIndex)
+		{
+			const float start = startTime(rng);
+			const float end = start + duration(rng);
+
+			for (unsigned d = 0; d < 3; ++d)
+			{
+				const float move = velocity(rng) * (end - start);
+
+				swept[boxIndex].mins[d] = boxes[boxIndex].mins[d] + std::min(move, 0.0f);
+				swept[boxIndex].maxs[d] = boxes[boxIndex].maxs[d] + std::max(move, 0.0f);
+			}
+
+			swept[boxIndex].mins[3] = start;
+			swept[boxIndex].maxs[3] = end;
+		}
+
+		return swept;
+	}
+
+	template <unsigned D>
+	struct BenchBoxes
+	{
+		static std::vector<Box3> Build(Distribution dist, unsigned boxCount, unsigned seed)
+		{
+			return BuildBoxes(dist, boxCount, seed);
+		}
+	};
+
+	template <>
+	struct BenchBoxes<4>
+	{
+		static std::vector<Box4> Build(Distribution dist, unsigned boxCount, unsigned seed)
+		{
+			return SweepBoxes(BuildBoxes(dist, boxCount, seed), seed + 1);
+		}
+	};
+
+	static float* AllocFloats(unsigned count)
+	{
+		return static_cast<float*>(_aligned_malloc(sizeof(float) * count, 64));
+	}
+
+	template <unsigned D>
+	struct BoxSet
+	{
+		float* mins[D];
+		float* maxs[D];
+		unsigned* indices;
+
+		explicit BoxSet(unsigned boxCount)
+		{
+			for (unsigned d = 0; d < D; ++d)
+			{
+				mins[d] = AllocFloats(boxCount);
+				maxs[d] = AllocFloats(boxCount);
+			}
+
+			indices = reinterpret_cast<unsigned*>(AllocFloats(boxCount));
+		}
+
+		~BoxSet()
+		{
+			for (unsigned d = 0; d < D; ++d)
+			{
+				_aligned_free(mins[d]);
+				_aligned_free(maxs[d]);
+			}
+
+			_aligned_free(indices);
+		}
+
+		BoxSet(const BoxSet&) = delete;
+		BoxSet& operator=(const BoxSet&) = delete;
+
+		template <typename Box>
+		void Load(const std::vector<Box>& boxes)
+		{
+			for (unsigned boxIndex = 0; boxIndex < boxes.size(); ++boxIndex)
+			{
+				for (unsigned d = 0; d < D; ++d)
+				{
+					mins[d][boxIndex] = boxes[boxIndex].mins[d];
+					maxs[d][boxIndex] = boxes[boxIndex].maxs[d];
+				}
+			}
+		}
+	};
+
+	struct Quality
+	{
+		double cost;        // Mean squared distance from each box's center to its partition's centroid, the k-means objective
+		double boundsRatio; // Partition bounds' summed surface measure over the whole set's, what a BVH pays per traversal
+	};
+
+	template <unsigned D>
+	static double BoundsMeasure(const double(&mins)[D], const double(&maxs)[D])
+	{
+		if (D == 1)
+			return maxs[0] - mins[0];
+
+		double measure = 0.0;
+
+		// Half the surface area in 3D, half the perimeter in 2D
+		for (unsigned d = 0; d < D; ++d)
+		{
+			double face = 1.0;
+
+			for (unsigned otherD = 0; otherD < D; ++otherD)
+			{
+				if (otherD != d)
+					face *= maxs[otherD] - mins[otherD];
+			}
+
+			measure += face;
+		}
+
+		return measure;
+	}
+
+	// Boxes come back grouped by partition, so each partition is a contiguous range
+	template <unsigned D>
+	static Quality MeasureQuality(const BoxSet<D>& boxes, unsigned boxCount, const unsigned* partitions, unsigned k)
+	{
+		Quality quality{ 0.0, 0.0 };
+		double allMins[D];
+		double allMaxs[D];
+		double partitionMeasure = 0.0;
+		unsigned partitionBegin = 0;
+
+		std::fill(allMins, allMins + D, HUGE_VAL);
+		std::fill(allMaxs, allMaxs + D, -HUGE_VAL);
+
+		for (unsigned partitionIndex = 0; partitionIndex < k; ++partitionIndex)
+		{
+			const unsigned partitionEnd = partitions[partitionIndex];
+			double centroid[D] = {};
+			double mins[D];
+			double maxs[D];
+
+			if (partitionBegin == partitionEnd)
+				continue;
+
+			std::fill(mins, mins + D, HUGE_VAL);
+			std::fill(maxs, maxs + D, -HUGE_VAL);
+
+			for (unsigned boxIndex = partitionBegin; boxIndex < partitionEnd; ++boxIndex)
+			{
+				for (unsigned d = 0; d < D; ++d)
+				{
+					centroid[d] += 0.5 * (boxes.mins[d][boxIndex] + boxes.maxs[d][boxIndex]);
+					mins[d] = std::min<double>(mins[d], boxes.mins[d][boxIndex]);
+					maxs[d] = std::max<double>(maxs[d], boxes.maxs[d][boxIndex]);
+				}
+			}
+
+			for (unsigned d = 0; d < D; ++d)
+			{
+				centroid[d] /= partitionEnd - partitionBegin;
+				allMins[d] = std::min(allMins[d], mins[d]);
+				allMaxs[d] = std::max(allMaxs[d], maxs[d]);
+			}
+
+			for (unsigned boxIndex = partitionBegin; boxIndex < partitionEnd; ++boxIndex)
+			{
+				for (unsigned d = 0; d < D; ++d)
+				{
+					const double offset = 0.5 * (boxes.mins[d][boxIndex] + boxes.maxs[d][boxIndex]) - centroid[d];
+
+					quality.cost += offset * offset;
+				}
+			}
+
+			partitionMeasure += BoundsMeasure<D>(mins, maxs);
+			partitionBegin = partitionEnd;
+		}
+
+		quality.cost /= boxCount;
+		quality.boundsRatio = partitionMeasure / BoundsMeasure<D>(allMins, allMaxs);
+
+		return quality;
+	}
+
+	// Partitioning the same boxes again from the seeds a run hands back should settle straight away. Returns false and
+	// reports the case when it doesn't.
+	template <unsigned D>
+	static bool CheckWarmStart(Distribution dist, PartitionMethod method, unsigned boxCount, unsigned k, void* workMem)
+	{
+		static const unsigned MAX_WARM_ITERATIONS = 2;
+		const auto source = BenchBoxes<D>::Build(dist, boxCount, boxCount * 31);
+		BoxSet<D> boxes(boxCount);
+		float seedMeans[D][16];
+		float* seedMeanPtrs[D];
+		unsigned partitions[16];
+		PartitionStats stats;
+
+		for (unsigned d = 0; d < D; ++d)
+			seedMeanPtrs[d] = seedMeans[d];
+
+		PartitionSeeds seeds{ seedMeanPtrs, false };
+
+		boxes.Load(source);
+		PartitionBoxes<D>(k, boxes.mins, boxes.maxs, boxCount, boxes.indices, partitions, workMem, method, &seeds, nullptr);
+
+		// Nothing to check when the run never settled or the partition is exact
+		if (!seeds.valid)
+			return true;
+
+		// The first run left the boxes grouped by partition
+		boxes.Load(source);
+		PartitionBoxes<D>(k, boxes.mins, boxes.maxs, boxCount, boxes.indices, partitions, workMem, method, &seeds, &stats);
+
+		if (stats.iterations > MAX_WARM_ITERATIONS)
+		{
+			std::cerr << "Warm start took " << stats.iterations << " iterations for " << D << "D " << DistributionName(dist) << ' ' << MethodName(method)
+				<< ", " << boxCount << " boxes, k " << k << std::endl;
+			return false;
+		}
+
+		return true;
+	}
+
+	template <unsigned D>
+	static bool BenchCase(Distribution dist, PartitionMethod method, unsigned boxCount, unsigned k)
+	{
+		const unsigned runCount = std::min(std::max(RUN_BOX_BUDGET / boxCount, MIN_RUN_COUNT), MAX_RUN_COUNT);
+		std::vector<char> workMem(ComputePartitionBoxesWorkMemSize<D>(boxCount));
+		BoxSet<D> boxes(boxCount);
+		unsigned partitions[16];
+		double totalMs = 0.0;
+		double minMs = HUGE_VAL;
+		double totalIterations = 0.0;
+		unsigned convergedCount = 0;
+		Quality totalQuality{ 0.0, 0.0 };
+
+		for (unsigned runIndex = 0; runIndex < runCount; ++runIndex)
+		{
+			PartitionStats stats;
+
+			boxes.Load(BenchBoxes<D>::Build(dist, boxCount, boxCount * 31 + runIndex));
+
+			const auto start = std::chrono::high_resolution_clock::now();
+			const bool converged = PartitionBoxes<D>(k, boxes.mins, boxes.maxs, boxCount, boxes.indices, partitions, workMem.data(), method, nullptr, &stats);
+			const auto end = std::chrono::high_resolution_clock::now();
+			const double ms = std::chrono::duration<double, std::milli>(end - start).count();
+			const Quality quality = MeasureQuality<D>(boxes, boxCount, partitions, k);
+
+			totalMs += ms;
+			minMs = std::min(minMs, ms);
+			totalIterations += stats.iterations;
+			convergedCount += converged ? 1 : 0;
+			totalQuality.cost += quality.cost;
+			totalQuality.boundsRatio += quality.boundsRatio;
+		}
+
+		std::cout << D << ',' << DistributionName(dist) << ',' << MethodName(method) << ',' << boxCount << ',' << k << ',' << runCount << ','
+			<< totalMs / runCount << ',' << minMs << ','
+			<< totalIterations / runCount << ',' << static_cast<double>(convergedCount) / runCount << ','
+			<< totalQuality.cost / runCount << ',' << totalQuality.boundsRatio / runCount << std::endl;
+
+		return CheckWarmStart<D>(dist, method, boxCount, k, workMem.data());
+	}
+
+	template <unsigned D>
+	static bool BenchDimension(unsigned maxBoxCount)
+	{
+		bool passed = true;
+
+		for (unsigned distIndex = 0; distIndex < static_cast<unsigned>(Distribution::Count); ++distIndex)
+		{
+			for (PartitionMethod method : { PartitionMethod::Exhaustive, PartitionMethod::Bounded, PartitionMethod::Balanced })
+			{
+				for (unsigned boxCount = MIN_BOX_COUNT; boxCount <= maxBoxCount; boxCount *= BOX_COUNT_STEP)
+				{
+					for (unsigned k : KS)
+						passed &= BenchCase<D>(static_cast<Distribution>(distIndex), method, boxCount, k);
+				}
+			}
+		}
+
+		return passed;
+	}
+}
+
+// Sweeps PartitionLines and PartitionBoxes2D, 3D and 4D over box counts, k, input distributions and partition
+// methods, writing one CSV row per case to stdout. Times are wall clock ms per call, quality columns are averaged
+// over the runs, each of which draws a fresh set of boxes. Each case also checks that a warm start from its own seeds
+// settles straight away, reporting any that don't to stderr and failing the run.
+int main(int argc, char* argv[])
+{
+	const unsigned maxBoxCount = argc > 1 ? static_cast<unsigned>(std::max(std::atoi(argv[1]), static_cast<int>(MIN_BOX_COUNT))) : DEFAULT_MAX_BOX_COUNT;
+
+	std::cout << "dims,distribution,method,boxes,k,runs,ms_mean,ms_min,iterations_mean,converged_rate,cost,bounds_ratio" << std::endl;
+
+	bool passed = BenchDimension<1>(maxBoxCount);
+	passed &= BenchDimension<2>(maxBoxCount);
+	passed &= BenchDimension<3>(maxBoxCount);
+	passed &= BenchDimension<4>(maxBoxCount);
+
+	return passed ? 0 : 1;
+}
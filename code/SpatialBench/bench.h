@@ -0,0 +1,4 @@
+#pragma once
+
+void RunBroadPhaseBench(unsigned stepCount);
+void RunSceneEntryBench(unsigned frameCount);
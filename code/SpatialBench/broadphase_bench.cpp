@@ -0,0 +1,235 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+#include "Box2D/Collision/b2BroadPhase.h"
+#include "SpatialBroadPhase.h"
+#include "shaders/scene_defines.glsl"
+#include "bench.h"
+
+namespace
+{
+	static const float FRAME_TIME = 1.0f / 60.0f;
+	static const float FLAKE_RADIUS = static_cast<float>(SNOWFLAKE_RADIUS) * 0.8f; // Matches the snowflake body in Physics
+
+	struct Flake
+	{
+		b2Vec2 pos;
+		b2Vec2 vel;
+		int32 proxyId;
+	};
+
+	// What one UpdatePairs reported: how many pairs, and a hash of them that doesn't depend on their order
+	struct PairUpdate
+	{
+		size_t pairCount;
+		uint64_t pairHash;
+	};
+
+	struct Timings
+	{
+		double createMs;
+		double moveMs;
+		double pairMs;
+		double churnMs;
+		size_t pairs;
+		std::vector<PairUpdate> pairUpdates;
+	};
+
+	// Stands in for b2ContactManager. User data is handed out in the same order for both broad-phases, so it names the
+	// same proxy in either and the updates can be checked against each other.
+	struct PairRecorder
+	{
+		PairUpdate update;
+		std::vector<PairUpdate> updates;
+
+		void AddPair(void* userDataA, void* userDataB)
+		{
+			const uint64_t idA = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(userDataA));
+			const uint64_t idB = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(userDataB));
+			uint64_t key = (std::min(idA, idB) << 32) | std::max(idA, idB);
+
+			// splitmix64's finalizer, so summing keys can't cancel out
+			key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9ull;
+			key = (key ^ (key >> 27)) * 0x94d049bb133111ebull;
+			key ^= key >> 31;
+
+			update.pairHash += key;
+			++update.pairCount;
+		}
+
+		template <typename BroadPhase>
+		void UpdatePairs(BroadPhase* broadPhase)
+		{
+			update = {};
+			broadPhase->UpdatePairs(this);
+			updates.push_back(update);
+		}
+	};
+
+	static b2AABB FlakeAABB(const b2Vec2& pos)
+	{
+		b2AABB aabb;
+
+		aabb.lowerBound = b2Vec2(pos.x - FLAKE_RADIUS, pos.y - FLAKE_RADIUS);
+		aabb.upperBound = b2Vec2(pos.x + FLAKE_RADIUS, pos.y + FLAKE_RADIUS);
+
+		return aabb;
+	}
+
+	static b2AABB BoxAABB(float x, float y, float hw, float hh)
+	{
+		b2AABB aabb;
+
+		aabb.lowerBound = b2Vec2(x - hw, y - hh);
+		aabb.upperBound = b2Vec2(x + hw, y + hh);
+
+		return aabb;
+	}
+
+	template <typename Func>
+	static double TimeMs(Func&& BenchFunc)
+	{
+		const auto start = std::chrono::high_resolution_clock::now();
+
+		BenchFunc();
+
+		return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	// Same proxy traffic b2World generates for falling snow: walls and platforms as static proxies, every flake moved
+	// each step, flakes melting at the ground destroyed and respawned at the top, then one pair update per step.
+	template <typename BroadPhase>
+	static Timings RunBench(unsigned flakeCount, unsigned stepCount)
+	{
+		std::mt19937 rng(flakeCount);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		BroadPhase broadPhase;
+		PairRecorder pairRecorder;
+		std::vector<Flake> flakes(flakeCount);
+		Timings timings = {};
+		int32 userData = 0;
+
+		auto NextUserData = [&userData]() { return reinterpret_cast<void*>(static_cast<intptr_t>(++userData)); };
+
+		timings.createMs = TimeMs([&]()
+		{
+			broadPhase.CreateProxy(BoxAABB(-(BOUNDS_HALF_WIDTH + 1.0f), 0.0f, 1.0f, BOUNDS_HALF_HEIGHT), NextUserData());
+			broadPhase.CreateProxy(BoxAABB(BOUNDS_HALF_WIDTH + 1.0f, 0.0f, 1.0f, BOUNDS_HALF_HEIGHT), NextUserData());
+			broadPhase.CreateProxy(BoxAABB(0.0f, BOUNDS_HALF_HEIGHT + 1.0f, BOUNDS_HALF_WIDTH + 2.0f, 1.0f), NextUserData());
+			broadPhase.CreateProxy(BoxAABB(0.0f, -(BOUNDS_HALF_HEIGHT + 1.0f), BOUNDS_HALF_WIDTH + 2.0f, 1.0f), NextUserData());
+
+			for (unsigned platformIndex = 0; platformIndex < PLATFORM_COUNT; ++platformIndex)
+			{
+				const float w = static_cast<float>(BOTTOM_PLATFORM_WIDTH - platformIndex * PLATFORM_WIDTH_DROP);
+				const float y = static_cast<float>(BOTTOM_LEFT_PLATFORM_Y + platformIndex * PLATFORM_VERTICAL_SPACE);
+
+				broadPhase.CreateProxy(BoxAABB(BOTTOM_LEFT_PLATFORM_X, y, w, PLATFORM_DIM), NextUserData());
+				broadPhase.CreateProxy(BoxAABB(-BOTTOM_LEFT_PLATFORM_X, y, w, PLATFORM_DIM), NextUserData());
+			}
+
+			for (Flake& flake : flakes)
+			{
+				flake.pos = b2Vec2((unit(rng) - 0.5f) * BOUNDS_HALF_WIDTH * 2.0f, (unit(rng) - 0.5f) * BOUNDS_HALF_HEIGHT * 2.0f);
+				flake.vel = b2Vec2((unit(rng) - 0.5f) * 0.5f, -1.0f - unit(rng));
+				flake.proxyId = broadPhase.CreateProxy(FlakeAABB(flake.pos), NextUserData());
+			}
+
+			pairRecorder.UpdatePairs(&broadPhase);
+		});
+
+		for (unsigned step = 0; step < stepCount; ++step)
+		{
+			timings.moveMs += TimeMs([&]()
+			{
+				for (Flake& flake : flakes)
+				{
+					const b2Vec2 displacement = FRAME_TIME * flake.vel;
+
+					flake.pos += displacement;
+					broadPhase.MoveProxy(flake.proxyId, FlakeAABB(flake.pos), displacement);
+				}
+			});
+
+			timings.churnMs += TimeMs([&]()
+			{
+				for (Flake& flake : flakes)
+				{
+					if (flake.pos.y < -BOUNDS_HALF_HEIGHT + SNOWFLAKE_RADIUS)
+					{
+						broadPhase.DestroyProxy(flake.proxyId);
+						flake.pos = b2Vec2((unit(rng) - 0.5f) * BOUNDS_HALF_WIDTH * 2.0f, static_cast<float>(BOUNDS_HALF_HEIGHT + SNOWFLAKE_RADIUS));
+						flake.proxyId = broadPhase.CreateProxy(FlakeAABB(flake.pos), NextUserData());
+					}
+				}
+			});
+
+			timings.pairMs += TimeMs([&]() { pairRecorder.UpdatePairs(&broadPhase); });
+		}
+
+		timings.moveMs /= stepCount;
+		timings.churnMs /= stepCount;
+		timings.pairMs /= stepCount;
+
+		for (const PairUpdate& update : pairRecorder.updates)
+			timings.pairs += update.pairCount;
+
+		timings.pairUpdates = std::move(pairRecorder.updates);
+
+		return timings;
+	}
+
+	static void PrintRow(const char* name, unsigned flakeCount, const Timings& timings)
+	{
+		std::cout << std::left << std::setw(20) << name << std::right
+			<< std::setw(8) << flakeCount
+			<< std::fixed << std::setprecision(4)
+			<< std::setw(11) << timings.createMs
+			<< std::setw(11) << timings.moveMs
+			<< std::setw(11) << timings.churnMs
+			<< std::setw(11) << timings.pairMs
+			<< std::setw(11) << timings.moveMs + timings.churnMs + timings.pairMs
+			<< std::setw(12) << timings.pairs << std::endl;
+	}
+}
+
+void RunBroadPhaseBench(unsigned stepCount)
+{
+	static const unsigned flakeCounts[] = { 1000, 2500, 5000, 10000 };
+
+	std::cout << "Broad-phase: " << stepCount << " steps per count, times are ms per step (create is one-off)" << std::endl;
+	std::cout << std::left << std::setw(20) << "broad-phase" << std::right
+		<< std::setw(8) << "flakes"
+		<< std::setw(11) << "create"
+		<< std::setw(11) << "move"
+		<< std::setw(11) << "churn"
+		<< std::setw(11) << "pairs"
+		<< std::setw(11) << "step"
+		<< std::setw(12) << "pair count" << std::endl;
+
+	for (unsigned flakeCount : flakeCounts)
+	{
+		const Timings boxTimings = RunBench<b2BroadPhase>(flakeCount, stepCount);
+		const Timings spatialTimings = RunBench<SpatialBroadPhase>(flakeCount, stepCount);
+
+		PrintRow("b2BroadPhase", flakeCount, boxTimings);
+		PrintRow("SpatialBroadPhase", flakeCount, spatialTimings);
+
+		// Same traffic, so every update must report the same pairs
+		for (size_t updateIndex = 0; updateIndex < boxTimings.pairUpdates.size(); ++updateIndex)
+		{
+			const PairUpdate& boxUpdate = boxTimings.pairUpdates[updateIndex];
+			const PairUpdate& spatialUpdate = spatialTimings.pairUpdates[updateIndex];
+
+			if (boxUpdate.pairCount != spatialUpdate.pairCount || boxUpdate.pairHash != spatialUpdate.pairHash)
+			{
+				std::cout << "Broad-phase pair mismatch for " << flakeCount << " flakes at update " << updateIndex
+					<< ": " << boxUpdate.pairCount << " pairs vs " << spatialUpdate.pairCount << std::endl;
+				break;
+			}
+		}
+	}
+}
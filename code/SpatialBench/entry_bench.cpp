@@ -0,0 +1,198 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <numeric>
+#include "glm/glm.hpp"
+#include "glm/gtx/euler_angles.hpp"
+#include "glm/ext/matrix_transform.hpp"
+#include "Component.h"
+#include "SceneEntry.h"
+#include "shaders/scene_defines.glsl"
+#include "bench.h"
+
+namespace
+{
+	static const float FRAME_TIME = 1.0f / 60.0f;
+
+	struct Bodies
+	{
+		std::vector<uint> ids;
+		std::vector<float> x, y, rot;
+		std::vector<float> vx, vy, spin;
+	};
+
+	struct Timings
+	{
+		double inverseMs;
+		double matrixMs;
+		double batchMs;
+		double kernelMs;
+	};
+
+	template <typename Func>
+	static double TimeMs(Func&& BenchFunc)
+	{
+		const auto start = std::chrono::high_resolution_clock::now();
+
+		BenchFunc();
+
+		return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	// Physics hands bodies over in its own order, so the ids are shuffled against the entry order like in the game
+	static Bodies BuildBodies(uint bodyCount, std::mt19937* rng)
+	{
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		Bodies bodies;
+
+		bodies.ids.resize(bodyCount);
+		std::iota(bodies.ids.begin(), bodies.ids.end(), 0);
+		std::shuffle(bodies.ids.begin(), bodies.ids.end(), *rng);
+
+		for (uint bodyIndex = 0; bodyIndex < bodyCount; ++bodyIndex)
+		{
+			bodies.x.push_back((unit(*rng) - 0.5f) * BOUNDS_HALF_WIDTH * 2.0f);
+			bodies.y.push_back((unit(*rng) - 0.5f) * BOUNDS_HALF_HEIGHT * 2.0f);
+			bodies.rot.push_back((unit(*rng) - 0.5f) * 20.0f);
+			bodies.vx.push_back((unit(*rng) - 0.5f) * 0.5f);
+			bodies.vy.push_back(-1.0f - unit(*rng));
+			bodies.spin.push_back((unit(*rng) - 0.5f) * 4.0f);
+		}
+
+		return bodies;
+	}
+
+	static void StepBodies(Bodies* bodies)
+	{
+		for (size_t bodyIndex = 0; bodyIndex < bodies->ids.size(); ++bodyIndex)
+		{
+			bodies->x[bodyIndex] += bodies->vx[bodyIndex] * FRAME_TIME;
+			bodies->y[bodyIndex] += bodies->vy[bodyIndex] * FRAME_TIME;
+			bodies->rot[bodyIndex] += bodies->spin[bodyIndex] * FRAME_TIME;
+		}
+	}
+
+	// The paths from UpdatePositions' physics transforms to scene entries:
+	// inverse - a matrix per body, inverted into a mat4 entry, as before entries were packed
+	// matrix - a matrix per body, packed into an entry by gfx::UpdateModels' mat4 overload
+	// batch - the SoA overload, ids looked up then entry::SetTransforms
+	// kernel - entry::SetTransforms alone, over already looked up entry indices
+	static Timings RunBench(uint bodyCount, uint frameCount)
+	{
+		std::mt19937 rng(bodyCount);
+		Bodies bodies = BuildBodies(bodyCount, &rng);
+		component_list<glm::mat4> matrixEntries;
+		component_list<entry::SceneEntry, true> sceneEntries;
+		std::vector<uint> entryIndices(bodyCount);
+		Timings timings = {};
+
+		for (uint objId = 0; objId < bodyCount; ++objId)
+		{
+			matrixEntries.add_to_object(objId) = glm::mat4(1.0f);
+			sceneEntries.add_to_object(objId) = {};
+			entry::SetType(sceneEntries.for_object(objId), MESH_TYPE_SNOW_FLAKE, 0.5f);
+		}
+
+		for (uint frame = 0; frame < frameCount; ++frame)
+		{
+			StepBodies(&bodies);
+
+			timings.inverseMs += TimeMs([&]()
+			{
+				for (uint bodyIndex = 0; bodyIndex < bodyCount; ++bodyIndex)
+				{
+					const glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::vec3(bodies.x[bodyIndex], bodies.y[bodyIndex], 0.0f)) * glm::eulerAngleZ(bodies.rot[bodyIndex]);
+					glm::mat4* const outEntry = matrixEntries.for_object(bodies.ids[bodyIndex]);
+					const float meshType = (*outEntry)[3][3];
+
+					*outEntry = glm::inverse(transform);
+					(*outEntry)[3][3] = meshType;
+				}
+			});
+
+			timings.matrixMs += TimeMs([&]()
+			{
+				for (uint bodyIndex = 0; bodyIndex < bodyCount; ++bodyIndex)
+				{
+					const glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::vec3(bodies.x[bodyIndex], bodies.y[bodyIndex], 0.0f)) * glm::eulerAngleZ(bodies.rot[bodyIndex]);
+
+					entry::SetTransform(sceneEntries.for_object(bodies.ids[bodyIndex]), transform);
+				}
+			});
+
+			sceneEntries.dirtyIds.clear();
+
+			timings.batchMs += TimeMs([&]()
+			{
+				entry::SceneEntry* const entries = sceneEntries.data();
+
+				for (uint bodyIndex = 0; bodyIndex < bodyCount; ++bodyIndex)
+				{
+					entryIndices[bodyIndex] = static_cast<uint>(sceneEntries.for_object(bodies.ids[bodyIndex]) - entries);
+				}
+
+				entry::SetTransforms(entries, entryIndices.data(), bodies.x.data(), bodies.y.data(), bodies.rot.data(), bodyCount);
+			});
+
+			sceneEntries.dirtyIds.clear();
+
+			timings.kernelMs += TimeMs([&]()
+			{
+				entry::SetTransforms(sceneEntries.data(), entryIndices.data(), bodies.x.data(), bodies.y.data(), bodies.rot.data(), bodyCount);
+			});
+		}
+
+		// The batch must land on the same bits as the mat4 path, up to atan2 rounding a turn fraction the other way
+		for (uint bodyIndex = 0; bodyIndex < bodyCount; ++bodyIndex)
+		{
+			const glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::vec3(bodies.x[bodyIndex], bodies.y[bodyIndex], 0.0f)) * glm::eulerAngleZ(bodies.rot[bodyIndex]);
+			entry::SceneEntry matrixEntry = *sceneEntries.for_object(bodies.ids[bodyIndex]);
+
+			entry::SetTransform(&matrixEntry, transform);
+
+			const entry::SceneEntry& batchEntry = sceneEntries[entryIndices[bodyIndex]];
+			const uint rotationDelta = (matrixEntry.typeRotation - batchEntry.typeRotation + 1) & SCENE_ENTRY_ROTATION_MASK;
+
+			if (matrixEntry.position != batchEntry.position || rotationDelta > 2 || (matrixEntry.typeRotation & ~SCENE_ENTRY_ROTATION_MASK) != (batchEntry.typeRotation & ~SCENE_ENTRY_ROTATION_MASK))
+			{
+				std::cout << "Scene entry mismatch for body " << bodyIndex << std::endl;
+				break;
+			}
+		}
+
+		timings.inverseMs /= frameCount;
+		timings.matrixMs /= frameCount;
+		timings.batchMs /= frameCount;
+		timings.kernelMs /= frameCount;
+
+		return timings;
+	}
+}
+
+void RunSceneEntryBench(unsigned frameCount)
+{
+	static const uint bodyCounts[] = { 256, 4096, 65536 };
+
+	std::cout << "Scene entries: " << frameCount << " frames per count, times are ms per frame" << std::endl;
+	std::cout << std::right
+		<< std::setw(8) << "bodies"
+		<< std::setw(11) << "inverse"
+		<< std::setw(11) << "matrix"
+		<< std::setw(11) << "batch"
+		<< std::setw(11) << "kernel" << std::endl;
+
+	for (uint bodyCount : bodyCounts)
+	{
+		const Timings timings = RunBench(bodyCount, frameCount);
+
+		std::cout << std::right << std::setw(8) << bodyCount
+			<< std::fixed << std::setprecision(4)
+			<< std::setw(11) << timings.inverseMs
+			<< std::setw(11) << timings.matrixMs
+			<< std::setw(11) << timings.batchMs
+			<< std::setw(11) << timings.kernelMs << std::endl;
+	}
+}
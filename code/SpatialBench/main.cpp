@@ -0,0 +1,310 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include "bvh/spatial_tree.h"
+#include "bvh/spatial_grid.h"
+#include "shaders/scene_defines.glsl"
+#include "bench.h"
+
+namespace
+{
+	// Game caps are 256 snowflakes, 16 snowballs and 16 fireballs. Larger scales keep the same mix.
+	static const unsigned SNOWFLAKES_PER_SCALE = 256;
+	static const unsigned SNOWBALLS_PER_SCALE = 16;
+	static const unsigned FIREBALLS_PER_SCALE = 16;
+	static const float FRAME_TIME = 1.0f / 60.0f;
+	static const unsigned QUERIES_PER_FRAME = 64;
+
+	struct Entity
+	{
+		float pos[2];
+		float vel[2];
+		float halfExtent;
+	};
+
+	struct Scene
+	{
+		std::vector<Entity> entities;
+		std::vector<unsigned> ids;
+	};
+
+	struct Timings
+	{
+		double buildMs;
+		double updateMs;
+		double queryMs;
+		double rayMs;
+		double clipMs;
+		size_t hits;
+		size_t pairs;
+	};
+
+	static void EntityBounds(const Entity& entity, float(&outMins)[2], float(&outMaxs)[2])
+	{
+		for (unsigned d = 0; d < 2; ++d)
+		{
+			outMins[d] = entity.pos[d] - entity.halfExtent;
+			outMaxs[d] = entity.pos[d] + entity.halfExtent;
+		}
+	}
+
+	// Mirrors AddPeriodics and the snowball gun in the game: flakes spread over the whole world drifting down, snowballs
+	// flying out from around the player, fireballs rolling in on the bottom three rows from past the walls.
+	static Scene BuildScene(unsigned scale, std::mt19937* rng)
+	{
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		Scene scene;
+
+		for (unsigned flakeIndex = 0; flakeIndex < SNOWFLAKES_PER_SCALE * scale; ++flakeIndex)
+		{
+			Entity flake;
+
+			flake.pos[0] = (unit(*rng) - 0.5f) * BOUNDS_HALF_WIDTH * 2.0f;
+			flake.pos[1] = (unit(*rng) - 0.5f) * BOUNDS_HALF_HEIGHT * 2.0f;
+			flake.vel[0] = (unit(*rng) - 0.5f) * 0.5f;
+			flake.vel[1] = -1.0f - unit(*rng);
+			flake.halfExtent = static_cast<float>(SNOWFLAKE_RADIUS);
+			scene.entities.push_back(flake);
+		}
+
+		for (unsigned ballIndex = 0; ballIndex < SNOWBALLS_PER_SCALE * scale; ++ballIndex)
+		{
+			Entity ball;
+			const float angle = unit(*rng) * 3.14159265f;
+
+			ball.pos[0] = (unit(*rng) - 0.5f) * 4.0f;
+			ball.pos[1] = -BOUNDS_HALF_HEIGHT + 1.0f + unit(*rng) * 6.0f;
+			ball.vel[0] = std::cos(angle) * 20.0f;
+			ball.vel[1] = std::sin(angle) * 20.0f;
+			ball.halfExtent = static_cast<float>(SNOWBALL_RADIUS * 1.3f);
+			scene.entities.push_back(ball);
+		}
+
+		for (unsigned fireIndex = 0; fireIndex < FIREBALLS_PER_SCALE * scale; ++fireIndex)
+		{
+			Entity fire;
+			const float side = ((*rng)() & 1) ? 1.0f : -1.0f;
+			const unsigned row = (*rng)() % 3;
+
+			fire.pos[0] = side * (BOUNDS_HALF_WIDTH + 4.0f + FIREBALL_RADIUS) * unit(*rng);
+			fire.pos[1] = row * 1.5f - (BOUNDS_HALF_HEIGHT - (1.5f + FIREBALL_RADIUS));
+			fire.vel[0] = -side * 5.0f;
+			fire.vel[1] = 0.0f;
+			fire.halfExtent = static_cast<float>(FIREBALL_RADIUS * 2.0f);
+			scene.entities.push_back(fire);
+		}
+
+		for (unsigned id = 0; id < scene.entities.size(); ++id)
+			scene.ids.push_back(id);
+
+		return scene;
+	}
+
+	// Steps everything one frame, wrapping back into the world so the distribution stays put
+	static void StepScene(Scene* scene)
+	{
+		const float halfDims[2] = { BOUNDS_HALF_WIDTH + 5.0f, BOUNDS_HALF_HEIGHT + 1.0f };
+
+		for (Entity& entity : scene->entities)
+		{
+			for (unsigned d = 0; d < 2; ++d)
+			{
+				entity.pos[d] += entity.vel[d] * FRAME_TIME;
+
+				if (entity.pos[d] < -halfDims[d])
+					entity.pos[d] += halfDims[d] * 2.0f;
+				else if (entity.pos[d] > halfDims[d])
+					entity.pos[d] -= halfDims[d] * 2.0f;
+			}
+		}
+	}
+
+	// The tree has no per-entry update, so moving things means a rebuild, as Graphics does every frame
+	struct TreeContainer
+	{
+		typedef spatial_tree<unsigned, 2, 16> container_type;
+
+		container_type tree;
+
+		static const char* Name() { return "spatial_tree<2,16>"; }
+
+		void Build(const Scene& scene)
+		{
+			tree.clear();
+			tree.insert(scene.ids.begin(), scene.ids.end(), [&scene](unsigned id, float(&outMins)[2], float(&outMaxs)[2])
+			{
+				EntityBounds(scene.entities[id], outMins, outMaxs);
+			});
+		}
+
+		void Update(const Scene& scene)
+		{
+			Build(scene);
+		}
+
+		container_type& Get() { return tree; }
+	};
+
+	struct GridContainer
+	{
+		typedef spatial_grid<unsigned, 2> container_type;
+
+		container_type grid;
+		std::vector<container_type::handle> handles;
+
+		GridContainer()
+			: grid({ -BOUNDS_HALF_WIDTH, -BOUNDS_HALF_HEIGHT }, { BOUNDS_HALF_WIDTH, BOUNDS_HALF_HEIGHT }, 1.0f)
+		{
+		}
+
+		static const char* Name() { return "spatial_grid<2>"; }
+
+		void Build(const Scene& scene)
+		{
+			grid.clear();
+			handles.clear();
+
+			for (unsigned id : scene.ids)
+			{
+				float mins[2];
+				float maxs[2];
+
+				EntityBounds(scene.entities[id], mins, maxs);
+				handles.push_back(grid.insert(id, mins, maxs));
+			}
+		}
+
+		void Update(const Scene& scene)
+		{
+			for (unsigned id : scene.ids)
+			{
+				float mins[2];
+				float maxs[2];
+
+				EntityBounds(scene.entities[id], mins, maxs);
+				grid.update(handles[id], mins, maxs);
+			}
+		}
+
+		container_type& Get() { return grid; }
+	};
+
+	template <typename Func>
+	static double TimeMs(Func&& BenchFunc)
+	{
+		const auto start = std::chrono::high_resolution_clock::now();
+
+		BenchFunc();
+
+		return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	// Every container sees the same scene, frames and queries, so hit and pair counts must match across a row
+	template <typename Container>
+	static Timings RunBench(Scene scene, unsigned frameCount, unsigned seed)
+	{
+		std::mt19937 rng(seed);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		Container container;
+		Timings timings = {};
+
+		timings.buildMs = TimeMs([&]() { container.Build(scene); });
+
+		for (unsigned frame = 0; frame < frameCount; ++frame)
+		{
+			StepScene(&scene);
+			timings.updateMs += TimeMs([&]() { container.Update(scene); });
+
+			timings.queryMs += TimeMs([&]()
+			{
+				for (unsigned queryIndex = 0; queryIndex < QUERIES_PER_FRAME; ++queryIndex)
+				{
+					const Entity& center = scene.entities[queryIndex % scene.entities.size()];
+					const float queryMins[2] = { center.pos[0] - 1.0f, center.pos[1] - 1.0f };
+					const float queryMaxs[2] = { center.pos[0] + 1.0f, center.pos[1] + 1.0f };
+
+					container.Get().query(queryMins, queryMaxs, [&timings](unsigned) { ++timings.hits; });
+				}
+			});
+
+			timings.rayMs += TimeMs([&]()
+			{
+				for (unsigned queryIndex = 0; queryIndex < QUERIES_PER_FRAME; ++queryIndex)
+				{
+					const float angle = unit(rng) * 3.14159265f;
+					const float start[2] = { (unit(rng) - 0.5f) * 4.0f, -BOUNDS_HALF_HEIGHT + 1.0f };
+					const float dir[2] = { std::cos(angle), std::sin(angle) };
+
+					container.Get().ray_query(start, dir, [&timings](unsigned) { ++timings.hits; });
+				}
+			});
+
+			timings.clipMs += TimeMs([&]()
+			{
+				container.Get().self_clip([&timings](unsigned, unsigned) { ++timings.pairs; });
+			});
+		}
+
+		timings.updateMs /= frameCount;
+		timings.queryMs /= frameCount;
+		timings.rayMs /= frameCount;
+		timings.clipMs /= frameCount;
+
+		return timings;
+	}
+
+	template <typename Container>
+	static void PrintRow(unsigned entityCount, const Timings& timings)
+	{
+		std::cout << std::left << std::setw(20) << Container::Name() << std::right
+			<< std::setw(8) << entityCount
+			<< std::fixed << std::setprecision(4)
+			<< std::setw(11) << timings.buildMs
+			<< std::setw(11) << timings.updateMs
+			<< std::setw(11) << timings.queryMs
+			<< std::setw(11) << timings.rayMs
+			<< std::setw(11) << timings.clipMs
+			<< std::setw(12) << timings.hits
+			<< std::setw(12) << timings.pairs << std::endl;
+	}
+
+	template <typename... Containers>
+	static void BenchScale(unsigned scale, unsigned frameCount)
+	{
+		std::mt19937 rng(scale);
+		const Scene scene = BuildScene(scale, &rng);
+		const unsigned entityCount = static_cast<unsigned>(scene.entities.size());
+
+		(PrintRow<Containers>(entityCount, RunBench<Containers>(scene, frameCount, scale * 7919)), ...);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	const unsigned frameCount = argc > 1 ? std::max(std::atoi(argv[1]), 1) : 120;
+
+	std::cout << "SpatialBench: " << frameCount << " frames per scale, times are ms per frame (build is one-off)" << std::endl;
+	std::cout << std::left << std::setw(20) << "container" << std::right
+		<< std::setw(8) << "count"
+		<< std::setw(11) << "build"
+		<< std::setw(11) << "update"
+		<< std::setw(11) << "query"
+		<< std::setw(11) << "ray"
+		<< std::setw(11) << "self_clip"
+		<< std::setw(12) << "hits"
+		<< std::setw(12) << "pairs" << std::endl;
+
+	for (unsigned scale = 1; scale <= 16; scale <<= 1)
+		BenchScale<TreeContainer, GridContainer>(scale, frameCount);
+
+	std::cout << std::endl;
+	RunBroadPhaseBench(frameCount);
+
+	std::cout << std::endl;
+	RunSceneEntryBench(frameCount);
+
+	return 0;
+}
@@ -0,0 +1,15 @@
+#ifndef B2_BROAD_PHASE_H
+#define B2_BROAD_PHASE_H
+
+#include "Box2D/Collision/b2Collision.h"
+#include "Box2D/Collision/b2DynamicTree.h"
+#include "SpatialBroadPhase.h"
+
+// Found ahead of Box2D's own b2BroadPhase.h when building with SpatialBroadPhase=true (see root.props), so
+// b2ContactManager, b2World, b2Body and b2Fixture all run on the spatial_tree backed broad-phase. A class rather than
+// a typedef, as b2Fixture.h forward declares it, and Box2D's b2BroadPhase.cpp is left out of that build.
+class b2BroadPhase : public SpatialBroadPhase
+{
+};
+
+#endif
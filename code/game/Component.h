@@ -6,17 +6,24 @@
 
 typedef unsigned uint;
 
-template<typename T>
+// With TrackDirty, dirtyIds collects every component id that was added, handed out by the non const for_object, or
+// moved by remove_objs, so the owner can mirror just those elsewhere. Ids may repeat, or be past the end after removals,
+// and stay until the owner clears them. Writes through data() or operator[] aren't tracked
+template<typename T, bool TrackDirty = false>
 struct component_list
 {
 	std::unordered_map<uint, uint> objToId;
 	std::vector<uint> idToObj;
 	std::vector<T> components;
+	std::vector<uint> dirtyIds;
 
 	T& add_to_object(uint objectId)
 	{
-		objToId[objectId] = static_cast<uint>(components.size());
+		const uint id = static_cast<uint>(components.size());
+
+		objToId[objectId] = id;
 		idToObj.emplace_back(objectId);
+		mark_dirty(id);
 		return components.emplace_back();
 	}
 
@@ -27,6 +34,7 @@ struct component_list
 		if (idIt != objToId.end())
 		{
 			assert(idIt->second < components.size());
+			mark_dirty(idIt->second);
 			return components.data() + idIt->second;
 		}
 
@@ -35,7 +43,23 @@ struct component_list
 
 	const T* for_object(uint objectId) const
 	{
-		return const_cast<component_list*>(this)->for_object(objectId);
+		auto idIt = objToId.find(objectId);
+
+		if (idIt != objToId.end())
+		{
+			assert(idIt->second < components.size());
+			return components.data() + idIt->second;
+		}
+
+		return nullptr;
+	}
+
+	void mark_dirty(uint id)
+	{
+		if constexpr (TrackDirty)
+		{
+			dirtyIds.emplace_back(id);
+		}
 	}
 
 	T* data()
@@ -84,6 +108,7 @@ struct component_list
 					objToIdIt->second = cId;
 					idToObj[cId] = lastObjId;
 					std::swap(components[cId], components[lastId]);
+					mark_dirty(cId);
 				}
 
 				Delete(components.back());
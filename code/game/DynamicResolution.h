@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cmath>
+#include <algorithm>
+
+namespace dynres
+{
+	static const float MIN_SCALE = 0.5f;
+	static const float MAX_SCALE = 1.0f;
+	static const float SCALE_STEP = 1.0f / 32.0f;
+
+	struct Controller
+	{
+		float targetMs;
+		float scale = MAX_SCALE;
+		float fullResMs = 0.0f;
+		float fixedMs = 0.0f;
+	};
+
+	// scaledMs is what the passes drawn at frameScale took, fixedMs what the ones always drawn at full resolution took.
+	// Timings come back a frame or two late, so the scaled passes are scaled to what they would have cost at full
+	// resolution, their cost going with the pixel count, before smoothing. They get whatever of the budget the fixed
+	// passes leave. The scale moves in SCALE_STEPs and only once it is off by more than one, so it settles rather than
+	// wobbles
+	inline float Update(Controller* c, float scaledMs, float fixedMs, float frameScale)
+	{
+		// Software rasterizers can report nothing at all
+		if (scaledMs <= 0.0f)
+		{
+			return c->scale;
+		}
+
+		const float frameFullResMs = scaledMs / (frameScale * frameScale);
+
+		c->fullResMs = c->fullResMs > 0.0f ? c->fullResMs + (frameFullResMs - c->fullResMs) * 0.1f : frameFullResMs;
+		c->fixedMs = c->fixedMs > 0.0f ? c->fixedMs + (fixedMs - c->fixedMs) * 0.1f : fixedMs;
+
+		const float scaledBudgetMs = std::max(c->targetMs - c->fixedMs, 0.0f);
+		const float idealScale = std::clamp(std::sqrt(scaledBudgetMs / c->fullResMs), MIN_SCALE, MAX_SCALE);
+
+		if (std::abs(idealScale - c->scale) > SCALE_STEP)
+		{
+			c->scale = std::clamp(std::floor(idealScale / SCALE_STEP) * SCALE_STEP, MIN_SCALE, MAX_SCALE);
+		}
+
+		return c->scale;
+	}
+}
@@ -1,12 +1,19 @@
 #include <vector>
+#include <bitset>
 #include <fstream>
 #include <filesystem>
 #include <chrono>
 #include <unordered_map>
 #include <numeric>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include "ComponentTypes.h"
 #include "Component.h"
 #include "Game.h"
+#include "SceneEntry.h"
+#include "DynamicResolution.h"
 #include "bvh/spatial_tree.h"
 #include "shaders/scene_defines.glsl"
 #include "glm/glm.hpp"
@@ -15,6 +22,8 @@
 #include "glm/gtc/type_ptr.hpp"
 #include "allegro5/allegro.h"
 #include "allegro5/allegro_opengl.h"
+#include "imgui.h"
+#include "imgui_impl_opengl3.h"
 
 #include "generated_shaders/blur.frag.h"
 #include "generated_shaders/downsample.frag.h"
@@ -28,6 +37,16 @@
 
 typedef unsigned uint;
 
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+#ifndef GL_TIME_ELAPSED
+#define GL_TIME_ELAPSED 0x88BF
+#endif
+
 namespace
 {
 	namespace tree
@@ -41,14 +60,47 @@ struct Graphics
 {
 	static const uint MAX_ENTRIES = MAX_SCENE_ENTRIES;
 	static const uint BLUR_PASSES = BLOOM_BLUR_PASSES;
+	static const uint SCENE_SLOTS = 3;
+	static const uint RENDER_PASSES = static_cast<uint>(gfx::RenderPass::COUNT);
+	static const uint TIMING_FRAMES = 300;
+
+	// FREE slots are filled by the simulation thread, READY ones drawn in ring order by the render thread, and
+	// IN_FLIGHT ones go back to FREE once the GPU is done with them
+	enum class SlotState
+	{
+		FREE,
+		READY,
+		IN_FLIGHT
+	};
 
-	component_list<glm::mat4> sceneEntries;
-	std::vector<tree::Node> sceneBVH;
+	// Everything the render thread needs for one frame, so it never reads state the simulation thread is changing
+	struct SceneSlot
+	{
+		SlotState state = SlotState::FREE;
+		GLsync fence = 0;
+		uint frameCount = 0;
+		uint entryCount = 0;
+		uint sceneVersion = 0;
+		std::bitset<MAX_ENTRIES> dirtyEntries;
+		ImDrawData guiDrawData;
+		std::vector<ImDrawList*> guiDrawLists;
+
+		// Render thread only, a GL_TIME_ELAPSED query per RenderPass
+		uint passQueries[RENDER_PASSES] = {};
+		float renderScale = 1.0f;
+	};
+
+	component_list<entry::SceneEntry, true> sceneEntries;
+	spatial_tree<uint, 3, 2>::build_seeds sceneBVHSeeds;
 	glm::vec3 camPos{ 0.0f, 0.0f, 0.0f };
 	glm::vec3 camTarget{ 0.0f, 0.0f, 0.0f };
 	glm::float1 camInvFov;
 	glm::mat3 camViewMtx;
 	glm::vec2 res{ 1024.0f, 768.0f };
+	glm::vec2 windowRes{ 1024.0f, 768.0f };
+	glm::vec2 renderRes{ 1024.0f, 768.0f };
+	// Aims under a 60 Hz frame, leaving room for the ImGui draws and the driver
+	dynres::Controller resController = { 14.0f };
 	glm::uint frameCount = 0;
 	uint noiseTex = 0;
 
@@ -56,6 +108,16 @@ struct Graphics
 	uint sceneVAO = 0;
 	uint sceneEntrySSB = 0;
 	uint sceneBVHSSB = 0;
+	char* sceneEntryMap = nullptr;
+	char* sceneBVHMap = nullptr;
+	size_t sceneEntrySlotSize = 0;
+	size_t sceneBVHSlotSize = 0;
+	SceneSlot sceneSlots[SCENE_SLOTS];
+	std::vector<tree::Node> sceneSlotNodes;
+	uint writeSlot = SCENE_SLOTS - 1;
+	uint drawSlot = SCENE_SLOTS - 1;
+	uint sceneVersion = 0;
+	bool sceneDirty = false;
 	uint sceneShader = 0;
 	uint sceneMainTex = 0;
 	uint sceneBrightTex[BLUR_PASSES] = {};
@@ -71,6 +133,20 @@ struct Graphics
 	uint outputShader = 0;
 	std::vector<uint> meshTypeRemap;
 	std::unordered_map<uint, uint> objToMesh;
+
+	ALLEGRO_DISPLAY* display = nullptr;
+	std::thread renderThread;
+	std::mutex sceneSlotMutex;
+	std::condition_variable sceneSlotCond;
+	glm::vec2 pendingRes{ 0.0f, 0.0f };
+	bool resizePending = false;
+	bool renderQuit = false;
+
+	// A ring of the last TIMING_FRAMES retired frames' pass times
+	std::mutex passTimingMutex;
+	float passTimingMs[TIMING_FRAMES][RENDER_PASSES] = {};
+	uint passTimingCount = 0;
+	float passTimingScale = 1.0f;
 };
 
 namespace
@@ -259,17 +335,19 @@ namespace
 				return childCount;
 			}
 
-			static uint FinalizeGPUTree_r(CompNode* node, std::vector<Node>* outNodes)
+			// outNodes may be write combined GPU memory, so each node is assembled locally and only stored when it differs
+			// from the copy of outNodes kept in prevNodes
+			static uint FinalizeGPUTree_r(CompNode* node, Node* outNodes, Node* prevNodes, uint* inoutNodeCount)
 			{
-				const uint nodeIndex = static_cast<uint>(outNodes->size());
-				Node* outNode = &outNodes->emplace_back();
+				const uint nodeIndex = (*inoutNodeCount)++;
+				Node outNode = {};
 
-				outNode->childMinX = node->childMinX;
-				outNode->childMinY = node->childMinY;
-				outNode->childMinZ = node->childMinZ;
-				outNode->childMaxX = node->childMaxX;
-				outNode->childMaxY = node->childMaxY;
-				outNode->childMaxZ = node->childMaxZ;
+				outNode.childMinX = node->childMinX;
+				outNode.childMinY = node->childMinY;
+				outNode.childMinZ = node->childMinZ;
+				outNode.childMaxX = node->childMaxX;
+				outNode.childMaxY = node->childMaxY;
+				outNode.childMaxZ = node->childMaxZ;
 
 				for (uint c = 0; c < 4; ++c)
 				{
@@ -282,39 +360,41 @@ namespace
 
 						if (isLeaf)
 						{
-							outNode->childOffsets[c] = static_cast<uint>((childNodeBits >> 1) | LEAF_NODE_MASK);
+							outNode.childOffsets[c] = static_cast<uint>((childNodeBits >> 1) | LEAF_NODE_MASK);
 						}
 						else
 						{
-							const uint childNodeOffset = FinalizeGPUTree_r(childNode, outNodes);
-
-							outNode = outNodes->data() + nodeIndex;
-							outNode->childOffsets[c] = childNodeOffset;
+							outNode.childOffsets[c] = FinalizeGPUTree_r(childNode, outNodes, prevNodes, inoutNodeCount);
 						}
 					}
 				}
 
+				if (std::memcmp(&outNode, prevNodes + nodeIndex, sizeof(Node)) != 0)
+				{
+					outNodes[nodeIndex] = outNode;
+					prevNodes[nodeIndex] = outNode;
+				}
+
 				return nodeIndex;
 			}
 		} 
 
-		static std::vector<Node> BuildSceneBVH(const Graphics& g)
+		// seeds carries each node's partition from the last frame's build, as the scene barely moves between frames
+		// Balanced partitions keep the snow bunched around the helper from growing one deep branch, which scene.frag's
+		// short traversal stack would cut off
+		// outNodes and prevNodes need room for MAX_ENTRIES * 2 nodes, returns the node count
+		static uint BuildSceneBVH(const Graphics& g, spatial_tree<uint, 3, 2>::build_seeds* seeds, Node* outNodes, Node* prevNodes)
 		{ 
 			using namespace int_tree;
 			const uint entryCount = static_cast<uint>(g.sceneEntries.size());
-			const glm::mat4* const entries = g.sceneEntries.data();
+			const entry::SceneEntry* const entries = g.sceneEntries.data();
 			uint* const indices = (uint*)_malloca(sizeof(uint) * entryCount);
-			spatial_tree<uint, 3, 2> buildTree;
 
 			std::iota(indices, indices + entryCount, 0);
-			buildTree.insert(indices, indices + entryCount, [entries](uint entryIndex, float(&outMins)[3], float(&outMaxs)[3])
+			spatial_tree<uint, 3, 2> buildTree(indices, indices + entryCount, [entries](uint entryIndex, float(&outMins)[3], float(&outMaxs)[3])
 			{
-				glm::mat4 entry = entries[entryIndex];
-				const uint entryType = static_cast<uint>(entry[3][3]);
-				entry[3][3] = 1.0f;
-				entry = glm::inverse(entry);
-
-				const glm::vec3 entryPos = entry[3]; // inverse transform stored
+				const uint entryType = entry::Type(entries[entryIndex]);
+				const glm::vec3 entryPos = entries[entryIndex].position;
 				glm::vec3& mins = reinterpret_cast<glm::vec3&>(outMins);
 				glm::vec3& maxs = reinterpret_cast<glm::vec3&>(outMaxs);
 
@@ -370,7 +450,7 @@ namespace
 					maxs += glm::vec3(2.0f, 5.0f, 2.0f);
 					break;
 				}
-			});
+			}, seeds, PartitionMethod::Balanced);
 			 
 			std::vector<CompNode> intGPUNodes;
 			intGPUNodes.reserve(entryCount * 2);
@@ -378,13 +458,12 @@ namespace
 			assert(intGPUNodes.size() < entryCount * 2);
 			CompressGPUTree_r(headIntNode);
 
-			std::vector<Node> gpuNodes;
-			gpuNodes.reserve(intGPUNodes.size());
-			FinalizeGPUTree_r(headIntNode, &gpuNodes);
+			uint nodeCount = 0;
+			FinalizeGPUTree_r(headIntNode, outNodes, prevNodes, &nodeCount);
 
 			_freea(indices);
 
-			return gpuNodes;
+			return nodeCount;
 		}
 	}
 
@@ -522,6 +601,182 @@ namespace
 
 	namespace scene
 	{
+		// Snowflakes sit slightly in front of the rest of the scene. The batched UpdateModels keeps z, so this is the
+		// only place it's set
+		static void SetEntryTransform(entry::SceneEntry* outEntry, glm::mat4 transform)
+		{
+			switch (entry::Type(*outEntry))
+			{
+			case MESH_TYPE_SNOW_FLAKE:
+				transform[3][2] += 0.3f;
+				break;
+			}
+
+			entry::SetTransform(outEntry, transform);
+		}
+
+		// The ImGui draw data is rebuilt by the next ImGui::NewFrame, so the slot keeps its own copy of the draw lists
+		static void CopyGUI(Graphics::SceneSlot* slot, const ImDrawData* guiDrawData)
+		{
+			for (ImDrawList* drawList : slot->guiDrawLists)
+			{
+				IM_DELETE(drawList);
+			}
+
+			slot->guiDrawLists.clear();
+			slot->guiDrawData.Clear();
+
+			if (guiDrawData && guiDrawData->Valid)
+			{
+				for (int listIndex = 0; listIndex < guiDrawData->CmdListsCount; ++listIndex)
+				{
+					slot->guiDrawLists.push_back(guiDrawData->CmdLists[listIndex]->CloneOutput());
+				}
+
+				slot->guiDrawData = *guiDrawData;
+				slot->guiDrawData.CmdLists = slot->guiDrawLists.data();
+			}
+		}
+
+		// The scene buffers are rings of SCENE_SLOTS slots, persistently mapped, so a frame's entries and BVH are written
+		// straight into GPU visible memory while the render thread and GPU are still on the slots of the frames before it.
+		// Runs on the simulation thread, waiting for the next slot in the ring to be FREE paces it to the render thread
+		static void PublishScene(Graphics* g, const ImDrawData* guiDrawData)
+		{
+			const uint slotIndex = (g->writeSlot + 1) % Graphics::SCENE_SLOTS;
+			Graphics::SceneSlot& slot = g->sceneSlots[slotIndex];
+
+			// Every slot missed the entries changed since the last publish, each slot catches up on its own turn
+			for (uint entryIndex : g->sceneEntries.dirtyIds)
+			{
+				for (Graphics::SceneSlot& dirtySlot : g->sceneSlots)
+				{
+					dirtySlot.dirtyEntries.set(entryIndex);
+				}
+			}
+
+			g->sceneEntries.dirtyIds.clear();
+
+			if (g->sceneDirty)
+			{
+				++g->sceneVersion;
+				g->sceneDirty = false;
+			}
+
+			{
+				std::unique_lock<std::mutex> lock(g->sceneSlotMutex);
+				g->sceneSlotCond.wait(lock, [&slot]() { return slot.state == Graphics::SlotState::FREE; });
+			}
+
+			const uint entryCount = static_cast<uint>(g->sceneEntries.size());
+			const entry::SceneEntry* const entries = g->sceneEntries.data();
+			entry::SceneEntry* const slotEntries = reinterpret_cast<entry::SceneEntry*>(g->sceneEntryMap + g->sceneEntrySlotSize * slotIndex);
+			tree::Node* const slotNodes = reinterpret_cast<tree::Node*>(g->sceneBVHMap + g->sceneBVHSlotSize * slotIndex);
+			tree::Node* const prevSlotNodes = g->sceneSlotNodes.data() + Graphics::MAX_ENTRIES * 2 * slotIndex;
+
+			// Copy the dirty entries as contiguous runs, ids past the end were moved away by removals
+			for (uint entryIndex = 0; entryIndex < entryCount;)
+			{
+				if (slot.dirtyEntries[entryIndex])
+				{
+					uint runEnd = entryIndex + 1;
+
+					while (runEnd < entryCount && slot.dirtyEntries[runEnd])
+					{
+						++runEnd;
+					}
+
+					std::memcpy(slotEntries + entryIndex, entries + entryIndex, (runEnd - entryIndex) * sizeof(entry::SceneEntry));
+					entryIndex = runEnd;
+				}
+				else
+				{
+					++entryIndex;
+				}
+			}
+
+			slot.dirtyEntries.reset();
+
+			// A slot last written before anything moved already holds this BVH
+			if (slot.sceneVersion != g->sceneVersion)
+			{
+				const uint nodeCount = tree::BuildSceneBVH(*g, &g->sceneBVHSeeds, slotNodes, prevSlotNodes);
+				assert(nodeCount <= Graphics::MAX_ENTRIES * 2);
+				slot.sceneVersion = g->sceneVersion;
+			}
+
+			slot.entryCount = entryCount;
+			slot.frameCount = g->frameCount;
+			CopyGUI(&slot, guiDrawData);
+			g->writeSlot = slotIndex;
+
+			{
+				std::lock_guard<std::mutex> lock(g->sceneSlotMutex);
+				slot.state = Graphics::SlotState::READY;
+			}
+
+			g->sceneSlotCond.notify_all();
+		}
+
+		// Called by the render thread once a frame's draws are submitted
+		static void FenceSlot(Graphics* g)
+		{
+			g->sceneSlots[g->drawSlot].fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		}
+
+		// Hands slotIndex back to the simulation thread once the GPU is done with it
+		static void RetireSlot(Graphics* g, uint slotIndex)
+		{
+			Graphics::SceneSlot& slot = g->sceneSlots[slotIndex];
+
+			// Only the render thread touches the fences, the state may be changing under the simulation thread
+			if (!slot.fence)
+			{
+				return;
+			}
+
+			GLenum waitResult = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+
+			while (waitResult == GL_TIMEOUT_EXPIRED)
+			{
+				waitResult = glClientWaitSync(slot.fence, 0, 1000000000);
+			}
+
+			glDeleteSync(slot.fence);
+			slot.fence = 0;
+
+			// The fence covers the timer queries, so their results are already in
+			float passMs[Graphics::RENDER_PASSES];
+
+			for (uint pass = 0; pass < Graphics::RENDER_PASSES; ++pass)
+			{
+				GLuint64 gpuNs = 0;
+				glGetQueryObjectui64v(slot.passQueries[pass], GL_QUERY_RESULT, &gpuNs);
+
+				passMs[pass] = static_cast<float>(gpuNs) * 1e-6f;
+			}
+
+			// Output upscales to the window, so only the passes before it run at the render scale
+			const float scaledMs = passMs[static_cast<uint>(gfx::RenderPass::SCENE)] + passMs[static_cast<uint>(gfx::RenderPass::DOWNSAMPLE)] + passMs[static_cast<uint>(gfx::RenderPass::BLUR)];
+			const float fixedMs = passMs[static_cast<uint>(gfx::RenderPass::OUTPUT)];
+
+			dynres::Update(&g->resController, scaledMs, fixedMs, slot.renderScale);
+
+			{
+				std::lock_guard<std::mutex> lock(g->passTimingMutex);
+				std::memcpy(g->passTimingMs[g->passTimingCount % Graphics::TIMING_FRAMES], passMs, sizeof(passMs));
+				++g->passTimingCount;
+				g->passTimingScale = slot.renderScale;
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(g->sceneSlotMutex);
+				slot.state = Graphics::SlotState::FREE;
+			}
+
+			g->sceneSlotCond.notify_all();
+		}
+
 		static bool UpdateUniforms(const Graphics &g)
 		{
 			static const uint camPosBinding = 0;
@@ -533,27 +788,16 @@ namespace
 			static const uint sceneEntryCountBinding = 8;
 			static const uint sceneEntryBufferBinding = 0;
 			static const uint sceneBVHBufferBinding = 1;
-			const uint sceneEntryCount = static_cast<uint>(g.sceneEntries.size());
-
 			glUniform3fv(camPosBinding, 1, glm::value_ptr(g.camPos));
 			glUniform3fv(camTargetBinding, 1, glm::value_ptr(g.camTarget));
 			glUniform1f(camInvFovBinding, g.camInvFov);
 			glUniformMatrix3fv(camViewBinding, 1, true, glm::value_ptr(g.camViewMtx));
-			glUniform2fv(resolutionBinding, 1, glm::value_ptr(g.res));
-			glUniform1ui(frameCountBinding, g.frameCount);
-			glUniform1ui(sceneEntryCountBinding, sceneEntryCount);
-			
-			glBindBufferBase( GL_SHADER_STORAGE_BUFFER, sceneEntryBufferBinding, g.sceneEntrySSB );
-
-			glBindBuffer(GL_SHADER_STORAGE_BUFFER, g.sceneEntrySSB);
-			glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sceneEntryCount * sizeof(glm::mat4), g.sceneEntries.data());
-			glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+			glUniform2fv(resolutionBinding, 1, glm::value_ptr(g.renderRes));
+			glUniform1ui(frameCountBinding, g.sceneSlots[g.drawSlot].frameCount);
+			glUniform1ui(sceneEntryCountBinding, g.sceneSlots[g.drawSlot].entryCount);
 
-			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, sceneBVHBufferBinding, g.sceneBVHSSB);
-
-			glBindBuffer(GL_SHADER_STORAGE_BUFFER, g.sceneBVHSSB);
-			glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, g.sceneBVH.size() * sizeof(tree::Node), g.sceneBVH.data());
-			glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+			glBindBufferRange(GL_SHADER_STORAGE_BUFFER, sceneEntryBufferBinding, g.sceneEntrySSB, g.sceneEntrySlotSize * g.drawSlot, g.sceneEntrySlotSize);
+			glBindBufferRange(GL_SHADER_STORAGE_BUFFER, sceneBVHBufferBinding, g.sceneBVHSSB, g.sceneBVHSlotSize * g.drawSlot, g.sceneBVHSlotSize);
 
 			return err::Error();
 		}
@@ -661,22 +905,38 @@ namespace
 				return true;
 			}
 
-			static bool GenSSB(uint* outSSB, size_t size)
+			// Allocates Graphics::SCENE_SLOTS zeroed slots of at least slotSize bytes and maps them for the buffer's lifetime
+			static bool GenRingSSB(size_t slotSize, uint* outSSB, char** outMap, size_t* outSlotSize)
 			{
+				typedef void (*PFNGLBUFFERSTORAGEPROC) (GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+				static PFNGLBUFFERSTORAGEPROC glBufferStorage = (PFNGLBUFFERSTORAGEPROC)al_get_opengl_proc_address("glBufferStorage");
+				const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+				GLint alignment = 1;
 				uint ssb;
 
+				glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+				slotSize = (slotSize + alignment - 1) / alignment * alignment;
+
 				glGenBuffers(1, &ssb);
 				glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssb);
-				glBufferData(GL_SHADER_STORAGE_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+				glBufferStorage(GL_SHADER_STORAGE_BUFFER, slotSize * Graphics::SCENE_SLOTS, nullptr, flags);
+				void* const map = glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, slotSize * Graphics::SCENE_SLOTS, flags);
 				glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 
-				if (err::Error())
+				if (err::Error() || !map)
 				{
+					glDeleteBuffers(1, &ssb);
 					*outSSB = 0;
+					*outMap = nullptr;
+					*outSlotSize = 0;
 					return false;
 				}
 
+				std::memset(map, 0, slotSize * Graphics::SCENE_SLOTS);
+
 				*outSSB = ssb;
+				*outMap = static_cast<char*>(map);
+				*outSlotSize = slotSize;
 				return true;
 			}
 
@@ -754,10 +1014,19 @@ namespace
 					uint sceneVAO;
 					uint sceneEntrySSB;
 					uint sceneBVHSSB;
+					char* sceneEntryMap;
+					char* sceneBVHMap;
+					size_t sceneEntrySlotSize;
+					size_t sceneBVHSlotSize;
 
 					GenVAO(&sceneVAO);
-					GenSSB(&sceneEntrySSB, sizeof(glm::mat4) * Graphics::MAX_ENTRIES);
-					GenSSB(&sceneBVHSSB, sizeof(tree::Node) * Graphics::MAX_ENTRIES * 2);
+					// PublishScene writes into the mapped slots unchecked
+					if (!GenRingSSB(sizeof(entry::SceneEntry) * Graphics::MAX_ENTRIES, &sceneEntrySSB, &sceneEntryMap, &sceneEntrySlotSize) ||
+						!GenRingSSB(sizeof(tree::Node) * Graphics::MAX_ENTRIES * 2, &sceneBVHSSB, &sceneBVHMap, &sceneBVHSlotSize))
+					{
+						printf("Failed to map the scene buffers.\n");
+						return false;
+					}
 					
 					GenerateFrameBuffers(g);
 					GenNoiseTexture(256, 256, &noiseTex);
@@ -767,6 +1036,16 @@ namespace
 					g->sceneShader = sceneShader;
 					g->sceneEntrySSB = sceneEntrySSB;
 					g->sceneBVHSSB = sceneBVHSSB;
+					g->sceneEntryMap = sceneEntryMap;
+					g->sceneBVHMap = sceneBVHMap;
+					g->sceneEntrySlotSize = sceneEntrySlotSize;
+					g->sceneBVHSlotSize = sceneBVHSlotSize;
+					g->sceneSlotNodes.resize(Graphics::MAX_ENTRIES * 2 * Graphics::SCENE_SLOTS);
+
+					for (Graphics::SceneSlot& slot : g->sceneSlots)
+					{
+						glGenQueries(Graphics::RENDER_PASSES, slot.passQueries);
+					}
 					g->sceneVAO = sceneVAO;
 					g->outputShader = outShader;
 
@@ -801,6 +1080,7 @@ namespace
 		{
 			const GLenum sceneAttachments[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
 
+			glViewport(0, 0, static_cast<uint>(g.renderRes.x), static_cast<uint>(g.renderRes.y));
 			glUseProgram(g.sceneShader);
 
 			glBindFramebuffer(GL_FRAMEBUFFER, g.sceneFBO);
@@ -822,24 +1102,19 @@ namespace
 		static void Render_Downsample(const Graphics& g)
 		{
 			const GLenum downsampleAttachemnts[] = { GL_COLOR_ATTACHMENT0 };
-			uint w = static_cast<uint>(g.res.x);
-			uint h = static_cast<uint>(g.res.y);
+			uint w = static_cast<uint>(g.renderRes.x);
+			uint h = static_cast<uint>(g.renderRes.y);
 
 			for (uint p = 1; p < BLOOM_BLUR_PASSES; ++p)
 			{
-				static const uint resolutionBinding = 1;
-
 				w >>= 1;
 				h >>= 1;
 
-				glm::vec2 res(static_cast<float>(w), static_cast<float>(h));
-
 				glViewport(0, 0, w, h);
 				glUseProgram(g.downsampleShader);
 				glBindFramebuffer(GL_FRAMEBUFFER, g.downsampleFBO[p]);
 				glBindTexture(GL_TEXTURE_2D, g.sceneBrightTex[p - 1]);
 				glUniform1i(0, 0);
-				glUniform2fv(resolutionBinding, 1, glm::value_ptr(res));
 
 				glDrawBuffers(1, downsampleAttachemnts);
 
@@ -863,20 +1138,25 @@ namespace
 			{
 				uint w = static_cast<uint>(g.res.x);
 				uint h = static_cast<uint>(g.res.y);
+				uint renderW = static_cast<uint>(g.renderRes.x);
+				uint renderH = static_cast<uint>(g.renderRes.y);
 
 				for (uint p = 0; p < Graphics::BLUR_PASSES; ++p)
 				{
-					glViewport(0, 0, w, h);
+					glViewport(0, 0, renderW, renderH);
 					glBindFramebuffer(GL_FRAMEBUFFER, pass ? g.downsampleFBO[p] : g.blurFBO[p]);
 					glBindTexture(GL_TEXTURE_2D, pass ? g.blurTex[p] : g.sceneBrightTex[p]);
 					glUniform1i(0, 0);
 
 					glm::vec2 res(static_cast<float>(w), static_cast<float>(h));
+					glm::vec2 renderRes(static_cast<float>(renderW), static_cast<float>(renderH));
 					static const uint horizBinding = 10;
 					static const uint resolutionBinding = 11;
+					static const uint renderResolutionBinding = 12;
 
 					glUniform1i(horizBinding, pass);
 					glUniform2fv(resolutionBinding, 1, glm::value_ptr(res));
+					glUniform2fv(renderResolutionBinding, 1, glm::value_ptr(renderRes));
 
 					glDrawBuffers(Graphics::BLUR_PASSES, blurAttachemnts);
 
@@ -890,6 +1170,8 @@ namespace
 
 					w >>= 1;
 					h >>= 1;
+					renderW >>= 1;
+					renderH >>= 1;
 				}
 			}
 		}
@@ -914,7 +1196,9 @@ namespace
 			}
 
 			static const uint resolutionBinding = 11;
+			static const uint renderResolutionBinding = 12;
 			glUniform2fv(resolutionBinding, 1, glm::value_ptr(g.res));
+			glUniform2fv(renderResolutionBinding, 1, glm::value_ptr(g.renderRes));
 
 			glBindVertexArray(g.sceneVAO);
 			glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
@@ -933,16 +1217,90 @@ namespace
 
 		static void Render(const Graphics &g)
 		{
+			const uint* const passQueries = g.sceneSlots[g.drawSlot].passQueries;
+
+			glBeginQuery(GL_TIME_ELAPSED, passQueries[static_cast<uint>(gfx::RenderPass::SCENE)]);
 			Render_Scene(g);
+			glEndQuery(GL_TIME_ELAPSED);
+
+			glBeginQuery(GL_TIME_ELAPSED, passQueries[static_cast<uint>(gfx::RenderPass::DOWNSAMPLE)]);
 			Render_Downsample(g);
+			glEndQuery(GL_TIME_ELAPSED);
+
+			glBeginQuery(GL_TIME_ELAPSED, passQueries[static_cast<uint>(gfx::RenderPass::BLUR)]);
 			Render_Blur(g);
+			glEndQuery(GL_TIME_ELAPSED);
+
+			glBeginQuery(GL_TIME_ELAPSED, passQueries[static_cast<uint>(gfx::RenderPass::OUTPUT)]);
 			Render_Output(g);
+			glEndQuery(GL_TIME_ELAPSED);
 
 			glBindVertexArray(0);
 			glUseProgram(0);
 
 			err::Error();
 		}
+
+		// Owns the GL context between gfx::StartRenderThread and gfx::StopRenderThread. Draws each READY slot in ring
+		// order and keeps a single frame in flight, so the simulation thread can be up to two frames ahead
+		static void RenderThread(Graphics* g)
+		{
+			al_set_target_backbuffer(g->display);
+
+			for (;;)
+			{
+				const uint slotIndex = (g->drawSlot + 1) % Graphics::SCENE_SLOTS;
+				Graphics::SceneSlot& slot = g->sceneSlots[slotIndex];
+				glm::vec2 newRes;
+				bool resize;
+
+				{
+					std::unique_lock<std::mutex> lock(g->sceneSlotMutex);
+					g->sceneSlotCond.wait(lock, [g, &slot]() { return g->renderQuit || slot.state == Graphics::SlotState::READY; });
+
+					if (g->renderQuit)
+					{
+						break;
+					}
+
+					newRes = g->pendingRes;
+					resize = g->resizePending;
+					g->resizePending = false;
+				}
+
+				if (resize)
+				{
+					al_acknowledge_resize(g->display);
+					g->res = newRes;
+					init::DestroyFrameBuffers(g);
+					init::GenerateFrameBuffers(g);
+				}
+
+				// Render times its passes, their sum picks the next frames' render resolution
+				g->drawSlot = slotIndex;
+				g->renderRes = glm::max(glm::floor(g->res * g->resController.scale), glm::vec2(1.0f));
+				slot.renderScale = g->resController.scale;
+
+				Render(*g);
+
+				if (slot.guiDrawData.Valid)
+				{
+					ImGui_ImplOpenGL3_RenderDrawData(&slot.guiDrawData);
+				}
+
+				scene::FenceSlot(g);
+				al_flip_display();
+
+				{
+					std::lock_guard<std::mutex> lock(g->sceneSlotMutex);
+					slot.state = Graphics::SlotState::IN_FLIGHT;
+				}
+
+				scene::RetireSlot(g, (slotIndex + Graphics::SCENE_SLOTS - 1) % Graphics::SCENE_SLOTS);
+			}
+
+			al_set_target_bitmap(nullptr);
+		}
 	}
 }
 
@@ -977,6 +1335,21 @@ namespace gfx
 		glDeleteBuffers(1, &g->sceneFBO);
 		glDeleteBuffers(Graphics::BLUR_PASSES, g->blurFBO);
 		glDeleteBuffers(Graphics::BLUR_PASSES, g->downsampleFBO);
+		for (Graphics::SceneSlot& slot : g->sceneSlots)
+		{
+			if (slot.fence)
+			{
+				glDeleteSync(slot.fence);
+			}
+
+			glDeleteQueries(Graphics::RENDER_PASSES, slot.passQueries);
+
+			for (ImDrawList* drawList : slot.guiDrawLists)
+			{
+				IM_DELETE(drawList);
+			}
+		}
+
 		glDeleteBuffers(1, &g->sceneEntrySSB);
 		glDeleteBuffers(1, &g->sceneBVHSSB);
 		glDeleteTextures(1, &g->noiseTex);
@@ -988,24 +1361,59 @@ namespace gfx
 		delete g;
 	}
 
-	void Update(Graphics* g)
+	bool StartRenderThread(Graphics* g, ALLEGRO_DISPLAY* display)
 	{
+		assert(!g->renderThread.joinable());
+
+		g->display = display;
+		g->renderQuit = false;
+
+		// A context can only be current on one thread, the render thread takes it from here
+		al_set_target_bitmap(nullptr);
+		g->renderThread = std::thread(render::RenderThread, g);
+
+		return g->renderThread.joinable();
+	}
+
+	void StopRenderThread(Graphics* g)
+	{
+		if (g->renderThread.joinable())
+		{
+			{
+				std::lock_guard<std::mutex> lock(g->sceneSlotMutex);
+				g->renderQuit = true;
+			}
+
+			g->sceneSlotCond.notify_all();
+			g->renderThread.join();
+
+			al_set_target_backbuffer(g->display);
+		}
+	}
+
+	void Update(Graphics* g, const ImDrawData* guiDrawData)
+	{
+		assert(g->renderThread.joinable());
+
 		++g->frameCount;
-		render::Render(*g); 
+		scene::PublishScene(g, guiDrawData);
 	}
 	 
-	bool Resize(Graphics* g, uint x, uint y)
+	void Resize(Graphics* g, uint x, uint y)
 	{
-		g->res = glm::vec2(static_cast<float>(x), static_cast<float>(y));
-		render::init::DestroyFrameBuffers(g);
-		return render::init::GenerateFrameBuffers(g);
+		// The render thread owns the framebuffers and the display's backbuffer, it resizes them before its next frame
+		std::lock_guard<std::mutex> lock(g->sceneSlotMutex);
+
+		g->windowRes = glm::vec2(static_cast<float>(x), static_cast<float>(y));
+		g->pendingRes = g->windowRes;
+		g->resizePending = true;
 	}
 
 
 	void PixelToWolrd(const Graphics& g, float* inoutX, float* inoutY)
 	{
-		const glm::vec2 pixel = glm::vec2(g.res.x - *inoutX, *inoutY) - (g.res * 0.5f);
-		const float z = g.res.y * g.camInvFov;
+		const glm::vec2 pixel = glm::vec2(g.windowRes.x - *inoutX, *inoutY) - (g.windowRes * 0.5f);
+		const float z = g.windowRes.y * g.camInvFov;
 		const glm::vec3 viewRayDir = glm::normalize(glm::vec3(pixel, z));
 		const glm::vec3 worldRayDir = g.camViewMtx * viewRayDir;
 		const float t = -g.camPos.z / worldRayDir.z;
@@ -1015,18 +1423,65 @@ namespace gfx
 		*inoutY = worldPos.y;
 	}
 
+	void GetPassTimings(Graphics* g, PassTimings* outTimings)
+	{
+		float passMs[Graphics::TIMING_FRAMES][Graphics::RENDER_PASSES];
+		uint frameCount;
+
+		{
+			std::lock_guard<std::mutex> lock(g->passTimingMutex);
+
+			frameCount = g->passTimingCount < Graphics::TIMING_FRAMES ? g->passTimingCount : Graphics::TIMING_FRAMES;
+			std::memcpy(passMs, g->passTimingMs, sizeof(passMs));
+			outTimings->renderScale = g->passTimingScale;
+
+			for (uint pass = 0; pass < Graphics::RENDER_PASSES; ++pass)
+			{
+				outTimings->passes[pass].lastMs = g->passTimingCount ? g->passTimingMs[(g->passTimingCount - 1) % Graphics::TIMING_FRAMES][pass] : 0.0f;
+			}
+		}
+
+		outTimings->frameCount = frameCount;
+
+		for (uint pass = 0; pass < Graphics::RENDER_PASSES; ++pass)
+		{
+			PassTiming* const outTiming = outTimings->passes + pass;
+			float samples[Graphics::TIMING_FRAMES];
+
+			if (!frameCount)
+			{
+				*outTiming = {};
+				continue;
+			}
+
+			for (uint frame = 0; frame < frameCount; ++frame)
+			{
+				samples[frame] = passMs[frame][pass];
+			}
+
+			const uint p99Index = (frameCount * 99 + 99) / 100 - 1;
+			std::nth_element(samples, samples + p99Index, samples + frameCount);
+
+			outTiming->minMs = *std::min_element(samples, samples + frameCount);
+			outTiming->avgMs = std::accumulate(samples, samples + frameCount, 0.0f) / frameCount;
+			outTiming->p99Ms = samples[p99Index];
+		}
+	}
+
 	bool AddModel( Graphics* g, uint objectId, MeshType type, const glm::mat4 &transform )
 	{
 		const uint modelId = static_cast<uint>(g->sceneEntries.size());
 
 		if (modelId < Graphics::MAX_ENTRIES )
 		{
-			glm::mat4* const model = &g->sceneEntries.add_to_object(objectId);
-			const float typeNum = static_cast<float>(g->meshTypeRemap[static_cast<uint>(type)]);
+			entry::SceneEntry* const model = &g->sceneEntries.add_to_object(objectId);
+			const uint typeNum = g->meshTypeRemap[static_cast<uint>(type)];
 			const float typeFrac = rand() / static_cast<float>(RAND_MAX + 1);
 
-			*model = glm::inverse( transform );
-			(*model)[3][3] = typeNum + typeFrac;
+			*model = {};
+			entry::SetType(model, typeNum, typeFrac);
+			scene::SetEntryTransform(model, transform);
+			g->sceneDirty = true;
 
 			return true;
 		}
@@ -1041,45 +1496,55 @@ namespace gfx
 		for (size_t objIndex = 0; objIndex < objectIds.size(); ++objIndex)
 		{
 			const uint objId = objectIds[objIndex];
-			glm::mat4* const outTrans = g->sceneEntries.for_object(objId);
+			entry::SceneEntry* const outEntry = g->sceneEntries.for_object(objId);
 
-			if (outTrans)
+			if (outEntry)
 			{
-				glm::mat4 trans = transforms[objIndex];
-				const float meshType = (*outTrans)[3][3];
+				scene::SetEntryTransform(outEntry, transforms[objIndex]);
+			}
+		}
 
-				switch (static_cast<uint>(meshType))
-				{
-				case MESH_TYPE_SNOW_FLAKE:
-					trans[3][2] += 0.3;
-					break;
-				}
+		g->sceneDirty = true;
 
-				*outTrans = glm::inverse(trans);
-				(*outTrans)[3][3] = meshType;
-			}
+		return true;
+	}
+
+	bool UpdateModels(Graphics* g, const std::vector<uint>& objectIds, const float* xs, const float* ys, const float* rots)
+	{
+		const uint objCount = static_cast<uint>(objectIds.size());
+		uint* const entryIndices = (uint*)_malloca(sizeof(uint) * objCount);
+		entry::SceneEntry* const entries = g->sceneEntries.data();
+
+		for (uint objIndex = 0; objIndex < objCount; ++objIndex)
+		{
+			const entry::SceneEntry* const outEntry = g->sceneEntries.for_object(objectIds[objIndex]);
+
+			entryIndices[objIndex] = outEntry ? static_cast<uint>(outEntry - entries) : ~0u;
 		}
 
-		g->sceneBVH = tree::BuildSceneBVH(*g);
+		entry::SetTransforms(entries, entryIndices, xs, ys, rots, objCount);
+		_freea(entryIndices);
+
+		g->sceneDirty = true;
 
 		return true;
 	}
 
 	void UpdateModelSubType(Graphics* g, uint objectId, float subType)
 	{
-		glm::mat4* const outTrans = g->sceneEntries.for_object(objectId);
+		entry::SceneEntry* const outEntry = g->sceneEntries.for_object(objectId);
 
-		if (outTrans)
+		if (outEntry)
 		{
-			assert(subType >= 0.0f && subType < 1.0f);
-
-			(*outTrans)[3][3] = std::floor((*outTrans)[3][3]) + subType;
+			entry::SetType(outEntry, entry::Type(*outEntry), subType);
+			g->sceneDirty = true;
 		}
 	}
 
 	void DestroyObjects( Graphics* g, const std::vector<uint>& objectIds )
 	{
 		g->sceneEntries.remove_objs(objectIds);
+		g->sceneDirty = true;
 	}
 
 }
\ No newline at end of file
@@ -4,6 +4,8 @@
 #include "glm/mat4x4.hpp"
 
 struct Graphics;
+struct ImDrawData;
+struct ALLEGRO_DISPLAY;
 
 typedef unsigned uint;
 
@@ -23,15 +25,47 @@ namespace gfx
 		TREE
 	};
 
+	enum class RenderPass : uint
+	{
+		SCENE,
+		DOWNSAMPLE,
+		BLUR,
+		OUTPUT,
+		COUNT
+	};
+
+	struct PassTiming
+	{
+		float lastMs;
+		float minMs;
+		float avgMs;
+		float p99Ms;
+	};
+
+	// GPU times over the last frames the render thread retired, indexed by RenderPass
+	struct PassTimings
+	{
+		PassTiming passes[static_cast<uint>(RenderPass::COUNT)];
+		uint frameCount;
+		float renderScale;
+	};
+
 	Graphics* Init();
 	void Shutdown(Graphics* g);
-	void Update(Graphics* g);
+	// The render thread takes the display's GL context from the calling thread, StopRenderThread hands it back
+	bool StartRenderThread(Graphics* g, ALLEGRO_DISPLAY* display);
+	void StopRenderThread(Graphics* g);
+	// Snapshots the scene and guiDrawData for the render thread, blocks while it is two frames behind
+	void Update(Graphics* g, const ImDrawData* guiDrawData);
 
-	bool Resize(Graphics* g, uint width, uint height);
+	void Resize(Graphics* g, uint width, uint height);
 	void PixelToWolrd(const Graphics &g, float* inoutX, float* inoutY);
+	void GetPassTimings(Graphics* g, PassTimings* outTimings);
 
 	bool AddModel( Graphics *g, uint objectId, MeshType type, const glm::mat4& transform );
 	bool UpdateModels(Graphics* g, const std::vector<uint>& objectIds, const std::vector<glm::mat4>& transforms);
+	// For bodies moving in the xy plane, rots are radians about z. Leaves each model's z as it was added
+	bool UpdateModels(Graphics* g, const std::vector<uint>& objectIds, const float* xs, const float* ys, const float* rots);
 	void UpdateModelSubType(Graphics* g, uint objectId, float subType);
 
 	void DestroyObjects( Graphics* g, const std::vector<uint>& objectIds );
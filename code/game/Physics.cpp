@@ -1,6 +1,7 @@
 #pragma once
 
 #include <vector>
+#include <type_traits>
 #include "Box2D/Box2D.h"
 #include "ComponentTypes.h"
 #include "Component.h"
@@ -8,6 +9,12 @@
 
 #include "Physics.h"
 
+// Building with SpatialBroadPhase=true swaps b2World's broad-phase for SpatialBroadPhase by putting a replacement
+// b2BroadPhase.h ahead of Box2D's on the include path. Box2D is built the same way, so the world's layout agrees.
+#ifdef KH_SPATIAL_BROADPHASE
+static_assert(std::is_base_of<SpatialBroadPhase, b2BroadPhase>::value, "b2BroadPhase.h resolved to Box2D's own, check the include path");
+#endif
+
 namespace
 {
 	enum BodyGroup : uint16_t
@@ -490,19 +497,20 @@ namespace phy
 		return false;
 	}
 
-	void GatherTransforms(const Physics &p, std::vector<uint>* outIds, std::vector<Transform>* outTransforms)
+	void GatherTransforms(const Physics &p, std::vector<uint>* outIds, Transforms* outTransforms)
 	{
 		*outIds = p.bodies.idToObj;
-		outTransforms->resize(p.bodies.size());
+		outTransforms->x.resize(p.bodies.size());
+		outTransforms->y.resize(p.bodies.size());
+		outTransforms->rot.resize(p.bodies.size());
 
 		for (size_t bodyId = 0; bodyId < p.bodies.size(); ++bodyId)
 		{
-			Transform* const outT = outTransforms->data() + bodyId;
 			const b2Body& body = *p.bodies[bodyId];
 
-			outT->x = body.GetPosition().x;
-			outT->y = body.GetPosition().y;
-			outT->rot = body.GetAngle();
+			outTransforms->x[bodyId] = body.GetPosition().x;
+			outTransforms->y[bodyId] = body.GetPosition().y;
+			outTransforms->rot[bodyId] = body.GetAngle();
 		}
 	}
 
@@ -21,9 +21,9 @@ namespace phy
 		FIRE_BALL
 	};
 
-	struct Transform
+	struct Transforms
 	{
-		float x, y, rot;
+		std::vector<float> x, y, rot;
 	};
 
 	Physics* Init();
@@ -33,7 +33,7 @@ namespace phy
 	bool AddBody(Physics* p, uint objectId, BodyType type, float x = 0.0f, float y = 0.0f);
 	bool AddSoftAnchor(Physics* p, uint objectId);
 
-	void GatherTransforms(const Physics &p, std::vector<uint>* outIds, std::vector<Transform>* outTransforms);
+	void GatherTransforms(const Physics &p, std::vector<uint>* outIds, Transforms* outTransforms);
 	void GatherContacts(const Physics& p, uint objectId, std::vector<uint>* outIds);
 
 	float GetX(const Physics &p, uint objectId);
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cmath>
+#include <emmintrin.h>
+#include "Assert.h"
+#include "glm/vec3.hpp"
+#include "glm/mat4x4.hpp"
+
+typedef unsigned uint;
+
+namespace entry
+{
+	using namespace glm;
+#include "shaders/scene_entry.glsl"
+
+	static_assert(sizeof(SceneEntry) == 16, "SceneEntry must match scene.frag's in_entries layout");
+
+	// rots are radians, returns each as a fraction of a turn in SCENE_ENTRY_ROTATION_MASK's bits. Rounds to nearest
+	// through the add and subtract of 1.5 * 2^23, so SSE2 is enough and RotationBits below gives the same bits
+	__forceinline __m128i RotationBits4(__m128 rots)
+	{
+		const __m128 roundMagic = _mm_set1_ps(12582912.0f);
+		const __m128 turns = _mm_mul_ps(rots, _mm_set1_ps(1.0f / 6.28318530718f));
+		const __m128 wholeTurns = _mm_sub_ps(_mm_add_ps(turns, roundMagic), roundMagic);
+		const __m128 partTurn = _mm_mul_ps(_mm_sub_ps(turns, wholeTurns), _mm_set1_ps(65536.0f));
+
+		return _mm_and_si128(_mm_cvtps_epi32(partTurn), _mm_set1_epi32(SCENE_ENTRY_ROTATION_MASK));
+	}
+
+	__forceinline uint RotationBits(float rot)
+	{
+		return static_cast<uint>(_mm_cvtsi128_si32(RotationBits4(_mm_set_ss(rot))));
+	}
+
+	// transform must be a rotation about z and a translation, which every scene object's is. scene.frag inverts it
+	inline void SetTransform(SceneEntry* outEntry, const glm::mat4& transform)
+	{
+		assert(std::abs(transform[2][2] - 1.0f) < 1e-4f);
+
+		outEntry->position = glm::vec3(transform[3]);
+		outEntry->typeRotation = (outEntry->typeRotation & ~SCENE_ENTRY_ROTATION_MASK) | RotationBits(std::atan2(transform[0][1], transform[0][0]));
+	}
+
+	// Batched SetTransform for bodies moving in the xy plane, entry entryIndices[i] is moved to (xs[i], ys[i]) and
+	// rotated by rots[i] radians, an index of ~0u skips body i. Keeps each entry's z, type and sub type.
+	inline void SetTransforms(SceneEntry* entries, const uint* entryIndices, const float* xs, const float* ys, const float* rots, uint count)
+	{
+		alignas(16) uint rotationBits[4];
+		uint bodyIndex = 0;
+
+		for (; bodyIndex < count; bodyIndex += 4)
+		{
+			const uint laneCount = count - bodyIndex < 4 ? count - bodyIndex : 4;
+
+			if (laneCount == 4)
+			{
+				_mm_store_si128(reinterpret_cast<__m128i*>(rotationBits), RotationBits4(_mm_loadu_ps(rots + bodyIndex)));
+			}
+			else
+			{
+				for (uint lane = 0; lane < laneCount; ++lane)
+				{
+					rotationBits[lane] = RotationBits(rots[bodyIndex + lane]);
+				}
+			}
+
+			for (uint lane = 0; lane < laneCount; ++lane)
+			{
+				const uint entryIndex = entryIndices[bodyIndex + lane];
+
+				if (entryIndex != ~0u)
+				{
+					SceneEntry* const outEntry = entries + entryIndex;
+
+					outEntry->position.x = xs[bodyIndex + lane];
+					outEntry->position.y = ys[bodyIndex + lane];
+					outEntry->typeRotation = (outEntry->typeRotation & ~SCENE_ENTRY_ROTATION_MASK) | rotationBits[lane];
+				}
+			}
+		}
+	}
+
+	inline void SetType(SceneEntry* outEntry, uint type, float subType)
+	{
+		assert(type <= SCENE_ENTRY_TYPE_MASK);
+		assert(subType >= 0.0f && subType < 1.0f);
+
+		const uint subTypeBits = static_cast<uint>(subType * 256.0f) & SCENE_ENTRY_SUB_TYPE_MASK;
+
+		outEntry->typeRotation = (outEntry->typeRotation & SCENE_ENTRY_ROTATION_MASK) | (type << SCENE_ENTRY_TYPE_SHIFT) | (subTypeBits << SCENE_ENTRY_SUB_TYPE_SHIFT);
+	}
+
+	inline uint Type(const SceneEntry& sceneEntry)
+	{
+		return (sceneEntry.typeRotation >> SCENE_ENTRY_TYPE_SHIFT) & SCENE_ENTRY_TYPE_MASK;
+	}
+}
@@ -0,0 +1,274 @@
+#include "SpatialBroadPhase.h"
+
+namespace
+{
+	static void TreeStats_r(const spatial_tree<int32, 2, 8>& node, int32* outHeight, int32* inoutMaxBalance, float32* inoutPerimeter)
+	{
+		int32 minChildHeight = INT32_MAX;
+		int32 maxChildHeight = 0;
+
+		for (unsigned childIndex = 0; childIndex < node.child_count(); ++childIndex)
+		{
+			int32 childHeight = 0;
+
+			*inoutPerimeter += 2.0f * ((node.child_maxs(0)[childIndex] - node.child_mins(0)[childIndex]) + (node.child_maxs(1)[childIndex] - node.child_mins(1)[childIndex]));
+
+			if (!node.leaf_branch())
+				TreeStats_r(node.subtree(childIndex), &childHeight, inoutMaxBalance, inoutPerimeter);
+
+			minChildHeight = b2Min(minChildHeight, childHeight);
+			maxChildHeight = b2Max(maxChildHeight, childHeight);
+		}
+
+		*outHeight = node.child_count() ? maxChildHeight + 1 : 0;
+		if (node.child_count())
+			*inoutMaxBalance = b2Max(*inoutMaxBalance, maxChildHeight - minChildHeight);
+	}
+}
+
+SpatialBroadPhase::SpatialBroadPhase()
+	: freeProxy(e_nullProxy)
+	, proxyCount(0)
+	, refitCount(0)
+	, rebuildTree(false)
+{
+}
+
+int32 SpatialBroadPhase::CreateProxy(const b2AABB& aabb, void* userData)
+{
+	const b2Vec2 r(b2_aabbExtension, b2_aabbExtension);
+	int32 proxyId;
+
+	if (freeProxy != e_nullProxy)
+	{
+		proxyId = freeProxy;
+		freeProxy = proxies[proxyId].nextFree;
+	}
+	else
+	{
+		proxyId = static_cast<int32>(proxies.size());
+		proxies.emplace_back();
+	}
+
+	Proxy* const proxy = &proxies[proxyId];
+
+	proxy->fatAABB.lowerBound = aabb.lowerBound - r;
+	proxy->fatAABB.upperBound = aabb.upperBound + r;
+	proxy->userData = userData;
+	proxy->nextFree = e_nullProxy;
+	proxy->live = true;
+	proxy->moved = false;
+	proxy->stale = false;
+	++proxyCount;
+
+	// Inserted in bulk on the next sync. A pending rebuild will pick it up anyway.
+	if (!rebuildTree)
+		pendingProxies.push_back(proxyId);
+
+	BufferMove(proxyId);
+
+	return proxyId;
+}
+
+void SpatialBroadPhase::DestroyProxy(int32 proxyId)
+{
+	Proxy* const proxy = &proxies[proxyId];
+
+	if (proxy->moved)
+		moveBuffer.erase(std::find(moveBuffer.begin(), moveBuffer.end(), proxyId));
+
+	proxy->userData = nullptr;
+	proxy->nextFree = freeProxy;
+	proxy->live = false;
+	proxy->moved = false;
+	proxy->stale = false;
+	freeProxy = proxyId;
+	--proxyCount;
+
+	rebuildTree = true;
+}
+
+void SpatialBroadPhase::MoveProxy(int32 proxyId, const b2AABB& aabb, const b2Vec2& displacement)
+{
+	Proxy* const proxy = &proxies[proxyId];
+
+	if (proxy->fatAABB.Contains(aabb))
+		return;
+
+	// Same fattening as b2DynamicTree, extended along the displacement to predict motion
+	const b2Vec2 r(b2_aabbExtension, b2_aabbExtension);
+	const b2Vec2 d = b2_aabbMultiplier * displacement;
+
+	proxy->fatAABB.lowerBound = aabb.lowerBound - r;
+	proxy->fatAABB.upperBound = aabb.upperBound + r;
+
+	if (d.x < 0.0f)
+		proxy->fatAABB.lowerBound.x += d.x;
+	else
+		proxy->fatAABB.upperBound.x += d.x;
+
+	if (d.y < 0.0f)
+		proxy->fatAABB.lowerBound.y += d.y;
+	else
+		proxy->fatAABB.upperBound.y += d.y;
+
+	if (!proxy->stale)
+	{
+		proxy->stale = true;
+		staleProxies.push_back(proxyId);
+	}
+
+	BufferMove(proxyId);
+}
+
+void SpatialBroadPhase::TouchProxy(int32 proxyId)
+{
+	BufferMove(proxyId);
+}
+
+int32 SpatialBroadPhase::GetTreeHeight() const
+{
+	int32 height = 0;
+	int32 balance = 0;
+	float32 perimeter = 0.0f;
+
+	SyncTree();
+	TreeStats_r(tree, &height, &balance, &perimeter);
+
+	return height;
+}
+
+int32 SpatialBroadPhase::GetTreeBalance() const
+{
+	int32 height = 0;
+	int32 balance = 0;
+	float32 perimeter = 0.0f;
+
+	SyncTree();
+	TreeStats_r(tree, &height, &balance, &perimeter);
+
+	return balance;
+}
+
+// Total node perimeter over the root's, as b2DynamicTree::GetAreaRatio
+float32 SpatialBroadPhase::GetTreeQuality() const
+{
+	int32 height = 0;
+	int32 balance = 0;
+	float32 perimeter = 0.0f;
+	float rootMins[2];
+	float rootMaxs[2];
+
+	SyncTree();
+
+	if (tree.empty())
+		return 0.0f;
+
+	TreeStats_r(tree, &height, &balance, &perimeter);
+	tree.bounds(rootMins, rootMaxs);
+
+	const float32 rootPerimeter = 2.0f * ((rootMaxs[0] - rootMins[0]) + (rootMaxs[1] - rootMins[1]));
+
+	return rootPerimeter > 0.0f ? perimeter / rootPerimeter : 0.0f;
+}
+
+void SpatialBroadPhase::ShiftOrigin(const b2Vec2& newOrigin)
+{
+	for (Proxy& proxy : proxies)
+	{
+		proxy.fatAABB.lowerBound -= newOrigin;
+		proxy.fatAABB.upperBound -= newOrigin;
+	}
+
+	tree.transform([&newOrigin](int32, float(&inoutMins)[2], float(&inoutMaxs)[2])
+	{
+		inoutMins[0] -= newOrigin.x;
+		inoutMins[1] -= newOrigin.y;
+		inoutMaxs[0] -= newOrigin.x;
+		inoutMaxs[1] -= newOrigin.y;
+		return true;
+	});
+}
+
+void SpatialBroadPhase::BufferMove(int32 proxyId)
+{
+	if (!proxies[proxyId].moved)
+	{
+		proxies[proxyId].moved = true;
+		moveBuffer.push_back(proxyId);
+	}
+}
+
+void SpatialBroadPhase::SyncTree() const
+{
+	if (!rebuildTree && staleProxies.empty() && pendingProxies.empty())
+		return;
+
+	refitCount += static_cast<int32>(staleProxies.size());
+
+	// Refitting in place keeps the old topology, which gets loose as things drift. Start over once it's been refit
+	// about as many times as there are proxies.
+	if (rebuildTree || refitCount > proxyCount)
+	{
+		RebuildTree();
+	}
+	else if (!staleProxies.empty())
+	{
+		tree.transform([this](int32 proxyId, float(&inoutMins)[2], float(&inoutMaxs)[2])
+		{
+			const Proxy* const proxy = &proxies[proxyId];
+
+			if (!proxy->stale)
+				return false;
+
+			ProxyBounds(proxyId, &inoutMins, &inoutMaxs);
+			proxy->stale = false;
+
+			return true;
+		});
+	}
+
+	if (!pendingProxies.empty())
+	{
+		tree.insert(pendingProxies.begin(), pendingProxies.end(), [this](int32 proxyId, float(&outMins)[2], float(&outMaxs)[2])
+		{
+			ProxyBounds(proxyId, &outMins, &outMaxs);
+			proxies[proxyId].stale = false;
+		});
+	}
+
+	staleProxies.clear();
+	pendingProxies.clear();
+}
+
+void SpatialBroadPhase::RebuildTree() const
+{
+	std::vector<int32> liveProxies;
+
+	liveProxies.reserve(proxyCount);
+	for (int32 proxyId = 0; proxyId < static_cast<int32>(proxies.size()); ++proxyId)
+	{
+		proxies[proxyId].stale = false;
+		if (proxies[proxyId].live)
+			liveProxies.push_back(proxyId);
+	}
+
+	tree = tree_type(liveProxies.begin(), liveProxies.end(), [this](int32 proxyId, float(&outMins)[2], float(&outMaxs)[2])
+	{
+		ProxyBounds(proxyId, &outMins, &outMaxs);
+	});
+
+	pendingProxies.clear();
+	refitCount = 0;
+	rebuildTree = false;
+}
+
+void SpatialBroadPhase::ProxyBounds(int32 proxyId, float(*outMins)[2], float(*outMaxs)[2]) const
+{
+	const b2AABB& fatAABB = proxies[proxyId].fatAABB;
+
+	(*outMins)[0] = fatAABB.lowerBound.x;
+	(*outMins)[1] = fatAABB.lowerBound.y;
+	(*outMaxs)[0] = fatAABB.upperBound.x;
+	(*outMaxs)[1] = fatAABB.upperBound.y;
+}
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include "Box2D/Collision/b2Collision.h"
+#include "bvh/spatial_tree.h"
+
+// Broad-phase backed by a 2D spatial_tree, with the same interface and pair semantics as b2BroadPhase: proxies get
+// fattened AABBs, moves that stay inside the fat AABB are free, and UpdatePairs reports every overlapping pair that
+// involves a moved proxy exactly once, ordered by proxy id. Box2D 2.3.1 hard-wires b2BroadPhase into b2ContactManager,
+// so building with SpatialBroadPhase=true puts a b2BroadPhase.h deriving from this ahead of Box2D's own instead.
+//
+// The tree has no removal or per-leaf update, so changes are batched and applied the next time it's read. New proxies
+// are bulk inserted, proxies moving out of their fat AABB are refit in place, and destroys, or more refits than there
+// are proxies, trigger a rebuild.
+class SpatialBroadPhase
+{
+public:
+	enum
+	{
+		e_nullProxy = -1
+	};
+
+	SpatialBroadPhase();
+
+	int32 CreateProxy(const b2AABB& aabb, void* userData);
+	void DestroyProxy(int32 proxyId);
+	void MoveProxy(int32 proxyId, const b2AABB& aabb, const b2Vec2& displacement);
+	void TouchProxy(int32 proxyId);
+
+	const b2AABB& GetFatAABB(int32 proxyId) const
+	{
+		return proxies[proxyId].fatAABB;
+	}
+
+	void* GetUserData(int32 proxyId) const
+	{
+		return proxies[proxyId].userData;
+	}
+
+	bool TestOverlap(int32 proxyIdA, int32 proxyIdB) const
+	{
+		return b2TestOverlap(proxies[proxyIdA].fatAABB, proxies[proxyIdB].fatAABB);
+	}
+
+	int32 GetProxyCount() const
+	{
+		return proxyCount;
+	}
+
+	// T::AddPair(void* userDataA, void* userDataB)
+	template <typename T>
+	void UpdatePairs(T* callback)
+	{
+		SyncTree();
+		pairBuffer.clear();
+
+		// When most proxies moved, one self_clip pass is cheaper than a query per move
+		if (static_cast<int32>(moveBuffer.size()) * 4 >= proxyCount)
+		{
+			tree.self_clip([this](int32 proxyIdA, int32 proxyIdB)
+			{
+				if (proxies[proxyIdA].moved || proxies[proxyIdB].moved)
+					pairBuffer.push_back({ b2Min(proxyIdA, proxyIdB), b2Max(proxyIdA, proxyIdB) });
+			});
+		}
+		else
+		{
+			for (int32 queryProxyId : moveBuffer)
+			{
+				const b2AABB& fatAABB = proxies[queryProxyId].fatAABB;
+
+				tree.query(&fatAABB.lowerBound.x, &fatAABB.upperBound.x, [this, queryProxyId](int32 proxyId)
+				{
+					// Pairs of two moved proxies are recorded by the query of the higher id only
+					if (proxyId == queryProxyId || (proxies[proxyId].moved && proxyId > queryProxyId))
+						return;
+
+					pairBuffer.push_back({ b2Min(proxyId, queryProxyId), b2Max(proxyId, queryProxyId) });
+				});
+			}
+		}
+
+		std::sort(pairBuffer.begin(), pairBuffer.end(), [](const Pair& lhs, const Pair& rhs)
+		{
+			return lhs.proxyIdA < rhs.proxyIdA || (lhs.proxyIdA == rhs.proxyIdA && lhs.proxyIdB < rhs.proxyIdB);
+		});
+
+		for (const Pair& pair : pairBuffer)
+			callback->AddPair(proxies[pair.proxyIdA].userData, proxies[pair.proxyIdB].userData);
+
+		for (int32 movedProxyId : moveBuffer)
+			proxies[movedProxyId].moved = false;
+
+		moveBuffer.clear();
+	}
+
+	// T::QueryCallback(int32 proxyId) returns false to stop
+	template <typename T>
+	void Query(T* callback, const b2AABB& aabb) const
+	{
+		SyncTree();
+
+		tree.query(&aabb.lowerBound.x, &aabb.upperBound.x, [callback](int32 proxyId)
+		{
+			return callback->QueryCallback(proxyId);
+		});
+	}
+
+	// T::RayCastCallback(const b2RayCastInput& input, int32 proxyId) returns 0 to stop, or a positive fraction to clip the ray
+	template <typename T>
+	void RayCast(T* callback, const b2RayCastInput& input) const
+	{
+		const b2Vec2 dir = input.p2 - input.p1;
+		const b2Vec2 end = input.p1 + input.maxFraction * dir;
+		b2RayCastInput subInput = input;
+
+		SyncTree();
+
+		tree.segment_query(&input.p1.x, &end.x, [&](int32 proxyId, const float(&mins)[2], const float(&maxs)[2])
+		{
+			// The query segment can't shrink once started, so skip anything past where earlier hits clipped the ray
+			if (!spatial_bounds::detail::SegmentBox<2>(&input.p1.x, &dir.x, subInput.maxFraction, mins, maxs, 0.0f))
+				return true;
+
+			const float32 value = callback->RayCastCallback(subInput, proxyId);
+
+			if (value == 0.0f)
+				return false;
+
+			if (value > 0.0f)
+				subInput.maxFraction = value;
+
+			return true;
+		});
+	}
+
+	int32 GetTreeHeight() const;
+	int32 GetTreeBalance() const;
+	float32 GetTreeQuality() const;
+
+	void ShiftOrigin(const b2Vec2& newOrigin);
+
+private:
+	typedef spatial_tree<int32, 2, 8> tree_type;
+
+	struct Proxy
+	{
+		b2AABB fatAABB;
+		void* userData;
+		int32 nextFree;
+		bool live;
+		bool moved; // In the move buffer
+		mutable bool stale; // Tree bounds are out of date
+	};
+
+	struct Pair
+	{
+		int32 proxyIdA;
+		int32 proxyIdB;
+	};
+
+	std::vector<Proxy> proxies;
+	std::vector<int32> moveBuffer;
+	std::vector<Pair> pairBuffer;
+	int32 freeProxy;
+	int32 proxyCount;
+
+	// Brought up to date lazily by the const queries
+	mutable tree_type tree;
+	mutable std::vector<int32> staleProxies;
+	mutable std::vector<int32> pendingProxies;
+	mutable int32 refitCount;
+	mutable bool rebuildTree;
+
+	void BufferMove(int32 proxyId);
+	void SyncTree() const;
+	void RebuildTree() const;
+	void ProxyBounds(int32 proxyId, float(*outMins)[2], float(*outMaxs)[2]) const;
+};
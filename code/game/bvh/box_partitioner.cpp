@@ -1,11 +1,17 @@
+#include "box_partitioner.h"
 #include "box_partitioner_internal.h"
 #include "box_partitioner_sse2.h"
-#include "../apply_permutation.h"
+#include "box_partitioner_avx2.h"
+#include "box_partitioner_avx512.h"
+#include "box_partitioner_parallel.h"
 #include "../Assert.h"
 #include <intrin.h>
 #include <malloc.h>
-#include <numeric>
 #include <algorithm>
+#include <limits>
+#include <cstring>
+#include <cmath>
+#include <cfloat>
 
 namespace
 {
@@ -28,73 +34,707 @@ static T* AllocWorkMem(uint count, void** workMemPtr)
 	return mem;
 }
 
+enum class PartitionISA
+{
+	SSE2,
+	AVX2,
+	AVX512
+};
+
+static PartitionISA DetectPartitionISA()
+{
+	static const int ECX_FMA = 1 << 12;
+	static const int ECX_OSXSAVE = 1 << 27;
+	static const int ECX_AVX = 1 << 28;
+	static const int EBX_AVX2 = 1 << 5;
+	static const int EBX_AVX512F = 1 << 16;
+	static const unsigned long long XCR0_YMM = 0x6;  // SSE and AVX state
+	static const unsigned long long XCR0_ZMM = 0xE6; // Plus opmask and both halves of the zmm registers
+	int regs[4]; // eax, ebx, ecx, edx
+
+	__cpuid( regs, 0 );
+	if( regs[0] < 7 )
+		return PartitionISA::SSE2;
+
+	__cpuid( regs, 1 );
+	const int features1 = regs[2];
+
+	// The OS has to save the wide registers on context switches as well
+	if( ( features1 & ( ECX_OSXSAVE | ECX_AVX | ECX_FMA ) ) != ( ECX_OSXSAVE | ECX_AVX | ECX_FMA ) )
+		return PartitionISA::SSE2;
+
+	const unsigned long long xcr0 = _xgetbv( 0 );
+	if( ( xcr0 & XCR0_YMM ) != XCR0_YMM )
+		return PartitionISA::SSE2;
+
+	__cpuidex( regs, 7, 0 );
+	const int features7 = regs[1];
+
+	if( ( features7 & EBX_AVX512F ) && ( xcr0 & XCR0_ZMM ) == XCR0_ZMM )
+		return PartitionISA::AVX512;
+
+	if( features7 & EBX_AVX2 )
+		return PartitionISA::AVX2;
+
+	return PartitionISA::SSE2;
+}
+
+static const PartitionISA s_partitionISA = DetectPartitionISA();
+
+// The widest driver the CPU supports. Picked once, and every driver is stateless, so they're shared between threads.
 template <size_t D>
-static void UpdateBoxPartitions( const uint meanCount, Boxes<D>* inoutBoxes, BoxMeans* inoutBoxMeans, uint* inoutIndices, uint* outPartitions, void* workMem )
+static BoxPartitionDriver<D>& GetPartitionDriver()
 {
-	const uint lastMeanIndex = meanCount - 1;
-	unsigned* const partBegin = AllocWorkMem<unsigned>( inoutBoxes->count, &workMem );
-	unsigned* const partEnd = partBegin + inoutBoxes->count;
+	static BoxPartitionDriver_SSE2<D> sse2Driver;
+	static BoxPartitionDriver_AVX2<D> avx2Driver;
+	static BoxPartitionDriver_AVX512<D> avx512Driver;
+
+	switch( s_partitionISA )
+	{
+	case PartitionISA::AVX512:
+		return avx512Driver;
+	case PartitionISA::AVX2:
+		return avx2Driver;
+	default:
+		return sse2Driver;
+	}
+}
+
+// Below this the pool's wake ups cost more than splitting the work saves
+static const uint PARALLEL_MIN_BOX_COUNT = 4 * BoxPartitionDriver_Parallel<3>::CHUNK_BOX_COUNT;
 
-	std::iota( partBegin, partEnd, 0 );
+// Below this the k-means|| rounds cost more than the iterations they save over farthest first
+static const uint SCALABLE_SEED_MIN_BOX_COUNT = 1024;
 
-	unsigned* partCur = partBegin;
-	for( size_t meanIndex = 0; meanIndex < lastMeanIndex; ++meanIndex )
+static PartitionWorkerPool& GetPartitionWorkerPool()
+{
+	static PartitionWorkerPool pool( std::max( std::thread::hardware_concurrency(), 1u ) - 1 );
+
+	return pool;
+}
+
+// Copies one box stream into box order by partition, as a linear read and k linear write streams
+template <typename T>
+static void ScatterBoxStream( const uint* boxDests, uint boxCount, const T* src, T* dst )
+{
+	for( uint boxIndex = 0; boxIndex < boxCount; ++boxIndex )
+		dst[boxDests[boxIndex]] = src[boxIndex];
+}
+
+// Groups the boxes by nearest mean with a counting scatter: a histogram, its prefix sum, then one pass over each stream
+// into the scatter buffers, which are swapped in afterward. Stable, so each partition keeps its boxes' previous order,
+// or their input order when inIndexOrder is set, which makes the partition sums independent of how the boxes got there.
+// The streams are independent and each is bandwidth bound, so large partitions scatter them on the worker pool.
+template <size_t D>
+static void UpdateBoxPartitions( const uint meanCount, Boxes<D>* inoutBoxes, BoxMeans* inoutBoxMeans, uint** inoutIndices, uint* outPartitions, Boxes<D>* scatterBoxes, BoxMeans* scatterBoxMeans, uint** scatterIndices, uint* boxDests, PartitionWorkerPool* pool, bool inIndexOrder = false )
+{
+	const uint boxCount = inoutBoxes->count;
+	const uint* const nearestMeans = inoutBoxMeans->nearestMeans;
+
+	std::memset( outPartitions, 0, sizeof( uint ) * meanCount );
+	for( uint boxIndex = 0; boxIndex < boxCount; ++boxIndex )
+		++outPartitions[nearestMeans[boxIndex]];
+
+	uint partitionBegin = 0;
+	for( uint meanIndex = 0; meanIndex < meanCount; ++meanIndex )
 	{
-		partCur = std::partition( partCur, partEnd, [meanIndex, inoutBoxMeans]( unsigned boxIndex )
+		const uint partitionSize = outPartitions[meanIndex];
+
+		outPartitions[meanIndex] = partitionBegin;
+		partitionBegin += partitionSize;
+	}
+
+	// Bumping each partition's write cursor leaves it at the partition's end, which is what outPartitions holds
+	if( inIndexOrder )
+	{
+		// The index scatter buffer isn't written until the scatter, so it holds where each input box is until then
+		uint* const boxPositions = *scatterIndices;
+
+		for( uint boxIndex = 0; boxIndex < boxCount; ++boxIndex )
+			boxPositions[( *inoutIndices )[boxIndex]] = boxIndex;
+
+		for( uint inputIndex = 0; inputIndex < boxCount; ++inputIndex )
 		{
-			return inoutBoxMeans->nearestMeans[boxIndex] == meanIndex;
-		} );
-		outPartitions[meanIndex] = static_cast<uint>( partCur - partBegin );
+			const uint boxIndex = boxPositions[inputIndex];
+
+			boxDests[boxIndex] = outPartitions[nearestMeans[boxIndex]]++;
+		}
+	}
+	else
+	{
+		for( uint boxIndex = 0; boxIndex < boxCount; ++boxIndex )
+			boxDests[boxIndex] = outPartitions[nearestMeans[boxIndex]]++;
+	}
+
+	const float* floatSrcs[4 + 3 * D];
+	float* floatDsts[4 + 3 * D];
+	uint floatStreamCount = 0;
+	const auto AddFloatStream = [&]( const float* src, float* dst )
+	{
+		floatSrcs[floatStreamCount] = src;
+		floatDsts[floatStreamCount] = dst;
+		++floatStreamCount;
+	};
+
+	AddFloatStream( inoutBoxMeans->meanDists, scatterBoxMeans->meanDists );
+	AddFloatStream( inoutBoxes->masses, scatterBoxes->masses );
+	if( inoutBoxMeans->assignedBounds )
+	{
+		AddFloatStream( inoutBoxMeans->assignedBounds, scatterBoxMeans->assignedBounds );
+		AddFloatStream( inoutBoxMeans->otherBounds, scatterBoxMeans->otherBounds );
+	}
+
+	for( size_t d = 0; d < D; ++d )
+	{
+		AddFloatStream( inoutBoxes->mins[d], scatterBoxes->mins[d] );
+		AddFloatStream( inoutBoxes->maxs[d], scatterBoxes->maxs[d] );
+		AddFloatStream( inoutBoxes->weightedCenters[d], scatterBoxes->weightedCenters[d] );
 	}
-	outPartitions[lastMeanIndex] = inoutBoxes->count;
 
-	apply_permutation( partBegin, inoutBoxMeans->nearestMeans, inoutBoxes->count );
-	apply_permutation( partBegin, inoutBoxMeans->meanDists, inoutBoxes->count );
-	apply_permutation( partBegin, inoutIndices, inoutBoxes->count );
-	apply_permutation( partBegin, inoutBoxes->masses, inoutBoxes->count );
+	// Task 0 is the indices. Nearest means needn't move at all, every partition is just its mean's index.
+	const auto ScatterTask = [&]( unsigned taskIndex )
+	{
+		if( taskIndex == 0 )
+		{
+			ScatterBoxStream( boxDests, boxCount, *inoutIndices, *scatterIndices );
+
+			uint meanBegin = 0;
+			for( uint meanIndex = 0; meanIndex < meanCount; ++meanIndex )
+			{
+				std::fill( scatterBoxMeans->nearestMeans + meanBegin, scatterBoxMeans->nearestMeans + outPartitions[meanIndex], meanIndex );
+				meanBegin = outPartitions[meanIndex];
+			}
+		}
+		else
+		{
+			ScatterBoxStream( boxDests, boxCount, floatSrcs[taskIndex - 1], floatDsts[taskIndex - 1] );
+		}
+	};
 
-	for (size_t d = 0; d < D; ++d)
+	if( pool )
+	{
+		pool->run( floatStreamCount + 1, ScatterTask );
+	}
+	else
+	{
+		for( uint taskIndex = 0; taskIndex <= floatStreamCount; ++taskIndex )
+			ScatterTask( taskIndex );
+	}
+
+	for( size_t d = 0; d < D; ++d )
 	{
-		apply_permutation( partBegin, inoutBoxes->mins[d], inoutBoxes->count );
-		apply_permutation( partBegin, inoutBoxes->maxs[d], inoutBoxes->count );
-		apply_permutation( partBegin, inoutBoxes->weightedCenters[d], inoutBoxes->count );
+		std::swap( inoutBoxes->mins[d], scatterBoxes->mins[d] );
+		std::swap( inoutBoxes->maxs[d], scatterBoxes->maxs[d] );
+		std::swap( inoutBoxes->weightedCenters[d], scatterBoxes->weightedCenters[d] );
 	}
+
+	std::swap( inoutBoxes->masses, scatterBoxes->masses );
+	std::swap( *inoutBoxMeans, *scatterBoxMeans );
+	std::swap( *inoutIndices, *scatterIndices );
+}
+
+// Lines are sorted and split exactly instead of running k-means, up to this many partitions. The split table takes k
+// uints per box, so this bounds the work mem; more partitions than that fall back to k-means.
+static const uint EXACT_LINES_MAX_K = 16;
+
+static size_t ComputeExactLinesWorkMemSize( uint boxCount )
+{
+	const size_t keysSize = RoundUp64( sizeof( uint ) * boxCount );
+	const size_t orderSize = RoundUp64( sizeof( uint ) * boxCount );
+	const size_t prefixSumsSize = RoundUp64( sizeof( double ) * ( boxCount + 1 ) ) * 3; // Plus 1 / n per size
+	const size_t costsSize = RoundUp64( sizeof( double ) * ( boxCount + 1 ) ) * 2; // This layer's and the last
+	const size_t splitsSize = RoundUp64( sizeof( uint ) * ( boxCount + 1 ) * EXACT_LINES_MAX_K );
+
+	return 64 + keysSize + orderSize + prefixSumsSize + costsSize + splitsSize;
 }
 
 template <size_t D>
 static size_t ComputeWorkMemSize( uint boxCount )
 {
-	static BoxPartitionDriver_SSE2<D> sse2Driver;
+	BoxPartitionDriver<D>& driver = GetPartitionDriver<D>();
 
-	boxCount = sse2Driver.AlignBoxCount( boxCount );
+	boxCount = driver.AlignBoxCount( boxCount );
 	const size_t nearestMeansSize = RoundUp64( sizeof( uint ) * boxCount );
 	const size_t meanDistsSize = RoundUp64( sizeof( float ) * boxCount );
 	const size_t permuteSize = RoundUp64( sizeof( unsigned ) * boxCount );
 	const size_t boxWeightedCentersSize = RoundUp64( sizeof( float ) * boxCount ) * D;
 	const size_t boxMassesSize = RoundUp64( sizeof( float ) * boxCount );
 	const size_t meansSize = RoundUp64(sizeof( float )*boxCount*D) + (64 * D);
+	const size_t boundsSize = RoundUp64( sizeof( float ) * boxCount ) * 2;
+	const size_t prevMeansSize = meansSize;
+	const size_t driftsSize = RoundUp64( sizeof( float ) * boxCount );
+	const size_t scatterSize = RoundUp64( sizeof( float ) * boxCount ) * ( 6 + 3 * D ); // Every box stream again, plus indices
 
-	return 64 + nearestMeansSize + meanDistsSize + permuteSize + boxWeightedCentersSize + boxMassesSize + meansSize;
+	const size_t kMeansSize = 64 + nearestMeansSize + meanDistsSize + permuteSize + boxWeightedCentersSize + boxMassesSize + meansSize + boundsSize + prevMeansSize + driftsSize + scatterSize;
+
+	return D == 1 ? std::max( kMeansSize, ComputeExactLinesWorkMemSize( boxCount ) ) : kMeansSize;
+}
+
+// How far each mean moved since prevMeans. Padded a little to cover rounding in the drift itself.
+// An empty partition's mean is NaN, which never compares less than anything, so it can't drift any closer.
+template <size_t D>
+static MeanDrifts ComputeMeanDrifts( const Means<D>& prevMeans, const Means<D>& means, float* outDrifts )
+{
+	MeanDrifts drifts{ outDrifts, 0.0f, 0, 0.0f };
+
+	for( uint meanIndex = 0; meanIndex < means.k; ++meanIndex )
+	{
+		float distSqr = 0.0f;
+		float magnitude = 1.0f;
+
+		for( size_t d = 0; d < D; ++d )
+		{
+			const float prevMean = prevMeans.means[d][meanIndex];
+			const float mean = means.means[d][meanIndex];
+
+			distSqr += ( mean - prevMean ) * ( mean - prevMean );
+			magnitude = std::max( magnitude, std::max( std::abs( prevMean ), std::abs( mean ) ) );
+		}
+
+		float drift = std::sqrt( distSqr ) * ( 1.0f + 4.0f * FLT_EPSILON ) + 4.0f * FLT_EPSILON * magnitude;
+
+		if( !( drift >= 0.0f ) )
+			drift = 0.0f;
+
+		outDrifts[meanIndex] = drift;
+
+		if( drift > drifts.maxDrift )
+		{
+			drifts.secondMaxDrift = drifts.maxDrift;
+			drifts.maxDrift = drift;
+			drifts.maxDriftMean = meanIndex;
+		}
+		else if( drift > drifts.secondMaxDrift )
+		{
+			drifts.secondMaxDrift = drift;
+		}
+	}
+
+	return drifts;
+}
+
+// Starts every box out at its nearest mean
+template <size_t D>
+static void AssignNearestMeans( BoxPartitionDriver<D>& driver, const Boxes<D>& boxes, const Means<D>& means, BoxMeans* outBoxMeans, uint memBoxCount )
+{
+	std::memset( outBoxMeans->nearestMeans, 0, sizeof( uint ) * memBoxCount );
+	std::fill( outBoxMeans->meanDists, outBoxMeans->meanDists + memBoxCount, std::numeric_limits<float>::max() );
+	driver.UpdateNearestMeans( boxes, means, outBoxMeans );
+}
+
+// A uniform float in [0, 1) hashed from a stream and a counter, so seeding picks the same candidates every run
+static __forceinline float SeedSampleUniform( uint stream, uint counter )
+{
+	uint x = counter * 0x9E3779B9u + stream * 0x85EBCA6Bu + 0x27D4EB2Fu;
+
+	x ^= x >> 16;
+	x *= 0x7FEB352Du;
+	x ^= x >> 15;
+	x *= 0x846CA68Bu;
+	x ^= x >> 16;
+
+	return static_cast<float>( x >> 8 ) * ( 1.0f / 16777216.0f );
+}
+
+// k-means|| candidates. A candidate is always a distinct box, so box sized buffers hold any number of them.
+template <size_t D>
+struct SeedCandidates
+{
+	VecD<D> centers;
+	float* masses; // Summed mass of the boxes nearest each candidate
+	uint* nearestMeans;
+	float* meanDists; // mass * distance^2 to the nearest mean picked so far
+};
+
+static const uint SEED_ROUNDS = 3;
+static const uint SEED_OVERSAMPLING = 1; // Candidates sampled per round, times k
+static const uint SEED_LLOYD_ITERATIONS = 8;
+
+// Picks a candidate with probability in proportion to its weight
+static uint ChooseSeedCandidate( const float* weights, uint candidateCount, float totalWeight, uint stream, uint counter )
+{
+	const float target = SeedSampleUniform( stream, counter ) * totalWeight;
+	float sum = 0.0f;
+	uint chosen = 0;
+
+	for( uint candidateIndex = 0; candidateIndex < candidateCount; ++candidateIndex )
+	{
+		if( weights[candidateIndex] > 0.0f )
+		{
+			chosen = candidateIndex;
+			sum += weights[candidateIndex];
+
+			if( sum > target )
+				break;
+		}
+	}
+
+	return chosen;
+}
+
+template <size_t D>
+static float MeanDistanceSqr( const Means<D>& a, uint aIndex, const Means<D>& b, uint bIndex )
+{
+	float distSqr = 0.0f;
+
+	for( size_t d = 0; d < D; ++d )
+	{
+		const float delta = a.means[d][aIndex] - b.means[d][bIndex];
+
+		distSqr += delta * delta;
+	}
+
+	return distSqr;
+}
+
+// k-means|| (scalable k-means++) seeding. Starting from box 0's center, each round samples about
+// SEED_OVERSAMPLING * k more candidates, each box with probability in proportion to its mass * distance^2 from the
+// candidates so far. A weighted k-means++ and a few Lloyd iterations over the candidates then reduce them to k means.
+// Each round is a single pass over the boxes, which the parallel driver splits across the pool, where farthest first
+// is k passes one after another. Returns false when fewer than k distinct candidates turn up.
+template <size_t D>
+static bool InitializeMeansScalable( BoxPartitionDriver<D>& driver, const Boxes<D>& boxes, const SeedCandidates<D>& candidates, Means<D>* outMeans, BoxMeans* outBoxMeans, uint memBoxCount )
+{
+	const uint meanCount = outMeans->k;
+	uint candidateCount = 0;
+	const auto AddCandidate = [&]( uint boxIndex )
+	{
+		for( size_t d = 0; d < D; ++d )
+			candidates.centers[d][candidateCount] = boxes.weightedCenters[d][boxIndex] / boxes.masses[boxIndex];
+
+		++candidateCount;
+	};
+
+	AddCandidate( 0 );
+
+	std::memset( outBoxMeans->nearestMeans, 0, sizeof( uint ) * memBoxCount );
+	std::fill( outBoxMeans->meanDists, outBoxMeans->meanDists + memBoxCount, std::numeric_limits<float>::max() );
+
+	uint roundBegin = 0;
+	for( uint round = 0; ; ++round )
+	{
+		Means<D> roundCandidates{ candidateCount };
+		roundCandidates.means = candidates.centers;
+
+		const float cost = driver.UpdateSeedDistances( boxes, roundCandidates, roundBegin, outBoxMeans );
+
+		// A box holding a candidate has no chance of being sampled, so no candidate comes up twice
+		if( round == SEED_ROUNDS || !( cost > 0.0f ) )
+			break;
+
+		const float sampleScale = static_cast<float>( SEED_OVERSAMPLING * meanCount ) / cost;
+
+		roundBegin = candidateCount;
+		for( uint boxIndex = 0; boxIndex < boxes.count; ++boxIndex )
+		{
+			const float distance = std::max( outBoxMeans->meanDists[boxIndex], 0.0f );
+
+			if( SeedSampleUniform( round, boxIndex ) < sampleScale * boxes.masses[boxIndex] * distance * distance )
+				AddCandidate( boxIndex );
+		}
+	}
+
+	if( candidateCount < meanCount )
+		return false;
+
+	Means<D> candidateMeans{ candidateCount };
+	candidateMeans.means = candidates.centers;
+
+	std::fill( candidates.masses, candidates.masses + candidateCount, 0.0f );
+	for( uint boxIndex = 0; boxIndex < boxes.count; ++boxIndex )
+		candidates.masses[outBoxMeans->nearestMeans[boxIndex]] += boxes.masses[boxIndex];
+
+	// Weighted k-means++ over the candidates
+	const auto PickMean = [&]( uint candidateIndex, uint meanIndex )
+	{
+		for( size_t d = 0; d < D; ++d )
+			outMeans->means[d][meanIndex] = candidates.centers[d][candidateIndex];
+	};
+
+	float totalMass = 0.0f;
+	for( uint candidateIndex = 0; candidateIndex < candidateCount; ++candidateIndex )
+		totalMass += candidates.masses[candidateIndex];
+
+	PickMean( ChooseSeedCandidate( candidates.masses, candidateCount, totalMass, SEED_ROUNDS, 0 ), 0 );
+
+	for( uint candidateIndex = 0; candidateIndex < candidateCount; ++candidateIndex )
+		candidates.meanDists[candidateIndex] = candidates.masses[candidateIndex] * MeanDistanceSqr( candidateMeans, candidateIndex, *outMeans, 0 );
+
+	for( uint meanIndex = 1; meanIndex < meanCount; ++meanIndex )
+	{
+		float totalCost = 0.0f;
+		for( uint candidateIndex = 0; candidateIndex < candidateCount; ++candidateIndex )
+			totalCost += candidates.meanDists[candidateIndex];
+
+		if( !( totalCost > 0.0f ) )
+			return false;
+
+		PickMean( ChooseSeedCandidate( candidates.meanDists, candidateCount, totalCost, SEED_ROUNDS, meanIndex ), meanIndex );
+
+		for( uint candidateIndex = 0; candidateIndex < candidateCount; ++candidateIndex )
+			candidates.meanDists[candidateIndex] = std::min( candidates.meanDists[candidateIndex], candidates.masses[candidateIndex] * MeanDistanceSqr( candidateMeans, candidateIndex, *outMeans, meanIndex ) );
+	}
+
+	// Weighted Lloyd iterations over the candidates. A mean left without candidates stays where it is.
+	std::fill( candidates.nearestMeans, candidates.nearestMeans + candidateCount, meanCount );
+	for( uint iteration = 0; iteration < SEED_LLOYD_ITERATIONS; ++iteration )
+	{
+		bool moved = false;
+
+		for( uint candidateIndex = 0; candidateIndex < candidateCount; ++candidateIndex )
+		{
+			float nearestDistSqr = std::numeric_limits<float>::max();
+			uint nearestMean = 0;
+
+			for( uint meanIndex = 0; meanIndex < meanCount; ++meanIndex )
+			{
+				const float distSqr = MeanDistanceSqr( candidateMeans, candidateIndex, *outMeans, meanIndex );
+
+				if( distSqr < nearestDistSqr )
+				{
+					nearestDistSqr = distSqr;
+					nearestMean = meanIndex;
+				}
+			}
+
+			moved |= candidates.nearestMeans[candidateIndex] != nearestMean;
+			candidates.nearestMeans[candidateIndex] = nearestMean;
+		}
+
+		if( !moved )
+			break;
+
+		for( uint meanIndex = 0; meanIndex < meanCount; ++meanIndex )
+		{
+			float mass = 0.0f;
+			float weightedSum[D] = {};
+
+			for( uint candidateIndex = 0; candidateIndex < candidateCount; ++candidateIndex )
+			{
+				if( candidates.nearestMeans[candidateIndex] == meanIndex )
+				{
+					for( size_t d = 0; d < D; ++d )
+						weightedSum[d] += candidates.masses[candidateIndex] * candidates.centers[d][candidateIndex];
+
+					mass += candidates.masses[candidateIndex];
+				}
+			}
+
+			if( mass > 0.0f )
+			{
+				for( size_t d = 0; d < D; ++d )
+					outMeans->means[d][meanIndex] = weightedSum[d] / mass;
+			}
+		}
+	}
+
+	AssignNearestMeans( driver, boxes, *outMeans, outBoxMeans, memBoxCount );
+
+	return true;
+}
+
+// Signed distance from a box to a mean as the drivers compute it, negative when the mean is inside, for one box
+template <size_t D>
+static float BoxToMeanDistance( const Boxes<D>& boxes, uint boxIndex, const Means<D>& means, uint meanIndex )
+{
+	float distSqr = 0.0f;
+	float minSideDist = std::numeric_limits<float>::lowest();
+	bool insideBox = true;
+
+	for( size_t d = 0; d < D; ++d )
+	{
+		const float mean = means.means[d][meanIndex];
+		const float minDistToSide = std::max( boxes.mins[d][boxIndex] - mean, mean - boxes.maxs[d][boxIndex] );
+		const float minDistToBox = std::max( minDistToSide, 0.0f );
+
+		insideBox = insideBox && minDistToBox == 0.0f;
+		minSideDist = std::max( minSideDist, minDistToSide );
+		distSqr += minDistToBox * minDistToBox;
+	}
+
+	return insideBox ? minSideDist : std::sqrt( distSqr );
+}
+
+static bool HasEmptyPartition( const uint* partitions, uint k )
+{
+	uint partitionBegin = 0;
+
+	for( uint partitionIndex = 0; partitionIndex < k; ++partitionIndex )
+	{
+		if( partitions[partitionIndex] == partitionBegin )
+			return true;
+
+		partitionBegin = partitions[partitionIndex];
+	}
+
+	return false;
+}
+
+// Whether every box's nearest mean is the partition it is grouped into
+static bool InPartitions( const uint* nearestMeans, const uint* partitions, uint k )
+{
+	uint partitionBegin = 0;
+
+	for( uint partitionIndex = 0; partitionIndex < k; ++partitionIndex )
+	{
+		const uint partitionEnd = partitions[partitionIndex];
+
+		for( uint boxIndex = partitionBegin; boxIndex < partitionEnd; ++boxIndex )
+		{
+			if( nearestMeans[boxIndex] != partitionIndex )
+				return false;
+		}
+
+		partitionBegin = partitionEnd;
+	}
+
+	return true;
+}
+
+// Most boxes a Balanced partition holds, 1.5 times its share rounded up. Always leaves room for every box.
+static __forceinline uint BalancedCapacity( uint k, uint boxCount )
+{
+	return ( 3 * boxCount + 2 * k - 1 ) / ( 2 * k );
+}
+
+// Moves boxes out of the partitions holding more than capacity, cheapest first, where a move costs how much further the
+// box is from the nearest mean with room than from its own. Once a mean fills up, the boxes headed for it look again.
+// moveCosts, moveTargets and moveHeap are box sized scratch. Leaves each box's partition in nearestMeans, and returns
+// false when no partition was over capacity.
+template <size_t D>
+static bool RebalancePartitions( uint capacity, const Boxes<D>& boxes, const Means<D>& means, uint* inoutPartitions, uint* outNearestMeans, float* moveCosts, uint* moveTargets, uint* moveHeap )
+{
+	const uint meanCount = means.k;
+	bool overCapacity = false;
+
+	uint partitionBegin = 0;
+	for( uint meanIndex = 0; meanIndex < meanCount; ++meanIndex )
+	{
+		overCapacity = overCapacity || inoutPartitions[meanIndex] - partitionBegin > capacity;
+		partitionBegin = inoutPartitions[meanIndex];
+	}
+
+	if( !overCapacity )
+		return false;
+
+	uint* const partitionSizes = inoutPartitions; // Sizes rather than ends until the boxes are regrouped
+
+	partitionBegin = 0;
+	for( uint meanIndex = 0; meanIndex < meanCount; ++meanIndex )
+	{
+		const uint partitionEnd = inoutPartitions[meanIndex];
+
+		std::fill( outNearestMeans + partitionBegin, outNearestMeans + partitionEnd, meanIndex );
+		partitionSizes[meanIndex] = partitionEnd - partitionBegin;
+		partitionBegin = partitionEnd;
+	}
+
+	// An empty partition's mean is NaN, which still has to take boxes if it's the only room left
+	const auto MeanDistance = [&]( uint boxIndex, uint meanIndex )
+	{
+		const float distance = BoxToMeanDistance( boxes, boxIndex, means, meanIndex );
+
+		return distance <= std::numeric_limits<float>::max() ? distance : std::numeric_limits<float>::max();
+	};
+
+	const auto FindMove = [&]( uint boxIndex )
+	{
+		const uint ownMean = outNearestMeans[boxIndex];
+		float nearestDistance = std::numeric_limits<float>::infinity();
+
+		for( uint meanIndex = 0; meanIndex < meanCount; ++meanIndex )
+		{
+			if( partitionSizes[meanIndex] < capacity )
+			{
+				const float distance = MeanDistance( boxIndex, meanIndex );
+
+				if( distance < nearestDistance )
+				{
+					nearestDistance = distance;
+					moveTargets[boxIndex] = meanIndex;
+				}
+			}
+		}
+
+		moveCosts[boxIndex] = nearestDistance - MeanDistance( boxIndex, ownMean );
+	};
+
+	const auto CheaperMove = [moveCosts]( uint a, uint b ) { return moveCosts[a] > moveCosts[b]; };
+	uint heapSize = 0;
+
+	for( uint boxIndex = 0; boxIndex < boxes.count; ++boxIndex )
+	{
+		if( partitionSizes[outNearestMeans[boxIndex]] > capacity )
+		{
+			FindMove( boxIndex );
+			moveHeap[heapSize++] = boxIndex;
+		}
+	}
+
+	std::make_heap( moveHeap, moveHeap + heapSize, CheaperMove );
+
+	while( heapSize )
+	{
+		std::pop_heap( moveHeap, moveHeap + heapSize, CheaperMove );
+
+		const uint boxIndex = moveHeap[--heapSize];
+		const uint ownMean = outNearestMeans[boxIndex];
+
+		if( partitionSizes[ownMean] <= capacity )
+			continue;
+
+		if( partitionSizes[moveTargets[boxIndex]] >= capacity )
+		{
+			FindMove( boxIndex );
+			moveHeap[heapSize++] = boxIndex;
+			std::push_heap( moveHeap, moveHeap + heapSize, CheaperMove );
+			continue;
+		}
+
+		--partitionSizes[ownMean];
+		++partitionSizes[moveTargets[boxIndex]];
+		outNearestMeans[boxIndex] = moveTargets[boxIndex];
+	}
+
+	return true;
 }
 
 // Partitions boxes of dimension D into K partitions
 template <size_t D>
-static bool PartitionBoxes( uint k, float* const* boxMins, float* const* boxMaxs, uint boxCount, uint* inoutIndices, uint* outPartitions, void* workMem )
+static bool KMeansPartitionBoxes( BoxPartitionDriver<D>& simdDriver, uint k, float* const* boxMins, float* const* boxMaxs, uint boxCount, uint* inoutIndices, uint* outPartitions, void* workMem, PartitionMethod method, PartitionSeeds* inoutSeeds, PartitionStats* outStats )
 {
 	static const uint MAX_ITERATIONS = 64;
-	static BoxPartitionDriver_SSE2<D> sse2Driver;
+	const bool bounded = method == PartitionMethod::Bounded;
+	const bool balanced = method == PartitionMethod::Balanced;
+	const bool parallel = boxCount >= PARALLEL_MIN_BOX_COUNT;
+	BoxPartitionDriver_Parallel<D> parallelDriver( &simdDriver, parallel ? &GetPartitionWorkerPool() : nullptr );
+	BoxPartitionDriver<D>& driver = parallel ? static_cast<BoxPartitionDriver<D>&>( parallelDriver ) : simdDriver;
 
-	const uint memBoxCount = sse2Driver.AlignBoxCount( boxCount );
-	const uint memMeanCount = sse2Driver.AlignBoxCount( k );
+	const uint memBoxCount = driver.AlignBoxCount( boxCount );
+	const uint memMeanCount = driver.AlignBoxCount( k );
 	Boxes<D> boxes{ boxCount };
 	Means<D> means{ k };
+	Means<D> prevMeans{ k };
 	BoxMeans boxMeans;
+	Boxes<D> scatterBoxes{ boxCount };
+	BoxMeans scatterBoxMeans;
+	uint* indices = inoutIndices;
 
 	assert( boxCount >= k );
 
 	boxMeans.nearestMeans = AllocWorkMem<uint>( memBoxCount, &workMem );
 	boxMeans.meanDists = AllocWorkMem<float>( memBoxCount, &workMem );
 	boxes.masses = AllocWorkMem<float>( memBoxCount, &workMem );
+	boxMeans.assignedBounds = bounded ? AllocWorkMem<float>( memBoxCount, &workMem ) : nullptr;
+	boxMeans.otherBounds = bounded ? AllocWorkMem<float>( memBoxCount, &workMem ) : nullptr;
+
+	scatterBoxMeans.nearestMeans = AllocWorkMem<uint>( memBoxCount, &workMem );
+	scatterBoxMeans.meanDists = AllocWorkMem<float>( memBoxCount, &workMem );
+	scatterBoxes.masses = AllocWorkMem<float>( memBoxCount, &workMem );
+	scatterBoxMeans.assignedBounds = bounded ? AllocWorkMem<float>( memBoxCount, &workMem ) : nullptr;
+	scatterBoxMeans.otherBounds = bounded ? AllocWorkMem<float>( memBoxCount, &workMem ) : nullptr;
+	uint* scatterIndices = AllocWorkMem<uint>( memBoxCount, &workMem );
+	uint* const boxDests = AllocWorkMem<uint>( memBoxCount, &workMem );
 
 	for( size_t d = 0; d < D; ++d )
 	{
@@ -103,26 +743,128 @@ static bool PartitionBoxes( uint k, float* const* boxMins, float* const* boxMaxs
 		boxes.mins[d] = boxMins[d];
 		boxes.maxs[d] = boxMaxs[d];
 		boxes.weightedCenters[d] = AllocWorkMem<float>( memBoxCount, &workMem );
+
+		scatterBoxes.mins[d] = AllocWorkMem<float>( memBoxCount, &workMem );
+		scatterBoxes.maxs[d] = AllocWorkMem<float>( memBoxCount, &workMem );
+		scatterBoxes.weightedCenters[d] = AllocWorkMem<float>( memBoxCount, &workMem );
 	}
 
-	sse2Driver.InitializeBoxes( &boxes );
-	sse2Driver.InitializeMeans( boxes, &means, &boxMeans, inoutIndices ); // indices used as work mem here
+	// Only the bounded update reads these, but the work mem always has room for them
+	for( size_t d = 0; d < D; ++d )
+		prevMeans.means[d] = AllocWorkMem<float>( memMeanCount, &workMem );
+
+	float* const meanDrifts = AllocWorkMem<float>( memMeanCount, &workMem );
+
+	driver.InitializeBoxes( &boxes );
 
-	sse2Driver.MakeIndexList( inoutIndices, boxCount, 0 );
+	if( inoutSeeds && inoutSeeds->valid )
+	{
+		for( size_t d = 0; d < D; ++d )
+			std::memcpy( means.means[d], inoutSeeds->means[d], sizeof( float ) * k );
+
+		AssignNearestMeans( driver, boxes, means, &boxMeans, memBoxCount );
+	}
+	else
+	{
+		// The scatter buffers sit idle until the first UpdateBoxPartitions, so the candidates borrow them
+		const SeedCandidates<D> seedCandidates{ scatterBoxes.weightedCenters, scatterBoxes.masses, scatterBoxMeans.nearestMeans, scatterBoxMeans.meanDists };
+
+		if( boxCount < SCALABLE_SEED_MIN_BOX_COUNT || !InitializeMeansScalable( driver, boxes, seedCandidates, &means, &boxMeans, memBoxCount ) )
+			driver.InitializeMeans( boxes, &means, &boxMeans, inoutIndices ); // indices used as work mem here
+	}
+
+	if( bounded )
+	{
+		// No bounds yet, so the first update looks at every mean
+		std::fill( boxMeans.assignedBounds, boxMeans.assignedBounds + memBoxCount, std::numeric_limits<float>::lowest() );
+		std::fill( boxMeans.otherBounds, boxMeans.otherBounds + memBoxCount, std::numeric_limits<float>::lowest() );
+	}
+
+	driver.MakeIndexList( inoutIndices, boxCount, 0 );
 	
 	uint iteration;
 	for( iteration = 0; iteration < MAX_ITERATIONS; ++iteration )
 	{
-		UpdateBoxPartitions<D>( k, &boxes, &boxMeans, inoutIndices, outPartitions, workMem );
+		UpdateBoxPartitions<D>( k, &boxes, &boxMeans, &indices, outPartitions, &scatterBoxes, &scatterBoxMeans, &scatterIndices, boxDests, parallel ? &GetPartitionWorkerPool() : nullptr );
+
+		if( bounded )
+		{
+			for( size_t d = 0; d < D; ++d )
+				std::memcpy( prevMeans.means[d], means.means[d], sizeof( float ) * k );
+		}
+
+		driver.ComputeMeans( boxes, outPartitions, &means );
+
+		bool converged;
 
-		sse2Driver.ComputeMeans( boxes, outPartitions, &means );
+		if( bounded )
+		{
+			const MeanDrifts drifts = ComputeMeanDrifts( prevMeans, means, meanDrifts );
 
-		const bool converged = sse2Driver.UpdateNearestMeans( boxes, means, &boxMeans );
+			converged = driver.UpdateNearestMeansBounded( boxes, means, drifts, &boxMeans );
+		}
+		else
+		{
+			converged = driver.UpdateNearestMeans( boxes, means, &boxMeans );
+		}
 
 		if( converged )
 			break;
 	}
 
+	uint seedIterations = 0;
+
+	if( inoutSeeds )
+	{
+		// The update above only moves a box for a mean nearer than any it has seen, so it can settle with boxes that are
+		// nearer some other mean than their own, and its sums depend on the order the boxes wandered into their
+		// partitions. Warm starting from those means would reassign boxes and set the iterations off again, so plain
+		// Lloyd steps over boxes in input order run until every box is at its true nearest mean, and only those means
+		// are marked valid. A warm start over the same boxes regroups them into the same order, gets the same means back
+		// and stops after one iteration. An empty partition's mean is NaN and would never pick up a box again, so those
+		// start over from farthest first, as do runs that don't settle in time.
+		inoutSeeds->valid = false;
+
+		for( ;; ++seedIterations )
+		{
+			UpdateBoxPartitions<D>( k, &boxes, &boxMeans, &indices, outPartitions, &scatterBoxes, &scatterBoxMeans, &scatterIndices, boxDests, parallel ? &GetPartitionWorkerPool() : nullptr, true );
+			driver.ComputeMeans( boxes, outPartitions, &means );
+
+			if( seedIterations == MAX_ITERATIONS || HasEmptyPartition( outPartitions, k ) )
+				break;
+
+			AssignNearestMeans( driver, boxes, means, &boxMeans, memBoxCount );
+
+			if( InPartitions( boxMeans.nearestMeans, outPartitions, k ) )
+			{
+				inoutSeeds->valid = true;
+				break;
+			}
+		}
+
+		for( size_t d = 0; d < D; ++d )
+			std::memcpy( inoutSeeds->means[d], means.means[d], sizeof( float ) * k );
+	}
+
+	// The scatter buffers and boxDests are free again until the regroup
+	if( balanced && RebalancePartitions( BalancedCapacity( k, boxCount ), boxes, means, outPartitions, boxMeans.nearestMeans, scatterBoxMeans.meanDists, scatterBoxMeans.nearestMeans, boxDests ) )
+	{
+		UpdateBoxPartitions<D>( k, &boxes, &boxMeans, &indices, outPartitions, &scatterBoxes, &scatterBoxMeans, &scatterIndices, boxDests, parallel ? &GetPartitionWorkerPool() : nullptr );
+		driver.ComputeMeans( boxes, outPartitions, &means );
+	}
+
+	// An odd number of scatters leaves the caller's arrays holding the order before last
+	if( indices != inoutIndices )
+	{
+		std::memcpy( inoutIndices, indices, sizeof( uint ) * boxCount );
+
+		for( size_t d = 0; d < D; ++d )
+		{
+			std::memcpy( boxMins[d], boxes.mins[d], sizeof( float ) * boxCount );
+			std::memcpy( boxMaxs[d], boxes.maxs[d], sizeof( float ) * boxCount );
+		}
+	}
+
 	uint partitionCount = 0;
 	uint partitionBegin = 0;
 	for( uint partitionIndex = 0; partitionIndex < means.k; ++partitionIndex )
@@ -136,20 +878,301 @@ static bool PartitionBoxes( uint k, float* const* boxMins, float* const* boxMaxs
 		}
 	}
 
+	if( outStats )
+	{
+		outStats->iterations = std::min( iteration + 1, MAX_ITERATIONS ) + seedIterations;
+		outStats->partitionCount = partitionCount;
+	}
+
 	return iteration != MAX_ITERATIONS;
 }
 
+// Sorts lines by center with a stable three pass radix sort on the centers' bits, leaving the sorted line indices in
+// order. Equal centers keep their input order, so equal inputs always split the same way. The temp buffers are box
+// sized, and keys ends up holding the sorted keys.
+static void SortLinesByCenter( const float* mins, const float* maxs, uint boxCount, uint* keys, uint* order, uint* tempKeys, uint* tempOrder )
+{
+	static const uint RADIX_BITS[] = { 11, 11, 10 };
+	static const uint RADIX_SIZE = 1 << 11;
+	uint counts[3][RADIX_SIZE] = {};
+
+	// Flipping the sign bit of positive floats and every bit of negative ones orders their bits as unsigned ints
+	for( uint boxIndex = 0; boxIndex < boxCount; ++boxIndex )
+	{
+		const float center = 0.5f * ( mins[boxIndex] + maxs[boxIndex] );
+		uint bits;
+
+		std::memcpy( &bits, &center, sizeof( bits ) );
+		bits = ( bits & 0x80000000 ) ? ~bits : bits | 0x80000000;
+
+		tempKeys[boxIndex] = bits;
+		tempOrder[boxIndex] = boxIndex;
+		++counts[0][bits & 0x7FF];
+		++counts[1][( bits >> 11 ) & 0x7FF];
+		++counts[2][bits >> 22];
+	}
+
+	// Three passes starting from the temp buffers end in keys and order
+	uint* srcKeys = tempKeys;
+	uint* srcOrder = tempOrder;
+	uint* dstKeys = keys;
+	uint* dstOrder = order;
+	uint shift = 0;
+
+	for( uint pass = 0; pass < 3; ++pass )
+	{
+		uint* const passCounts = counts[pass];
+		const uint mask = ( 1 << RADIX_BITS[pass] ) - 1;
+
+		uint digitBegin = 0;
+		for( uint digit = 0; digit <= mask; ++digit )
+		{
+			const uint digitCount = passCounts[digit];
+
+			passCounts[digit] = digitBegin;
+			digitBegin += digitCount;
+		}
+
+		for( uint sortedIndex = 0; sortedIndex < boxCount; ++sortedIndex )
+		{
+			const uint dest = passCounts[( srcKeys[sortedIndex] >> shift ) & mask]++;
+
+			dstKeys[dest] = srcKeys[sortedIndex];
+			dstOrder[dest] = srcOrder[sortedIndex];
+		}
+
+		std::swap( srcKeys, dstKeys );
+		std::swap( srcOrder, dstOrder );
+		shift += RADIX_BITS[pass];
+	}
+}
+
+// One layer of the split table: the cheapest way to cut centers [0, end) into one more partition than the last layer
+// did, for every end in [endBegin, endLast]. A partition's cost is the squared distance from its centers to their
+// mean, summed, from prefix sums of the centers and their squares. The best split for an end never moves left as the
+// end moves right, so solving the middle end first bounds the search for the ends on either side of it. Every split
+// is also bounded by the capacity and by the ends the last layer could reach, both of which only move right as well.
+struct LineSplitLayer
+{
+	const double* sums;
+	const double* sumSqrs;
+	const double* invCounts; // 1 / n for each partition size n, so the search loop doesn't divide
+	const double* prevCosts;
+	double* costs;
+	uint* splits;
+	uint capacity;
+	uint prevEndBegin;
+	uint prevEndLast;
+
+	void Solve( uint endBegin, uint endLast, uint splitBegin, uint splitLast ) const
+	{
+		if( endBegin > endLast )
+			return;
+
+		const uint end = endBegin + ( ( endLast - endBegin ) >> 1 );
+		const uint firstSplit = std::max( { splitBegin, prevEndBegin, end > capacity ? end - capacity : 0 } );
+		const uint lastSplit = std::min( { splitLast, prevEndLast, end - 1 } );
+		const double endSum = sums[end];
+		const double endSumSqr = sumSqrs[end];
+		double bestCost = std::numeric_limits<double>::infinity();
+		uint bestSplit = std::min( firstSplit, lastSplit );
+
+		for( uint split = firstSplit; split <= lastSplit; ++split )
+		{
+			const double sum = endSum - sums[split];
+			const double cost = prevCosts[split] + ( endSumSqr - sumSqrs[split] ) - sum * sum * invCounts[end - split];
+
+			if( cost < bestCost )
+			{
+				bestCost = cost;
+				bestSplit = split;
+			}
+		}
+
+		costs[end] = bestCost;
+		splits[end] = bestSplit;
+
+		if( end > endBegin )
+			Solve( endBegin, end - 1, splitBegin, bestSplit );
+
+		Solve( end + 1, endLast, bestSplit, splitLast );
+	}
+};
+
+// Partitions lines exactly: sorted by center, the cheapest k way cut of the sorted order, minimizing the summed squared
+// distance from each center to its partition's mean, is found by dynamic programming over the cut positions as in
+// Fisher's optimal grouping. That's the k-means objective, solved outright instead of iterated toward. Balanced cuts
+// the same way with every partition held to the Balanced capacity.
+static bool ExactPartitionLines( uint k, float* const* boxMins, float* const* boxMaxs, uint boxCount, uint* inoutIndices, uint* outPartitions, void* workMem, PartitionMethod method, PartitionSeeds* inoutSeeds, PartitionStats* outStats )
+{
+	float* const mins = boxMins[0];
+	float* const maxs = boxMaxs[0];
+	const uint capacity = method == PartitionMethod::Balanced ? BalancedCapacity( k, boxCount ) : boxCount;
+
+	assert( boxCount >= k && k <= EXACT_LINES_MAX_K );
+
+	uint* const keys = AllocWorkMem<uint>( boxCount, &workMem );
+	uint* const order = AllocWorkMem<uint>( boxCount, &workMem );
+	double* const sums = AllocWorkMem<double>( boxCount + 1, &workMem );
+	double* const sumSqrs = AllocWorkMem<double>( boxCount + 1, &workMem );
+	double* const invCounts = AllocWorkMem<double>( boxCount + 1, &workMem );
+	double* costs = AllocWorkMem<double>( boxCount + 1, &workMem );
+	double* prevCosts = AllocWorkMem<double>( boxCount + 1, &workMem );
+	uint* const splits = AllocWorkMem<uint>( ( boxCount + 1 ) * k, &workMem );
+
+	// The costs aren't needed until the sort is done, so they hold its temp keys and order
+	SortLinesByCenter( mins, maxs, boxCount, keys, order, reinterpret_cast<uint*>( costs ), reinterpret_cast<uint*>( prevCosts ) );
+
+	const uint originIndex = order[boxCount >> 1];
+	const double origin = 0.5f * ( mins[originIndex] + maxs[originIndex] );
+
+	// Relative to a center near the middle, to keep the squares small
+	sums[0] = 0.0;
+	sumSqrs[0] = 0.0;
+	invCounts[0] = 0.0;
+	for( uint sortedIndex = 0; sortedIndex < boxCount; ++sortedIndex )
+	{
+		const uint boxIndex = order[sortedIndex];
+		const double center = 0.5f * ( mins[boxIndex] + maxs[boxIndex] ) - origin;
+
+		sums[sortedIndex + 1] = sums[sortedIndex] + center;
+		sumSqrs[sortedIndex + 1] = sumSqrs[sortedIndex] + center * center;
+		invCounts[sortedIndex + 1] = 1.0 / ( sortedIndex + 1 );
+	}
+
+	// Partition p ends somewhere in [p + 1, (p + 1) * capacity], leaving each later partition at least one box and at
+	// most capacity of them. The first partition always starts at 0.
+	uint prevEndBegin = 0;
+	uint prevEndLast = 0;
+	prevCosts[0] = 0.0;
+
+	for( uint partitionIndex = 0; partitionIndex < k; ++partitionIndex )
+	{
+		const uint partitionsLeft = k - partitionIndex - 1;
+		const uint endBegin = std::max( partitionIndex + 1, boxCount > partitionsLeft * capacity ? boxCount - partitionsLeft * capacity : 0 );
+		const uint endLast = std::min( boxCount - partitionsLeft, ( partitionIndex + 1 ) * capacity );
+		const LineSplitLayer layer{ sums, sumSqrs, invCounts, prevCosts, costs, splits + ( boxCount + 1 ) * partitionIndex, capacity, prevEndBegin, prevEndLast };
+
+		layer.Solve( endBegin, endLast, prevEndBegin, prevEndLast );
+
+		std::swap( costs, prevCosts );
+		prevEndBegin = endBegin;
+		prevEndLast = endLast;
+	}
+
+	uint partitionEnd = boxCount;
+	for( uint partitionIndex = k; partitionIndex-- > 0; )
+	{
+		outPartitions[partitionIndex] = partitionEnd;
+		partitionEnd = splits[( boxCount + 1 ) * partitionIndex + partitionEnd];
+	}
+
+	assert( partitionEnd == 0 );
+
+	// The keys aren't needed past the sort, so they hold each bound while it's gathered into sorted order
+	float* const sortedBounds = reinterpret_cast<float*>( keys );
+
+	for( uint sortedIndex = 0; sortedIndex < boxCount; ++sortedIndex )
+		sortedBounds[sortedIndex] = mins[order[sortedIndex]];
+	std::memcpy( mins, sortedBounds, sizeof( float ) * boxCount );
+
+	for( uint sortedIndex = 0; sortedIndex < boxCount; ++sortedIndex )
+		sortedBounds[sortedIndex] = maxs[order[sortedIndex]];
+	std::memcpy( maxs, sortedBounds, sizeof( float ) * boxCount );
+
+	std::memcpy( inoutIndices, order, sizeof( uint ) * boxCount );
+
+	if( inoutSeeds )
+	{
+		// Seeds don't help an exact partition, but the means go back all the same
+		uint partitionBegin = 0;
+		for( uint partitionIndex = 0; partitionIndex < k; ++partitionIndex )
+		{
+			const uint partitionEnd = outPartitions[partitionIndex];
+
+			inoutSeeds->means[0][partitionIndex] = static_cast<float>( origin + ( sums[partitionEnd] - sums[partitionBegin] ) / ( partitionEnd - partitionBegin ) );
+			partitionBegin = partitionEnd;
+		}
+
+		inoutSeeds->valid = true;
+	}
+
+	if( outStats )
+	{
+		outStats->iterations = 0;
+		outStats->partitionCount = k;
+	}
+
+	return true;
+}
+
+// Lines small enough in k for the split table are partitioned exactly, everything else runs k-means
+template <size_t D>
+static bool PartitionBoxesWithDriver( BoxPartitionDriver<D>& simdDriver, uint k, float* const* boxMins, float* const* boxMaxs, uint boxCount, uint* inoutIndices, uint* outPartitions, void* workMem, PartitionMethod method, PartitionSeeds* inoutSeeds, PartitionStats* outStats )
+{
+	if( D == 1 && k <= EXACT_LINES_MAX_K )
+		return ExactPartitionLines( k, boxMins, boxMaxs, boxCount, inoutIndices, outPartitions, workMem, method, inoutSeeds, outStats );
+
+	return KMeansPartitionBoxes<D>( simdDriver, k, boxMins, boxMaxs, boxCount, inoutIndices, outPartitions, workMem, method, inoutSeeds, outStats );
+}
+
+template <size_t D>
+static bool PartitionBoxesWithWorkMem( uint k, float* const* boxMins, float* const* boxMaxs, uint boxCount, uint* inoutIndices, uint* outPartitions, void* workMem, PartitionMethod method, PartitionSeeds* inoutSeeds, PartitionStats* outStats )
+{
+	return PartitionBoxesWithDriver<D>( GetPartitionDriver<D>(), k, boxMins, boxMaxs, boxCount, inoutIndices, outPartitions, workMem, method, inoutSeeds, outStats );
+}
+
+// Without work mem from the caller, each thread keeps a partitioner around for these
 template <size_t D>
-static bool PartitionBoxes( uint k, float* const* boxMins, float* const* boxMaxs, uint boxCount, uint* inoutIndices, uint* outPartitions )
+static bool PartitionBoxesWithoutWorkMem( uint k, float* const* boxMins, float* const* boxMaxs, uint boxCount, uint* inoutIndices, uint* outPartitions, PartitionMethod method, PartitionSeeds* inoutSeeds, PartitionStats* outStats )
 {
-	void* const workMem = _malloca( ComputeWorkMemSize<D>( boxCount ) );
-	const bool ret = PartitionBoxes<D>( k, boxMins, boxMaxs, boxCount, inoutIndices, outPartitions, workMem );
+	thread_local BoxPartitioner<D> partitioner;
 
-	_freea( workMem );
-	return ret;
+	return partitioner.Partition( k, boxMins, boxMaxs, boxCount, inoutIndices, outPartitions, method, inoutSeeds, outStats );
 }
 }
 
+template <unsigned D>
+BoxPartitioner<D>::BoxPartitioner()
+	: driver( GetPartitionDriver<D>() )
+	, workMem( nullptr )
+	, workMemBoxCount( 0 )
+{
+}
+
+template <unsigned D>
+BoxPartitioner<D>::~BoxPartitioner()
+{
+	_aligned_free( workMem );
+}
+
+template <unsigned D>
+void BoxPartitioner<D>::Reserve( unsigned boxCount )
+{
+	if( boxCount <= workMemBoxCount )
+		return;
+
+	// Grow geometrically, so a run of slightly larger builds doesn't reallocate every time
+	workMemBoxCount = std::max( boxCount, workMemBoxCount + ( workMemBoxCount >> 1 ) );
+
+	_aligned_free( workMem );
+	workMem = _aligned_malloc( ComputeWorkMemSize<D>( workMemBoxCount ), 64 );
+	assert( workMem );
+}
+
+template <unsigned D>
+bool BoxPartitioner<D>::Partition( unsigned k, float* const* boxMins, float* const* boxMaxs, unsigned boxCount, unsigned* inoutIndices, unsigned* outPartitions, PartitionMethod method, PartitionSeeds* inoutSeeds, PartitionStats* outStats )
+{
+	Reserve( boxCount );
+
+	return PartitionBoxesWithDriver<D>( driver, k, boxMins, boxMaxs, boxCount, inoutIndices, outPartitions, workMem, method, inoutSeeds, outStats );
+}
+
+template class BoxPartitioner<1>;
+template class BoxPartitioner<2>;
+template class BoxPartitioner<3>;
+template class BoxPartitioner<4>;
+
 size_t ComputePartitionLinesWorkMemSize( unsigned boxCount )
 {
 	return ComputeWorkMemSize<1>( boxCount );
@@ -165,31 +1188,46 @@ size_t ComputePartitionBoxes3DWorkMemSize( unsigned boxCount )
 	return ComputeWorkMemSize<3>( boxCount );
 }
 
-bool PartitionLines( unsigned k, float* const* boxMins, float* const* boxMaxs, unsigned boxCount, unsigned* inoutIndices, unsigned* outPartitions, void* workMem )
+size_t ComputePartitionBoxes4DWorkMemSize( unsigned boxCount )
+{
+	return ComputeWorkMemSize<4>( boxCount );
+}
+
+bool PartitionLines( unsigned k, float* const* boxMins, float* const* boxMaxs, unsigned boxCount, unsigned* inoutIndices, unsigned* outPartitions, void* workMem, PartitionMethod method, PartitionSeeds* inoutSeeds, PartitionStats* outStats )
 {
-	return PartitionBoxes<1>( k, boxMins, boxMaxs, boxCount, inoutIndices, outPartitions, workMem );
+	return PartitionBoxesWithWorkMem<1>( k, boxMins, boxMaxs, boxCount, inoutIndices, outPartitions, workMem, method, inoutSeeds, outStats );
 }
-bool PartitionBoxes2D( unsigned k, float* const* boxMins, float* const* boxMaxs, unsigned boxCount, unsigned* inoutIndices, unsigned* outPartitions, void* workMem )
+bool PartitionBoxes2D( unsigned k, float* const* boxMins, float* const* boxMaxs, unsigned boxCount, unsigned* inoutIndices, unsigned* outPartitions, void* workMem, PartitionMethod method, PartitionSeeds* inoutSeeds, PartitionStats* outStats )
+{
+	return PartitionBoxesWithWorkMem<2>( k, boxMins, boxMaxs, boxCount, inoutIndices, outPartitions, workMem, method, inoutSeeds, outStats );
+}
+
+bool PartitionBoxes3D( unsigned k, float* const* boxMins, float* const* boxMaxs, unsigned boxCount, unsigned* inoutIndices, unsigned* outPartitions, void* workMem, PartitionMethod method, PartitionSeeds* inoutSeeds, PartitionStats* outStats )
+{
+	return PartitionBoxesWithWorkMem<3>( k, boxMins, boxMaxs, boxCount, inoutIndices, outPartitions, workMem, method, inoutSeeds, outStats );
+}
+
+bool PartitionBoxes4D( unsigned k, float* const* boxMins, float* const* boxMaxs, unsigned boxCount, unsigned* inoutIndices, unsigned* outPartitions, void* workMem, PartitionMethod method, PartitionSeeds* inoutSeeds, PartitionStats* outStats )
 {
-	return PartitionBoxes<2>( k, boxMins, boxMaxs, boxCount, inoutIndices, outPartitions, workMem );
+	return PartitionBoxesWithWorkMem<4>( k, boxMins, boxMaxs, boxCount, inoutIndices, outPartitions, workMem, method, inoutSeeds, outStats );
 }
 
-bool PartitionBoxes3D( unsigned k, float* const* boxMins, float* const* boxMaxs, unsigned boxCount, unsigned* inoutIndices, unsigned* outPartitions, void* workMem )
+bool PartitionLines( unsigned k, float* const* boxMins, float* const* boxMaxs, unsigned boxCount, unsigned* inoutIndices, unsigned* outPartitions, PartitionMethod method, PartitionSeeds* inoutSeeds, PartitionStats* outStats )
 {
-	return PartitionBoxes<3>( k, boxMins, boxMaxs, boxCount, inoutIndices, outPartitions, workMem );
+	return PartitionBoxesWithoutWorkMem<1>( k, boxMins, boxMaxs, boxCount, inoutIndices, outPartitions, method, inoutSeeds, outStats );
 }
 
-bool PartitionLines( unsigned k, float* const* boxMins, float* const* boxMaxs, unsigned boxCount, unsigned* inoutIndices, unsigned* outPartitions )
+bool PartitionBoxes2D( unsigned k, float* const* boxMins, float* const* boxMaxs, unsigned boxCount, unsigned* inoutIndices, unsigned* outPartitions, PartitionMethod method, PartitionSeeds* inoutSeeds, PartitionStats* outStats )
 {
-	return PartitionBoxes<1>( k, boxMins, boxMaxs, boxCount, inoutIndices, outPartitions );
+	return PartitionBoxesWithoutWorkMem<2>( k, boxMins, boxMaxs, boxCount, inoutIndices, outPartitions, method, inoutSeeds, outStats );
 }
 
-bool PartitionBoxes2D( unsigned k, float* const* boxMins, float* const* boxMaxs, unsigned boxCount, unsigned* inoutIndices, unsigned* outPartitions )
+bool PartitionBoxes3D( unsigned k, float* const* boxMins, float* const* boxMaxs, unsigned boxCount, unsigned* inoutIndices, unsigned* outPartitions, PartitionMethod method, PartitionSeeds* inoutSeeds, PartitionStats* outStats )
 {
-	return PartitionBoxes<2>( k, boxMins, boxMaxs, boxCount, inoutIndices, outPartitions );
+	return PartitionBoxesWithoutWorkMem<3>( k, boxMins, boxMaxs, boxCount, inoutIndices, outPartitions, method, inoutSeeds, outStats );
 }
 
-bool PartitionBoxes3D( unsigned k, float* const* boxMins, float* const* boxMaxs, unsigned boxCount, unsigned* inoutIndices, unsigned* outPartitions )
+bool PartitionBoxes4D( unsigned k, float* const* boxMins, float* const* boxMaxs, unsigned boxCount, unsigned* inoutIndices, unsigned* outPartitions, PartitionMethod method, PartitionSeeds* inoutSeeds, PartitionStats* outStats )
 {
-	return PartitionBoxes<3>( k, boxMins, boxMaxs, boxCount, inoutIndices, outPartitions );
+	return PartitionBoxesWithoutWorkMem<4>( k, boxMins, boxMaxs, boxCount, inoutIndices, outPartitions, method, inoutSeeds, outStats );
 }
@@ -1,27 +1,63 @@
 #pragma once
 
+// How the k-means loop finds each box's nearest mean. Exhaustive and Bounded give the same partitions.
+// Bounded keeps lower bounds on each box's distance to its own mean and to the rest, moved along by how far the means
+// drift each iteration as in Hamerly's k-means, and skips the distances that can't beat the current one. It pays off
+// as k grows, for two extra floats of work mem per box.
+// Balanced runs as Exhaustive, then caps every partition at 1.5 * boxCount / k boxes, rounded up. Boxes leave a full
+// partition for their next nearest mean with room, cheapest moves first, and the means are recomputed after. Clustered
+// boxes no longer pile into one partition, so a tree built from them has a predictable depth.
+// PartitionLines skips k-means for k up to 16: it sorts the lines by center and cuts the sorted order where the
+// summed squared distance to the means is smallest, which is exact. Exhaustive and Bounded cut the same way, and
+// Balanced cuts with the same cap on each partition.
+enum class PartitionMethod
+{
+	Exhaustive,
+	Bounded,
+	Balanced
+};
+
+// Means to start the k-means from instead of seeding farthest first, written back with the final means. Handing the
+// result of one call to the next partition of nearly the same boxes, say the same tree node next frame, skips the
+// seeding pass and starts the iterations close to where they end.
+struct PartitionSeeds
+{
+	float * const *means; // D arrays of k floats
+	bool valid;           // Set when means is a converged result. Cleared when a partition came up empty or the means never settled.
+};
+
+// How a partition went, for tuning and benchmarks
+struct PartitionStats
+{
+	unsigned iterations;     // k-means iterations run, including the last one that found nothing to move. 0 when exact.
+	unsigned partitionCount; // Non-empty partitions
+};
+
 size_t ComputePartitionLinesWorkMemSize(unsigned boxCount);
 size_t ComputePartitionBoxes2DWorkMemSize(unsigned boxCount);
 size_t ComputePartitionBoxes3DWorkMemSize(unsigned boxCount);
+size_t ComputePartitionBoxes4DWorkMemSize(unsigned boxCount);
 
 template<unsigned D>
 size_t ComputePartitionBoxesWorkMemSize(unsigned boxCount)
 {
 	typedef size_t(*WorkMemFunc)(unsigned boxCount);
-	static const WorkMemFunc WorkMemSize[] = { &ComputePartitionLinesWorkMemSize, &ComputePartitionBoxes2DWorkMemSize, &ComputePartitionBoxes3DWorkMemSize };
+	static const WorkMemFunc WorkMemSize[] = { &ComputePartitionLinesWorkMemSize, &ComputePartitionBoxes2DWorkMemSize, &ComputePartitionBoxes3DWorkMemSize, &ComputePartitionBoxes4DWorkMemSize };
 
-	static_assert(D >= 1 && D <= sizeof(WorkMemSize) / sizeof(WorkMemSize[0]) + 1, "No compute work mem implementation for given dimensions");
+	static_assert(D >= 1 && D <= sizeof(WorkMemSize) / sizeof(WorkMemSize[0]), "No compute work mem implementation for given dimensions");
 
 	return WorkMemSize[D-1]( boxCount);
 }
 
-bool PartitionLines(unsigned k, float * const *boxMins, float * const *boxMaxs, unsigned boxCount, unsigned *outIndices, unsigned *outPartitions, void *workMem);
-bool PartitionBoxes2D(unsigned k, float * const *boxMins, float * const *boxMaxs, unsigned boxCount, unsigned *outIndices, unsigned *outPartitions, void *workMem);
-bool PartitionBoxes3D(unsigned k, float * const *boxMins, float * const *boxMaxs, unsigned boxCount, unsigned *outIndices, unsigned *outPartitions, void *workMem);
+bool PartitionLines(unsigned k, float * const *boxMins, float * const *boxMaxs, unsigned boxCount, unsigned *outIndices, unsigned *outPartitions, void *workMem, PartitionMethod method = PartitionMethod::Exhaustive, PartitionSeeds *inoutSeeds = nullptr, PartitionStats *outStats = nullptr);
+bool PartitionBoxes2D(unsigned k, float * const *boxMins, float * const *boxMaxs, unsigned boxCount, unsigned *outIndices, unsigned *outPartitions, void *workMem, PartitionMethod method = PartitionMethod::Exhaustive, PartitionSeeds *inoutSeeds = nullptr, PartitionStats *outStats = nullptr);
+bool PartitionBoxes3D(unsigned k, float * const *boxMins, float * const *boxMaxs, unsigned boxCount, unsigned *outIndices, unsigned *outPartitions, void *workMem, PartitionMethod method = PartitionMethod::Exhaustive, PartitionSeeds *inoutSeeds = nullptr, PartitionStats *outStats = nullptr);
+bool PartitionBoxes4D(unsigned k, float * const *boxMins, float * const *boxMaxs, unsigned boxCount, unsigned *outIndices, unsigned *outPartitions, void *workMem, PartitionMethod method = PartitionMethod::Exhaustive, PartitionSeeds *inoutSeeds = nullptr, PartitionStats *outStats = nullptr);
 
-bool PartitionLines(unsigned k, float * const *boxMins, float * const *boxMaxs, unsigned boxCount, unsigned *outIndices, unsigned *outPartitions);
-bool PartitionBoxes2D(unsigned k, float * const *boxMins, float * const *boxMaxs, unsigned boxCount, unsigned *outIndices, unsigned *outPartitions);
-bool PartitionBoxes3D(unsigned k, float * const *boxMins, float * const *boxMaxs, unsigned boxCount, unsigned *outIndices, unsigned *outPartitions);
+bool PartitionLines(unsigned k, float * const *boxMins, float * const *boxMaxs, unsigned boxCount, unsigned *outIndices, unsigned *outPartitions, PartitionMethod method = PartitionMethod::Exhaustive, PartitionSeeds *inoutSeeds = nullptr, PartitionStats *outStats = nullptr);
+bool PartitionBoxes2D(unsigned k, float * const *boxMins, float * const *boxMaxs, unsigned boxCount, unsigned *outIndices, unsigned *outPartitions, PartitionMethod method = PartitionMethod::Exhaustive, PartitionSeeds *inoutSeeds = nullptr, PartitionStats *outStats = nullptr);
+bool PartitionBoxes3D(unsigned k, float * const *boxMins, float * const *boxMaxs, unsigned boxCount, unsigned *outIndices, unsigned *outPartitions, PartitionMethod method = PartitionMethod::Exhaustive, PartitionSeeds *inoutSeeds = nullptr, PartitionStats *outStats = nullptr);
+bool PartitionBoxes4D(unsigned k, float * const *boxMins, float * const *boxMaxs, unsigned boxCount, unsigned *outIndices, unsigned *outPartitions, PartitionMethod method = PartitionMethod::Exhaustive, PartitionSeeds *inoutSeeds = nullptr, PartitionStats *outStats = nullptr);
 
 
 template<unsigned K>
@@ -42,6 +78,12 @@ bool PartitionBoxes3D(float * const * boxMins, float * const * boxMaxs, unsigned
 	return PartitionBoxes3D(K, boxMins, boxMaxs, boxCount, outIndices, reinterpret_cast<unsigned *>(outPartitions), workMem);
 }
 
+template<unsigned K>
+bool PartitionBoxes4D(float * const * boxMins, float * const * boxMaxs, unsigned boxCount, unsigned *outIndices, unsigned(&outPartitions)[K], void *workMem)
+{
+	return PartitionBoxes4D(K, boxMins, boxMaxs, boxCount, outIndices, reinterpret_cast<unsigned *>(outPartitions), workMem);
+}
+
 template<unsigned K>
 bool PartitionLines(float * const * boxMins, float * const * boxMaxs, unsigned boxCount, unsigned *outIndices, unsigned(&outPartitions)[K])
 {
@@ -60,66 +102,62 @@ bool PartitionBoxes3D(float * const * boxMins, float * const * boxMaxs, unsigned
 	return PartitionBoxes3D(K, boxMins, boxMaxs, boxCount, outIndices, reinterpret_cast<unsigned *>(outPartitions));
 }
 
+template<unsigned K>
+bool PartitionBoxes4D(float * const * boxMins, float * const * boxMaxs, unsigned boxCount, unsigned *outIndices, unsigned(&outPartitions)[K])
+{
+	return PartitionBoxes4D(K, boxMins, boxMaxs, boxCount, outIndices, reinterpret_cast<unsigned *>(outPartitions));
+}
+
 template<unsigned D>
-bool PartitionBoxes(unsigned k, float * const *boxMins, float * const *boxMaxs, unsigned boxCount, unsigned *outIndices, unsigned *outPartitions, void *workMem)
+bool PartitionBoxes(unsigned k, float * const *boxMins, float * const *boxMaxs, unsigned boxCount, unsigned *outIndices, unsigned *outPartitions, void *workMem, PartitionMethod method = PartitionMethod::Exhaustive, PartitionSeeds *inoutSeeds = nullptr, PartitionStats *outStats = nullptr)
 {
-	typedef bool(*PartFunc)(unsigned k, float * const *boxMins, float * const *boxMaxs, unsigned boxCount, unsigned *outIndices, unsigned *outPartitions, void *workMem);
-	static const PartFunc Partitioners[] = { &PartitionLines, &PartitionBoxes2D, &PartitionBoxes3D };
+	typedef bool(*PartFunc)(unsigned k, float * const *boxMins, float * const *boxMaxs, unsigned boxCount, unsigned *outIndices, unsigned *outPartitions, void *workMem, PartitionMethod method, PartitionSeeds *inoutSeeds, PartitionStats *outStats);
+	static const PartFunc Partitioners[] = { &PartitionLines, &PartitionBoxes2D, &PartitionBoxes3D, &PartitionBoxes4D };
 
-	static_assert(D >= 1 && D <= sizeof(Partitioners) / sizeof(Partitioners[0]) + 1, "No partition implementation for given dimensions");
+	static_assert(D >= 1 && D <= sizeof(Partitioners) / sizeof(Partitioners[0]), "No partition implementation for given dimensions");
 
-	return Partitioners[D-1](k, boxMins, boxMaxs, boxCount, outIndices, outPartitions, workMem);
+	return Partitioners[D-1](k, boxMins, boxMaxs, boxCount, outIndices, outPartitions, workMem, method, inoutSeeds, outStats);
 }
 
 template<unsigned D>
-bool PartitionBoxes(unsigned k, float *(&boxMins)[D], float *(&boxMaxs)[D], unsigned boxCount, unsigned *outIndices, unsigned *outPartitions, void *workMem)
+bool PartitionBoxes(unsigned k, float *(&boxMins)[D], float *(&boxMaxs)[D], unsigned boxCount, unsigned *outIndices, unsigned *outPartitions, void *workMem, PartitionMethod method = PartitionMethod::Exhaustive, PartitionSeeds *inoutSeeds = nullptr, PartitionStats *outStats = nullptr)
 {
-	return PartitionBoxes<D>(k, &boxMins[0], &boxMaxs[0], boxCount, outIndices, outPartitions, workMem);
+	return PartitionBoxes<D>(k, &boxMins[0], &boxMaxs[0], boxCount, outIndices, outPartitions, workMem, method, inoutSeeds, outStats);
 }
 
 template<unsigned D>
-bool PartitionBoxes(unsigned k, float * const *boxMins, float * const *boxMaxs, unsigned boxCount, unsigned *outIndices, unsigned *outPartitions)
+bool PartitionBoxes(unsigned k, float * const *boxMins, float * const *boxMaxs, unsigned boxCount, unsigned *outIndices, unsigned *outPartitions, PartitionMethod method = PartitionMethod::Exhaustive, PartitionSeeds *inoutSeeds = nullptr, PartitionStats *outStats = nullptr)
 {
-	typedef bool(*PartFunc)(unsigned k, float * const *boxMins, float * const *boxMaxs, unsigned boxCount, unsigned *outIndices, unsigned *outPartitions);
-	static const PartFunc Partitioners[] = { &PartitionLines, &PartitionBoxes2D, &PartitionBoxes3D };
+	typedef bool(*PartFunc)(unsigned k, float * const *boxMins, float * const *boxMaxs, unsigned boxCount, unsigned *outIndices, unsigned *outPartitions, PartitionMethod method, PartitionSeeds *inoutSeeds, PartitionStats *outStats);
+	static const PartFunc Partitioners[] = { &PartitionLines, &PartitionBoxes2D, &PartitionBoxes3D, &PartitionBoxes4D };
 
-	static_assert(D >= 1 && D <= sizeof(Partitioners) / sizeof(Partitioners[0]) + 1, "No partition implementation for given dimensions");
+	static_assert(D >= 1 && D <= sizeof(Partitioners) / sizeof(Partitioners[0]), "No partition implementation for given dimensions");
 
-	return Partitioners[D-1](k, boxMins, boxMaxs, boxCount, outIndices, outPartitions);
+	return Partitioners[D-1](k, boxMins, boxMaxs, boxCount, outIndices, outPartitions, method, inoutSeeds, outStats);
 }
 
 template<unsigned D>
-bool PartitionBoxes(unsigned k, float *(&boxMins)[D], float *(&boxMaxs)[D], unsigned boxCount, unsigned *outIndices, unsigned *outPartitions)
+bool PartitionBoxes(unsigned k, float *(&boxMins)[D], float *(&boxMaxs)[D], unsigned boxCount, unsigned *outIndices, unsigned *outPartitions, PartitionMethod method = PartitionMethod::Exhaustive, PartitionSeeds *inoutSeeds = nullptr, PartitionStats *outStats = nullptr)
 {
-	return PartitionBoxes<D>(k, &boxMins[0], &boxMaxs[0], boxCount, outIndices, outPartitions);
+	return PartitionBoxes<D>(k, &boxMins[0], &boxMaxs[0], boxCount, outIndices, outPartitions, method, inoutSeeds, outStats);
 }
 
 template<unsigned D, unsigned K>
 bool PartitionBoxes(float * const *boxMins, float * const *boxMaxs, unsigned boxCount, unsigned *outIndices, unsigned *outPartitions, void *workMem)
 {
-	typedef bool(*PartFunc)(float * const *boxMins, float * const *boxMaxs, unsigned boxCount, unsigned *outIndices, unsigned *outPartitions, void *workMem);
-	static const PartFunc Partitioners[] = { &PartitionLines<K>, &PartitionBoxes2D<K>, &PartitionBoxes3D<K> };
-
-	static_assert(D >= 1 && D <= sizeof(Partitioners) / sizeof(Partitioners[0]) + 1, "No partition implementation for given dimensions");
-
-	return Partitioners[D-1](K, boxMins, boxMaxs, boxCount, outIndices, outPartitions, workMem);
+	return PartitionBoxes<D>(K, boxMins, boxMaxs, boxCount, outIndices, outPartitions, workMem);
 }
 
 template<unsigned D, unsigned K>
 bool PartitionBoxes(float *(&boxMins)[D], float *(&boxMaxs)[D], unsigned boxCount, unsigned *outIndices, unsigned (&outPartitions)[K], void *workMem)
 {
-	return PartitionBoxes<D>(&boxMins[0], &boxMaxs[0], boxCount, outIndices, outPartitions, workMem);
+	return PartitionBoxes<D,K>(&boxMins[0], &boxMaxs[0], boxCount, outIndices, &outPartitions[0], workMem);
 }
 
 template<unsigned D, unsigned K>
 bool PartitionBoxes(float * const *boxMins, float * const *boxMaxs, unsigned boxCount, unsigned *outIndices, unsigned *outPartitions)
 {
-	typedef bool(*PartFunc)(unsigned k, float * const *boxMins, float * const *boxMaxs, unsigned boxCount, unsigned *outIndices, unsigned *outPartitions);
-	static const PartFunc Partitioners[] = { &PartitionLines, &PartitionBoxes2D, &PartitionBoxes3D };
-
-	static_assert(D >= 1 && D <= sizeof(Partitioners) / sizeof(Partitioners[0]) + 1, "No partition implementation for given dimensions");
-
-	return Partitioners[D-1](K, boxMins, boxMaxs, boxCount, outIndices, outPartitions);
+	return PartitionBoxes<D>(K, boxMins, boxMaxs, boxCount, outIndices, outPartitions);
 }
 
 template<unsigned D, unsigned K>
@@ -127,3 +165,35 @@ bool PartitionBoxes(float *(&boxMins)[D], float *(&boxMaxs)[D], unsigned boxCoun
 {
 	return PartitionBoxes<D,K>(&boxMins[0], &boxMaxs[0], boxCount, outIndices, &outPartitions[0]);
 }
+
+template<size_t D>
+struct BoxPartitionDriver;
+
+// Partitions boxes with work mem kept between calls, grown to the largest box count seen so far, and the SIMD driver
+// picked for this CPU. Reusing one for every node of a build saves an allocation, or the overloads' stack probe, per
+// call. Not thread safe, so give each building thread its own.
+template<unsigned D>
+class BoxPartitioner
+{
+public:
+	BoxPartitioner();
+	~BoxPartitioner();
+
+	BoxPartitioner(const BoxPartitioner &) = delete;
+	BoxPartitioner &operator=(const BoxPartitioner &) = delete;
+
+	// Grows the work mem to fit boxCount boxes, so the calls that follow don't have to
+	void Reserve(unsigned boxCount);
+
+	bool Partition(unsigned k, float * const *boxMins, float * const *boxMaxs, unsigned boxCount, unsigned *inoutIndices, unsigned *outPartitions, PartitionMethod method = PartitionMethod::Exhaustive, PartitionSeeds *inoutSeeds = nullptr, PartitionStats *outStats = nullptr);
+
+	bool Partition(unsigned k, float *(&boxMins)[D], float *(&boxMaxs)[D], unsigned boxCount, unsigned *inoutIndices, unsigned *outPartitions, PartitionMethod method = PartitionMethod::Exhaustive, PartitionSeeds *inoutSeeds = nullptr, PartitionStats *outStats = nullptr)
+	{
+		return Partition(k, &boxMins[0], &boxMaxs[0], boxCount, inoutIndices, outPartitions, method, inoutSeeds, outStats);
+	}
+
+private:
+	BoxPartitionDriver<D> &driver;
+	void *workMem;
+	unsigned workMemBoxCount;
+};
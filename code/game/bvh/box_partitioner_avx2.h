@@ -0,0 +1,464 @@
+#pragma once
+
+#include "box_partitioner_internal.h"
+#include "../Assert.h"
+#include <immintrin.h>
+#include <algorithm>
+#include <numeric>
+#include <limits>
+#include <cstring>
+#include <cfloat>
+
+// Same algorithm as BoxPartitionDriver_SSE2, 8 boxes at a time. Needs AVX2 and FMA, so only
+// call through it after checking CPUID.
+template <size_t D>
+struct BoxPartitionDriver_AVX2 : BoxPartitionDriver<D>
+{
+private:
+	// Computes the distance from the mean to the nearest point on the box.
+	// Result is negative if mean is inside the box. See BoxPartitionDriver_SSE2.
+	static inline __m256 BoxToSingleMeanDistance( const Boxes<D>& boxes, uint avxBoxIndex, const Means<D>& means, uint meanIndex )
+	{
+		__m256 mean[D];
+
+		for( size_t d = 0; d < D; ++d )
+			mean[d] = _mm256_set1_ps( means.means[d][meanIndex] );
+
+		return BoxToMeanDistance( boxes, avxBoxIndex, mean );
+	}
+
+	// Loads the 8 values of a block of boxes. The last block can be short, so it is masked rather than read past the end
+	// of the caller's arrays, its missing lanes left 0.
+	static __forceinline __m256 LoadBoxLanes( const float* values, uint avxBoxIndex, uint boxCount )
+	{
+		const uint firstBox = avxBoxIndex << 3;
+
+		if( boxCount - firstBox >= 8 )
+			return _mm256_loadu_ps( values + firstBox );
+
+		const __m256i tailMask = _mm256_cmpgt_epi32( _mm256_set1_epi32( static_cast<int>( boxCount - firstBox ) ), _mm256_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7 ) );
+
+		return _mm256_maskload_ps( values + firstBox, tailMask );
+	}
+
+	// As BoxToSingleMeanDistance, with a mean per lane
+	static inline __m256 BoxToMeanDistance( const Boxes<D>& boxes, uint avxBoxIndex, const __m256 ( &mean )[D] )
+	{
+		const __m256 zero = _mm256_setzero_ps();
+		__m256 distSqr = _mm256_setzero_ps();
+		__m256 minSideDist = _mm256_set1_ps( std::numeric_limits<float>::lowest() );
+		__m256 insideBox = _mm256_castsi256_ps( _mm256_set1_epi32( 0xFFFFFFFF ) );
+
+		for( size_t d = 0; d < D; ++d )
+		{
+			const __m256 boxMin = LoadBoxLanes( boxes.mins[d], avxBoxIndex, boxes.count );
+			const __m256 boxMax = LoadBoxLanes( boxes.maxs[d], avxBoxIndex, boxes.count );
+			const __m256 minToMeanDist = _mm256_sub_ps( boxMin, mean[d] );
+			const __m256 meanToMaxDist = _mm256_sub_ps( mean[d], boxMax );
+			const __m256 minDistToSide = _mm256_max_ps( minToMeanDist, meanToMaxDist ); // We use max, because these values are negative
+			const __m256 minDistToBox = _mm256_max_ps( minDistToSide, zero );
+			const __m256 insideOnAxis = _mm256_cmp_ps( minDistToBox, zero, _CMP_EQ_OQ );
+
+			insideBox = _mm256_and_ps( insideOnAxis, insideBox );
+			minSideDist = _mm256_max_ps( minSideDist, minDistToSide );
+			distSqr = _mm256_fmadd_ps( minDistToBox, minDistToBox, distSqr );
+		}
+
+		return _mm256_blendv_ps( _mm256_sqrt_ps( distSqr ), minSideDist, insideBox );
+	}
+
+	// A computed distance nudged down by a few ulps, so rounding can't leave a bound above the true distance
+	static __forceinline __m256 DistanceLowerBound( __m256 distance )
+	{
+		return _mm256_fnmadd_ps( _mm256_andnot_ps( _mm256_set1_ps( -0.0f ), distance ), _mm256_set1_ps( 4.0f * FLT_EPSILON ), distance );
+	}
+
+	static inline float FltPartitionGather( const float* values, unsigned partitionBegin, unsigned partitionEnd, unsigned avxPartitionBegin, unsigned avxPartitionEnd )
+	{
+		float gather = 0.0f;
+
+		for( uint boxIndex = partitionBegin; boxIndex < avxPartitionBegin; ++boxIndex )
+			gather += values[boxIndex];
+
+		for( uint boxIndex = avxPartitionEnd; boxIndex < partitionEnd; ++boxIndex )
+			gather += values[boxIndex];
+
+		return gather;
+	}
+
+	static __forceinline float HAdd( __m256 v )
+	{
+		__m128 sums = _mm_add_ps( _mm256_castps256_ps128( v ), _mm256_extractf128_ps( v, 1 ) );
+		__m128 shuf = _mm_movehdup_ps( sums ); // [ D D | B B ]
+		sums = _mm_add_ps( sums, shuf );       // [ D+D D+C | B+B A+B ]
+		shuf = _mm_movehl_ps( shuf, sums );    // [ D D | D+D D+C ]
+		sums = _mm_add_ss( sums, shuf );
+
+		return _mm_cvtss_f32( sums );
+	}
+
+	// Sums values over [partitionBegin, partitionEnd), eight at a time over the aligned middle
+	static inline float PartitionSum( const float* values, uint partitionBegin, uint partitionEnd )
+	{
+		if( partitionEnd - partitionBegin <= 7 )
+		{
+			float sum = 0.0f;
+
+			for( uint boxIndex = partitionBegin; boxIndex < partitionEnd; ++boxIndex )
+				sum += values[boxIndex];
+
+			return sum;
+		}
+
+		const uint avxPartitionBegin = ( partitionBegin + 7 ) & ~7;
+		const uint avxPartitionEnd = partitionEnd & ~7;
+		const __m256* const avxValues = reinterpret_cast<const __m256*>( values );
+		const float gather = FltPartitionGather( values, partitionBegin, partitionEnd, avxPartitionBegin, avxPartitionEnd );
+		__m256 sum = _mm256_setzero_ps();
+
+		for( uint avxBoxIndex = avxPartitionBegin >> 3; avxBoxIndex < avxPartitionEnd >> 3; ++avxBoxIndex )
+			sum = _mm256_add_ps( sum, avxValues[avxBoxIndex] );
+
+		return gather + HAdd( sum );
+	}
+
+	__forceinline uint AVXBoxCount( uint boxCount )
+	{
+		return AlignBoxCount( boxCount ) >> 3;
+	}
+
+	// Updates the nearest mean of every box in one block of 8, masking out lanes past the end. Returns a mask of changed lanes.
+	static __forceinline __m256i UpdateNearestMeanBlock( const Boxes<D>& boxes, const Means<D>& means, uint avxBoxIndex, __m256i laneMask, __m256* inoutDistance, __m256i* inoutNearest )
+	{
+		__m256 curDistance = *inoutDistance;
+		__m256i curNearest = *inoutNearest;
+		__m256i changed = _mm256_setzero_si256();
+
+		for( uint meanIndex = 0; meanIndex < means.k; ++meanIndex )
+		{
+			const __m256i avxMeanIndex = _mm256_set1_epi32( static_cast<int>( meanIndex ) );
+			const __m256 meanDistance = BoxToSingleMeanDistance( boxes, avxBoxIndex, means, meanIndex );
+			const __m256i lessThanDist = _mm256_and_si256( laneMask, _mm256_castps_si256( _mm256_cmp_ps( meanDistance, curDistance, _CMP_LT_OQ ) ) );
+
+			curDistance = _mm256_min_ps( meanDistance, curDistance );
+			curNearest = _mm256_blendv_epi8( curNearest, avxMeanIndex, lessThanDist );
+			changed = _mm256_or_si256( changed, lessThanDist );
+		}
+
+		*inoutDistance = curDistance;
+		*inoutNearest = curNearest;
+
+		return changed;
+	}
+
+	// UpdateNearestMeanBlock, which also leaves exact bounds behind for the bounded update. See BoxPartitionDriver_SSE2.
+	static inline __m256i UpdateNearestMeanBlockBounded( const Boxes<D>& boxes, const Means<D>& means, uint avxBoxIndex, __m256i laneMask, BoxMeans* inoutBoxMeans )
+	{
+		__m256* const avxMeanDists = reinterpret_cast<__m256*>( inoutBoxMeans->meanDists );
+		__m256i* const avxNearestMeans = reinterpret_cast<__m256i*>( inoutBoxMeans->nearestMeans );
+		const __m256i oldNearest = avxNearestMeans[avxBoxIndex];
+		__m256 curDistance = avxMeanDists[avxBoxIndex];
+		__m256i curNearest = oldNearest;
+		__m256 oldNearestDistance = _mm256_setzero_ps();
+		__m256 minDistance = _mm256_set1_ps( std::numeric_limits<float>::max() );
+		__m256 secondMinDistance = minDistance;
+		__m256i minMean = _mm256_setzero_si256();
+		__m256i changed = _mm256_setzero_si256();
+
+		for( uint meanIndex = 0; meanIndex < means.k; ++meanIndex )
+		{
+			const __m256i avxMeanIndex = _mm256_set1_epi32( static_cast<int>( meanIndex ) );
+			const __m256 meanDistance = BoxToSingleMeanDistance( boxes, avxBoxIndex, means, meanIndex );
+			const __m256i lessThanDist = _mm256_and_si256( laneMask, _mm256_castps_si256( _mm256_cmp_ps( meanDistance, curDistance, _CMP_LT_OQ ) ) );
+			const __m256 lessThanMin = _mm256_cmp_ps( meanDistance, minDistance, _CMP_LT_OQ );
+
+			curDistance = _mm256_min_ps( meanDistance, curDistance );
+			curNearest = _mm256_blendv_epi8( curNearest, avxMeanIndex, lessThanDist );
+			changed = _mm256_or_si256( changed, lessThanDist );
+
+			oldNearestDistance = _mm256_blendv_ps( oldNearestDistance, meanDistance, _mm256_castsi256_ps( _mm256_cmpeq_epi32( oldNearest, avxMeanIndex ) ) );
+			secondMinDistance = _mm256_blendv_ps( _mm256_min_ps( meanDistance, secondMinDistance ), minDistance, lessThanMin );
+			minDistance = _mm256_min_ps( meanDistance, minDistance );
+			minMean = _mm256_blendv_epi8( minMean, avxMeanIndex, _mm256_castps_si256( lessThanMin ) );
+		}
+
+		reinterpret_cast<__m256*>( inoutBoxMeans->assignedBounds )[avxBoxIndex] = DistanceLowerBound( _mm256_blendv_ps( minDistance, oldNearestDistance, _mm256_castsi256_ps( _mm256_cmpeq_epi32( curNearest, oldNearest ) ) ) );
+		reinterpret_cast<__m256*>( inoutBoxMeans->otherBounds )[avxBoxIndex] = DistanceLowerBound( _mm256_blendv_ps( minDistance, secondMinDistance, _mm256_castsi256_ps( _mm256_cmpeq_epi32( curNearest, minMean ) ) ) );
+		avxMeanDists[avxBoxIndex] = curDistance;
+		avxNearestMeans[avxBoxIndex] = curNearest;
+
+		return changed;
+	}
+
+public:
+	virtual void MakeIndexList( unsigned* start, unsigned count, unsigned valStart ) final
+	{
+		if( count > 8 )
+		{
+			const unsigned avxCount = AVXBoxCount( count ) - 1;
+			const __m256i inc = _mm256_set1_epi32( 8 );
+			__m256i cur = _mm256_add_epi32( _mm256_set1_epi32( static_cast<int>( valStart ) ), _mm256_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7 ) );
+
+			for( size_t avxIndex = 0; avxIndex < avxCount; ++avxIndex )
+			{
+				_mm256_storeu_si256( reinterpret_cast<__m256i*>( start ) + avxIndex, cur );
+				cur = _mm256_add_epi32( cur, inc );
+			}
+
+			const unsigned completed = avxCount << 3;
+			start += completed;
+			count -= completed;
+			valStart += completed;
+		}
+
+		std::iota( start, start + count, valStart );
+	}
+
+	virtual void InitializeBoxes( Boxes<D>* inoutBoxes ) final
+	{
+		const uint avxBoxCount = AVXBoxCount( inoutBoxes->count );
+		__m256* const outMasses = reinterpret_cast<__m256*>( inoutBoxes->masses );
+		const __m256 half = _mm256_set1_ps( 0.5f );
+		const __m256 epsilon = _mm256_set1_ps( FLT_EPSILON );
+
+		for( uint avxBoxIndex = 0; avxBoxIndex < avxBoxCount; ++avxBoxIndex )
+		{
+			__m256 mass = _mm256_setzero_ps();
+
+			for( size_t x = 0; x < D - 1; ++x )
+			{
+				const __m256 xMin = LoadBoxLanes( inoutBoxes->mins[x], avxBoxIndex, inoutBoxes->count );
+				const __m256 xMax = LoadBoxLanes( inoutBoxes->maxs[x], avxBoxIndex, inoutBoxes->count );
+				const __m256 xExtent = _mm256_sub_ps( xMax, xMin );
+
+				for( size_t y = x + 1; y < D; ++y )
+				{
+					const __m256 yMin = LoadBoxLanes( inoutBoxes->mins[y], avxBoxIndex, inoutBoxes->count );
+					const __m256 yMax = LoadBoxLanes( inoutBoxes->maxs[y], avxBoxIndex, inoutBoxes->count );
+					const __m256 yExtent = _mm256_sub_ps( yMax, yMin );
+
+					mass = _mm256_fmadd_ps( xExtent, yExtent, mass );
+				}
+			}
+
+			outMasses[avxBoxIndex] = _mm256_max_ps( mass, epsilon );
+		}
+
+		for( size_t d = 0; d < D; ++d )
+		{
+			const float* const mins = inoutBoxes->mins[d];
+			const float* const maxs = inoutBoxes->maxs[d];
+			__m256* const outWeightedCenters = reinterpret_cast<__m256*>( inoutBoxes->weightedCenters[d] );
+
+			for( uint avxBoxIndex = 0; avxBoxIndex < avxBoxCount; ++avxBoxIndex )
+			{
+				const __m256 min = LoadBoxLanes( mins, avxBoxIndex, inoutBoxes->count );
+				const __m256 max = LoadBoxLanes( maxs, avxBoxIndex, inoutBoxes->count );
+				const __m256 perim = _mm256_add_ps( max, min );
+				const __m256 halfMass = _mm256_mul_ps( outMasses[avxBoxIndex], half );
+
+				outWeightedCenters[avxBoxIndex] = _mm256_mul_ps( perim, halfMass );
+			}
+		}
+	}
+
+	virtual void InitializeMeans( const Boxes<D>& boxes, Means<D>* outMeans, BoxMeans* outBoxMeans, uint* indices ) final
+	{
+		const uint meanCount = outMeans->k;
+		const uint avxBoxCount = AVXBoxCount( boxes.count );
+		__m256* const outAVXMeanDists = reinterpret_cast<__m256*>( outBoxMeans->meanDists );
+		__m256i* const outAVXNearestMeans = reinterpret_cast<__m256i*>( outBoxMeans->nearestMeans );
+		auto InitializeMean = [outMeans, &boxes]( uint boxIndex, uint meanIndex )
+		{
+			for( size_t d = 0; d < D; ++d )
+				outMeans->means[d][meanIndex] = boxes.weightedCenters[d][boxIndex] / boxes.masses[boxIndex];
+		};
+
+		InitializeMean( 0, 0 );
+
+		MakeIndexList( indices, boxes.count - 1, 1 );
+
+		std::memset( outBoxMeans->nearestMeans, 0, sizeof( uint ) * boxes.count );
+		for( uint avxBoxIndex = 0; avxBoxIndex < avxBoxCount; ++avxBoxIndex )
+			outAVXMeanDists[avxBoxIndex] = BoxToSingleMeanDistance( boxes, avxBoxIndex, *outMeans, 0 );
+
+		for( uint meanIndex = 1; meanIndex < meanCount; ++meanIndex )
+		{
+			const __m256i avxMeanIndex = _mm256_set1_epi32( static_cast<int>( meanIndex ) );
+			uint* const farthestNearestIndexPtr = std::max_element( indices, indices + boxes.count - meanIndex, [outBoxMeans]( uint a, uint b )
+			{
+				return outBoxMeans->meanDists[a] < outBoxMeans->meanDists[b];
+			} );
+			const uint farthestNearestIndex = *farthestNearestIndexPtr;
+
+			InitializeMean( farthestNearestIndex, meanIndex );
+			*farthestNearestIndexPtr = indices[boxes.count - meanIndex - 1]; // Erase currently found index with the back
+
+			for( uint avxBoxIndex = 0; avxBoxIndex < avxBoxCount; ++avxBoxIndex )
+			{
+				const __m256 distance = BoxToSingleMeanDistance( boxes, avxBoxIndex, *outMeans, meanIndex );
+				const __m256 oldDistance = outAVXMeanDists[avxBoxIndex];
+				const __m256i lessEqual = _mm256_castps_si256( _mm256_cmp_ps( distance, oldDistance, _CMP_LE_OQ ) );
+
+				// Less equal to encourage movement to new means, as the SSE2 driver
+				outAVXMeanDists[avxBoxIndex] = _mm256_min_ps( distance, oldDistance );
+				outAVXNearestMeans[avxBoxIndex] = _mm256_blendv_epi8( outAVXNearestMeans[avxBoxIndex], avxMeanIndex, lessEqual );
+			}
+		}
+	}
+
+	virtual bool UpdateNearestMeans( const Boxes<D>& boxes, const Means<D>& means, BoxMeans* inoutBoxMeans ) final
+	{
+		const uint avxBoxCount = boxes.count >> 3;
+		const uint handledBoxCount = avxBoxCount << 3;
+		__m256* const inoutAVXMeanDists = reinterpret_cast<__m256*>( inoutBoxMeans->meanDists );
+		__m256i* const inoutAVXNearestMeans = reinterpret_cast<__m256i*>( inoutBoxMeans->nearestMeans );
+		const __m256i allLanes = _mm256_set1_epi32( 0xFFFFFFFF );
+		__m256i changed = _mm256_setzero_si256();
+
+		for( uint avxBoxIndex = 0; avxBoxIndex < avxBoxCount; ++avxBoxIndex )
+			changed = _mm256_or_si256( changed, UpdateNearestMeanBlock( boxes, means, avxBoxIndex, allLanes, &inoutAVXMeanDists[avxBoxIndex], &inoutAVXNearestMeans[avxBoxIndex] ) );
+
+		if( handledBoxCount < boxes.count ) // tail
+		{
+			const __m256i tailMask = _mm256_cmpgt_epi32( _mm256_set1_epi32( static_cast<int>( boxes.count - handledBoxCount ) ), _mm256_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7 ) );
+
+			changed = _mm256_or_si256( changed, UpdateNearestMeanBlock( boxes, means, avxBoxCount, tailMask, &inoutAVXMeanDists[avxBoxCount], &inoutAVXNearestMeans[avxBoxCount] ) );
+		}
+
+		return _mm256_testz_si256( changed, changed ) != 0;
+	}
+
+	virtual float UpdateSeedDistances( const Boxes<D>& boxes, const Means<D>& candidates, uint firstCandidate, BoxMeans* inoutBoxMeans ) final
+	{
+		const uint avxBoxCount = AVXBoxCount( boxes.count );
+		const __m256* const avxMasses = reinterpret_cast<const __m256*>( boxes.masses );
+		__m256* const inoutAVXMeanDists = reinterpret_cast<__m256*>( inoutBoxMeans->meanDists );
+		__m256i* const inoutAVXNearestMeans = reinterpret_cast<__m256i*>( inoutBoxMeans->nearestMeans );
+		const __m256 zero = _mm256_setzero_ps();
+		__m256 cost = zero;
+
+		for( uint avxBoxIndex = 0; avxBoxIndex < avxBoxCount; ++avxBoxIndex )
+		{
+			const __m256i laneMask = _mm256_cmpgt_epi32( _mm256_set1_epi32( static_cast<int>( boxes.count - ( avxBoxIndex << 3 ) ) ), _mm256_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7 ) );
+			__m256 curDistance = inoutAVXMeanDists[avxBoxIndex];
+			__m256i curNearest = inoutAVXNearestMeans[avxBoxIndex];
+
+			for( uint candidateIndex = firstCandidate; candidateIndex < candidates.k; ++candidateIndex )
+			{
+				const __m256i avxCandidateIndex = _mm256_set1_epi32( static_cast<int>( candidateIndex ) );
+				const __m256 candidateDistance = BoxToSingleMeanDistance( boxes, avxBoxIndex, candidates, candidateIndex );
+				const __m256i lessThanDist = _mm256_and_si256( laneMask, _mm256_castps_si256( _mm256_cmp_ps( candidateDistance, curDistance, _CMP_LT_OQ ) ) );
+
+				curDistance = _mm256_min_ps( candidateDistance, curDistance );
+				curNearest = _mm256_blendv_epi8( curNearest, avxCandidateIndex, lessThanDist );
+			}
+
+			const __m256 outsideDistance = _mm256_max_ps( curDistance, zero );
+			const __m256 boxCost = _mm256_mul_ps( avxMasses[avxBoxIndex], _mm256_mul_ps( outsideDistance, outsideDistance ) );
+
+			inoutAVXMeanDists[avxBoxIndex] = curDistance;
+			inoutAVXNearestMeans[avxBoxIndex] = curNearest;
+			cost = _mm256_add_ps( cost, _mm256_and_ps( _mm256_castsi256_ps( laneMask ), boxCost ) );
+		}
+
+		return HAdd( cost );
+	}
+
+	// Same result as UpdateNearestMeans, skipping the distances the bounds show can't beat a box's current distance
+	virtual bool UpdateNearestMeansBounded( const Boxes<D>& boxes, const Means<D>& means, const MeanDrifts& drifts, BoxMeans* inoutBoxMeans ) final
+	{
+		const uint avxBoxCount = AVXBoxCount( boxes.count );
+		__m256* const inoutAVXMeanDists = reinterpret_cast<__m256*>( inoutBoxMeans->meanDists );
+		const __m256i* const avxNearestMeans = reinterpret_cast<const __m256i*>( inoutBoxMeans->nearestMeans );
+		__m256* const inoutAVXAssignedBounds = reinterpret_cast<__m256*>( inoutBoxMeans->assignedBounds );
+		__m256* const inoutAVXOtherBounds = reinterpret_cast<__m256*>( inoutBoxMeans->otherBounds );
+		const __m256i maxDriftMean = _mm256_set1_epi32( static_cast<int>( drifts.maxDriftMean ) );
+		const __m256 maxDrift = _mm256_set1_ps( drifts.maxDrift );
+		const __m256 secondMaxDrift = _mm256_set1_ps( drifts.secondMaxDrift );
+		__m256i changed = _mm256_setzero_si256();
+
+		for( uint avxBoxIndex = 0; avxBoxIndex < avxBoxCount; ++avxBoxIndex )
+		{
+			const __m256i laneMask = _mm256_cmpgt_epi32( _mm256_set1_epi32( static_cast<int>( boxes.count - ( avxBoxIndex << 3 ) ) ), _mm256_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7 ) );
+			const __m256i nearest = avxNearestMeans[avxBoxIndex];
+			const __m256 assignedDrift = _mm256_mask_i32gather_ps( _mm256_setzero_ps(), drifts.drifts, nearest, _mm256_castsi256_ps( laneMask ), 4 );
+			const __m256 otherDrift = _mm256_blendv_ps( maxDrift, secondMaxDrift, _mm256_castsi256_ps( _mm256_cmpeq_epi32( nearest, maxDriftMean ) ) );
+			const __m256 curDistance = inoutAVXMeanDists[avxBoxIndex];
+			const __m256 assignedBound = _mm256_sub_ps( inoutAVXAssignedBounds[avxBoxIndex], assignedDrift );
+			const __m256 otherBound = _mm256_sub_ps( inoutAVXOtherBounds[avxBoxIndex], otherDrift );
+			const __m256i needAll = _mm256_and_si256( laneMask, _mm256_castps_si256( _mm256_cmp_ps( otherBound, curDistance, _CMP_LT_OQ ) ) );
+			const __m256i needAssigned = _mm256_and_si256( laneMask, _mm256_castps_si256( _mm256_cmp_ps( assignedBound, curDistance, _CMP_LT_OQ ) ) );
+
+			if( !_mm256_testz_si256( needAll, needAll ) )
+			{
+				changed = _mm256_or_si256( changed, UpdateNearestMeanBlockBounded( boxes, means, avxBoxIndex, laneMask, inoutBoxMeans ) );
+			}
+			else if( !_mm256_testz_si256( needAssigned, needAssigned ) )
+			{
+				// Only the assigned mean could have come closer. Nearest stays put either way.
+				__m256 mean[D];
+
+				for( size_t d = 0; d < D; ++d )
+					mean[d] = _mm256_mask_i32gather_ps( _mm256_setzero_ps(), means.means[d], nearest, _mm256_castsi256_ps( needAssigned ), 4 );
+
+				const __m256 meanDistance = BoxToMeanDistance( boxes, avxBoxIndex, mean );
+				const __m256i lessThanDist = _mm256_and_si256( needAssigned, _mm256_castps_si256( _mm256_cmp_ps( meanDistance, curDistance, _CMP_LT_OQ ) ) );
+
+				inoutAVXMeanDists[avxBoxIndex] = _mm256_blendv_ps( curDistance, _mm256_min_ps( meanDistance, curDistance ), _mm256_castsi256_ps( needAssigned ) );
+				inoutAVXAssignedBounds[avxBoxIndex] = _mm256_blendv_ps( assignedBound, DistanceLowerBound( meanDistance ), _mm256_castsi256_ps( needAssigned ) );
+				inoutAVXOtherBounds[avxBoxIndex] = otherBound;
+				changed = _mm256_or_si256( changed, lessThanDist );
+			}
+			else
+			{
+				inoutAVXAssignedBounds[avxBoxIndex] = assignedBound;
+				inoutAVXOtherBounds[avxBoxIndex] = otherBound;
+			}
+		}
+
+		return _mm256_testz_si256( changed, changed ) != 0;
+	}
+
+	virtual void ComputeMeans( const Boxes<D>& boxes, const uint* partitions, Means<D>* outMeans ) final
+	{
+		const uint meanCount = outMeans->k;
+
+		uint partitionBegin = 0;
+
+		for( uint meanIndex = 0; meanIndex < meanCount; ++meanIndex )
+		{
+			const uint partitionEnd = partitions[meanIndex];
+			const float partitionMass = 1.0f / PartitionSum( boxes.masses, partitionBegin, partitionEnd );
+
+			for( size_t d = 0; d < D; ++d )
+				outMeans->means[d][meanIndex] = PartitionSum( boxes.weightedCenters[d], partitionBegin, partitionEnd ) * partitionMass;
+
+			partitionBegin = partitionEnd;
+		}
+	}
+
+	virtual void SumPartitions( const Boxes<D>& boxes, const uint* partitions, Means<D>* outWeightedSums, float* outMasses ) final
+	{
+		const uint meanCount = outWeightedSums->k;
+
+		uint partitionBegin = 0;
+
+		for( uint meanIndex = 0; meanIndex < meanCount; ++meanIndex )
+		{
+			const uint partitionEnd = partitions[meanIndex];
+
+			outMasses[meanIndex] = PartitionSum( boxes.masses, partitionBegin, partitionEnd );
+
+			for( size_t d = 0; d < D; ++d )
+				outWeightedSums->means[d][meanIndex] = PartitionSum( boxes.weightedCenters[d], partitionBegin, partitionEnd );
+
+			partitionBegin = partitionEnd;
+		}
+	}
+
+	virtual uint AlignBoxCount( uint boxCount ) final
+	{
+		return ( boxCount + 7 ) & ~7;
+	}
+};
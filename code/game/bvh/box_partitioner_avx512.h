@@ -0,0 +1,453 @@
+#pragma once
+
+#include "box_partitioner_internal.h"
+#include "../Assert.h"
+#include <immintrin.h>
+#include <algorithm>
+#include <numeric>
+#include <limits>
+#include <cstring>
+#include <cfloat>
+
+// Same algorithm as BoxPartitionDriver_SSE2, 16 boxes at a time. Only needs AVX-512F, but still only call through it
+// after checking CPUID and the OS's XSAVE state.
+template <size_t D>
+struct BoxPartitionDriver_AVX512 : BoxPartitionDriver<D>
+{
+private:
+	// Computes the distance from the mean to the nearest point on the box.
+	// Result is negative if mean is inside the box. See BoxPartitionDriver_SSE2.
+	static inline __m512 BoxToSingleMeanDistance( const Boxes<D>& boxes, uint zmmBoxIndex, const Means<D>& means, uint meanIndex )
+	{
+		__m512 mean[D];
+
+		for( size_t d = 0; d < D; ++d )
+			mean[d] = _mm512_set1_ps( means.means[d][meanIndex] );
+
+		return BoxToMeanDistance( boxes, zmmBoxIndex, mean );
+	}
+
+	// Loads the 16 values of a block of boxes. The last block can be short, so it is masked rather than read past the end
+	// of the caller's arrays, its missing lanes left 0.
+	static __forceinline __m512 LoadBoxLanes( const float* values, uint zmmBoxIndex, uint boxCount )
+	{
+		const uint firstBox = zmmBoxIndex << 4;
+
+		if( boxCount - firstBox >= 16 )
+			return _mm512_loadu_ps( values + firstBox );
+
+		return _mm512_maskz_loadu_ps( static_cast<__mmask16>( ( 1u << ( boxCount - firstBox ) ) - 1 ), values + firstBox );
+	}
+
+	// As BoxToSingleMeanDistance, with a mean per lane
+	static inline __m512 BoxToMeanDistance( const Boxes<D>& boxes, uint zmmBoxIndex, const __m512 ( &mean )[D] )
+	{
+		const __m512 zero = _mm512_setzero_ps();
+		__m512 distSqr = _mm512_setzero_ps();
+		__m512 minSideDist = _mm512_set1_ps( std::numeric_limits<float>::lowest() );
+		__mmask16 insideBox = 0xFFFF;
+
+		for( size_t d = 0; d < D; ++d )
+		{
+			const __m512 boxMin = LoadBoxLanes( boxes.mins[d], zmmBoxIndex, boxes.count );
+			const __m512 boxMax = LoadBoxLanes( boxes.maxs[d], zmmBoxIndex, boxes.count );
+			const __m512 minToMeanDist = _mm512_sub_ps( boxMin, mean[d] );
+			const __m512 meanToMaxDist = _mm512_sub_ps( mean[d], boxMax );
+			const __m512 minDistToSide = _mm512_max_ps( minToMeanDist, meanToMaxDist ); // We use max, because these values are negative
+			const __m512 minDistToBox = _mm512_max_ps( minDistToSide, zero );
+
+			insideBox &= _mm512_cmp_ps_mask( minDistToBox, zero, _CMP_EQ_OQ );
+			minSideDist = _mm512_max_ps( minSideDist, minDistToSide );
+			distSqr = _mm512_fmadd_ps( minDistToBox, minDistToBox, distSqr );
+		}
+
+		return _mm512_mask_blend_ps( insideBox, _mm512_sqrt_ps( distSqr ), minSideDist );
+	}
+
+	// A computed distance nudged down by a few ulps, so rounding can't leave a bound above the true distance
+	static __forceinline __m512 DistanceLowerBound( __m512 distance )
+	{
+		return _mm512_fnmadd_ps( _mm512_abs_ps( distance ), _mm512_set1_ps( 4.0f * FLT_EPSILON ), distance );
+	}
+
+	static inline float FltPartitionGather( const float* values, unsigned partitionBegin, unsigned partitionEnd, unsigned zmmPartitionBegin, unsigned zmmPartitionEnd )
+	{
+		float gather = 0.0f;
+
+		for( uint boxIndex = partitionBegin; boxIndex < zmmPartitionBegin; ++boxIndex )
+			gather += values[boxIndex];
+
+		for( uint boxIndex = zmmPartitionEnd; boxIndex < partitionEnd; ++boxIndex )
+			gather += values[boxIndex];
+
+		return gather;
+	}
+
+	static __forceinline float HAdd( __m512 v )
+	{
+		const __m256 lo = _mm512_castps512_ps256( v );
+		const __m256 hi = _mm256_castpd_ps( _mm512_extractf64x4_pd( _mm512_castps_pd( v ), 1 ) );
+		const __m256 halves = _mm256_add_ps( lo, hi );
+		__m128 sums = _mm_add_ps( _mm256_castps256_ps128( halves ), _mm256_extractf128_ps( halves, 1 ) );
+		__m128 shuf = _mm_movehdup_ps( sums );
+		sums = _mm_add_ps( sums, shuf );
+		shuf = _mm_movehl_ps( shuf, sums );
+		sums = _mm_add_ss( sums, shuf );
+
+		return _mm_cvtss_f32( sums );
+	}
+
+	// Sums values over [partitionBegin, partitionEnd), sixteen at a time over the aligned middle
+	static inline float PartitionSum( const float* values, uint partitionBegin, uint partitionEnd )
+	{
+		if( partitionEnd - partitionBegin <= 15 )
+		{
+			float sum = 0.0f;
+
+			for( uint boxIndex = partitionBegin; boxIndex < partitionEnd; ++boxIndex )
+				sum += values[boxIndex];
+
+			return sum;
+		}
+
+		const uint zmmPartitionBegin = ( partitionBegin + 15 ) & ~15;
+		const uint zmmPartitionEnd = partitionEnd & ~15;
+		const __m512* const zmmValues = reinterpret_cast<const __m512*>( values );
+		const float gather = FltPartitionGather( values, partitionBegin, partitionEnd, zmmPartitionBegin, zmmPartitionEnd );
+		__m512 sum = _mm512_setzero_ps();
+
+		for( uint zmmBoxIndex = zmmPartitionBegin >> 4; zmmBoxIndex < zmmPartitionEnd >> 4; ++zmmBoxIndex )
+			sum = _mm512_add_ps( sum, zmmValues[zmmBoxIndex] );
+
+		return gather + HAdd( sum );
+	}
+
+	__forceinline uint ZMMBoxCount( uint boxCount )
+	{
+		return AlignBoxCount( boxCount ) >> 4;
+	}
+
+	// Updates the nearest mean of every box in one block of 16 lanes in laneMask. Returns the lanes that changed.
+	static __forceinline __mmask16 UpdateNearestMeanBlock( const Boxes<D>& boxes, const Means<D>& means, uint zmmBoxIndex, __mmask16 laneMask, __m512* inoutDistance, __m512i* inoutNearest )
+	{
+		__m512 curDistance = *inoutDistance;
+		__m512i curNearest = *inoutNearest;
+		__mmask16 changed = 0;
+
+		for( uint meanIndex = 0; meanIndex < means.k; ++meanIndex )
+		{
+			const __m512 meanDistance = BoxToSingleMeanDistance( boxes, zmmBoxIndex, means, meanIndex );
+			const __mmask16 lessThanDist = _mm512_mask_cmp_ps_mask( laneMask, meanDistance, curDistance, _CMP_LT_OQ );
+
+			curDistance = _mm512_min_ps( meanDistance, curDistance );
+			curNearest = _mm512_mask_blend_epi32( lessThanDist, curNearest, _mm512_set1_epi32( static_cast<int>( meanIndex ) ) );
+			changed |= lessThanDist;
+		}
+
+		*inoutDistance = curDistance;
+		*inoutNearest = curNearest;
+
+		return changed;
+	}
+
+	// UpdateNearestMeanBlock, which also leaves exact bounds behind for the bounded update. See BoxPartitionDriver_SSE2.
+	static inline __mmask16 UpdateNearestMeanBlockBounded( const Boxes<D>& boxes, const Means<D>& means, uint zmmBoxIndex, __mmask16 laneMask, BoxMeans* inoutBoxMeans )
+	{
+		__m512* const zmmMeanDists = reinterpret_cast<__m512*>( inoutBoxMeans->meanDists );
+		__m512i* const zmmNearestMeans = reinterpret_cast<__m512i*>( inoutBoxMeans->nearestMeans );
+		const __m512i oldNearest = zmmNearestMeans[zmmBoxIndex];
+		__m512 curDistance = zmmMeanDists[zmmBoxIndex];
+		__m512i curNearest = oldNearest;
+		__m512 oldNearestDistance = _mm512_setzero_ps();
+		__m512 minDistance = _mm512_set1_ps( std::numeric_limits<float>::max() );
+		__m512 secondMinDistance = minDistance;
+		__m512i minMean = _mm512_setzero_si512();
+		__mmask16 changed = 0;
+
+		for( uint meanIndex = 0; meanIndex < means.k; ++meanIndex )
+		{
+			const __m512i zmmMeanIndex = _mm512_set1_epi32( static_cast<int>( meanIndex ) );
+			const __m512 meanDistance = BoxToSingleMeanDistance( boxes, zmmBoxIndex, means, meanIndex );
+			const __mmask16 lessThanDist = _mm512_mask_cmp_ps_mask( laneMask, meanDistance, curDistance, _CMP_LT_OQ );
+			const __mmask16 lessThanMin = _mm512_cmp_ps_mask( meanDistance, minDistance, _CMP_LT_OQ );
+
+			curDistance = _mm512_min_ps( meanDistance, curDistance );
+			curNearest = _mm512_mask_blend_epi32( lessThanDist, curNearest, zmmMeanIndex );
+			changed |= lessThanDist;
+
+			oldNearestDistance = _mm512_mask_blend_ps( _mm512_cmpeq_epi32_mask( oldNearest, zmmMeanIndex ), oldNearestDistance, meanDistance );
+			secondMinDistance = _mm512_mask_blend_ps( lessThanMin, _mm512_min_ps( meanDistance, secondMinDistance ), minDistance );
+			minDistance = _mm512_min_ps( meanDistance, minDistance );
+			minMean = _mm512_mask_blend_epi32( lessThanMin, minMean, zmmMeanIndex );
+		}
+
+		reinterpret_cast<__m512*>( inoutBoxMeans->assignedBounds )[zmmBoxIndex] = DistanceLowerBound( _mm512_mask_blend_ps( _mm512_cmpeq_epi32_mask( curNearest, oldNearest ), minDistance, oldNearestDistance ) );
+		reinterpret_cast<__m512*>( inoutBoxMeans->otherBounds )[zmmBoxIndex] = DistanceLowerBound( _mm512_mask_blend_ps( _mm512_cmpeq_epi32_mask( curNearest, minMean ), minDistance, secondMinDistance ) );
+		zmmMeanDists[zmmBoxIndex] = curDistance;
+		zmmNearestMeans[zmmBoxIndex] = curNearest;
+
+		return changed;
+	}
+
+public:
+	virtual void MakeIndexList( unsigned* start, unsigned count, unsigned valStart ) final
+	{
+		const __m512i inc = _mm512_set1_epi32( 16 );
+		__m512i cur = _mm512_add_epi32( _mm512_set1_epi32( static_cast<int>( valStart ) ), _mm512_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 ) );
+
+		for( ; count >= 16; count -= 16, start += 16 )
+		{
+			_mm512_storeu_si512( start, cur );
+			cur = _mm512_add_epi32( cur, inc );
+		}
+
+		_mm512_mask_storeu_epi32( start, static_cast<__mmask16>( ( 1u << count ) - 1 ), cur );
+	}
+
+	virtual void InitializeBoxes( Boxes<D>* inoutBoxes ) final
+	{
+		const uint zmmBoxCount = ZMMBoxCount( inoutBoxes->count );
+		__m512* const outMasses = reinterpret_cast<__m512*>( inoutBoxes->masses );
+		const __m512 half = _mm512_set1_ps( 0.5f );
+		const __m512 epsilon = _mm512_set1_ps( FLT_EPSILON );
+
+		for( uint zmmBoxIndex = 0; zmmBoxIndex < zmmBoxCount; ++zmmBoxIndex )
+		{
+			__m512 mass = _mm512_setzero_ps();
+
+			for( size_t x = 0; x < D - 1; ++x )
+			{
+				const __m512 xMin = LoadBoxLanes( inoutBoxes->mins[x], zmmBoxIndex, inoutBoxes->count );
+				const __m512 xMax = LoadBoxLanes( inoutBoxes->maxs[x], zmmBoxIndex, inoutBoxes->count );
+				const __m512 xExtent = _mm512_sub_ps( xMax, xMin );
+
+				for( size_t y = x + 1; y < D; ++y )
+				{
+					const __m512 yMin = LoadBoxLanes( inoutBoxes->mins[y], zmmBoxIndex, inoutBoxes->count );
+					const __m512 yMax = LoadBoxLanes( inoutBoxes->maxs[y], zmmBoxIndex, inoutBoxes->count );
+					const __m512 yExtent = _mm512_sub_ps( yMax, yMin );
+
+					mass = _mm512_fmadd_ps( xExtent, yExtent, mass );
+				}
+			}
+
+			outMasses[zmmBoxIndex] = _mm512_max_ps( mass, epsilon );
+		}
+
+		for( size_t d = 0; d < D; ++d )
+		{
+			const float* const mins = inoutBoxes->mins[d];
+			const float* const maxs = inoutBoxes->maxs[d];
+			__m512* const outWeightedCenters = reinterpret_cast<__m512*>( inoutBoxes->weightedCenters[d] );
+
+			for( uint zmmBoxIndex = 0; zmmBoxIndex < zmmBoxCount; ++zmmBoxIndex )
+			{
+				const __m512 min = LoadBoxLanes( mins, zmmBoxIndex, inoutBoxes->count );
+				const __m512 max = LoadBoxLanes( maxs, zmmBoxIndex, inoutBoxes->count );
+				const __m512 perim = _mm512_add_ps( max, min );
+				const __m512 halfMass = _mm512_mul_ps( outMasses[zmmBoxIndex], half );
+
+				outWeightedCenters[zmmBoxIndex] = _mm512_mul_ps( perim, halfMass );
+			}
+		}
+	}
+
+	virtual void InitializeMeans( const Boxes<D>& boxes, Means<D>* outMeans, BoxMeans* outBoxMeans, uint* indices ) final
+	{
+		const uint meanCount = outMeans->k;
+		const uint zmmBoxCount = ZMMBoxCount( boxes.count );
+		__m512* const outZMMMeanDists = reinterpret_cast<__m512*>( outBoxMeans->meanDists );
+		__m512i* const outZMMNearestMeans = reinterpret_cast<__m512i*>( outBoxMeans->nearestMeans );
+		auto InitializeMean = [outMeans, &boxes]( uint boxIndex, uint meanIndex )
+		{
+			for( size_t d = 0; d < D; ++d )
+				outMeans->means[d][meanIndex] = boxes.weightedCenters[d][boxIndex] / boxes.masses[boxIndex];
+		};
+
+		InitializeMean( 0, 0 );
+
+		MakeIndexList( indices, boxes.count - 1, 1 );
+
+		std::memset( outBoxMeans->nearestMeans, 0, sizeof( uint ) * boxes.count );
+		for( uint zmmBoxIndex = 0; zmmBoxIndex < zmmBoxCount; ++zmmBoxIndex )
+			outZMMMeanDists[zmmBoxIndex] = BoxToSingleMeanDistance( boxes, zmmBoxIndex, *outMeans, 0 );
+
+		for( uint meanIndex = 1; meanIndex < meanCount; ++meanIndex )
+		{
+			const __m512i zmmMeanIndex = _mm512_set1_epi32( static_cast<int>( meanIndex ) );
+			uint* const farthestNearestIndexPtr = std::max_element( indices, indices + boxes.count - meanIndex, [outBoxMeans]( uint a, uint b )
+			{
+				return outBoxMeans->meanDists[a] < outBoxMeans->meanDists[b];
+			} );
+			const uint farthestNearestIndex = *farthestNearestIndexPtr;
+
+			InitializeMean( farthestNearestIndex, meanIndex );
+			*farthestNearestIndexPtr = indices[boxes.count - meanIndex - 1]; // Erase currently found index with the back
+
+			for( uint zmmBoxIndex = 0; zmmBoxIndex < zmmBoxCount; ++zmmBoxIndex )
+			{
+				const __m512 distance = BoxToSingleMeanDistance( boxes, zmmBoxIndex, *outMeans, meanIndex );
+				const __m512 oldDistance = outZMMMeanDists[zmmBoxIndex];
+				const __mmask16 lessEqual = _mm512_cmp_ps_mask( distance, oldDistance, _CMP_LE_OQ );
+
+				// Less equal to encourage movement to new means, as the SSE2 driver
+				outZMMMeanDists[zmmBoxIndex] = _mm512_min_ps( distance, oldDistance );
+				outZMMNearestMeans[zmmBoxIndex] = _mm512_mask_blend_epi32( lessEqual, outZMMNearestMeans[zmmBoxIndex], zmmMeanIndex );
+			}
+		}
+	}
+
+	virtual bool UpdateNearestMeans( const Boxes<D>& boxes, const Means<D>& means, BoxMeans* inoutBoxMeans ) final
+	{
+		const uint zmmBoxCount = boxes.count >> 4;
+		const uint handledBoxCount = zmmBoxCount << 4;
+		__m512* const inoutZMMMeanDists = reinterpret_cast<__m512*>( inoutBoxMeans->meanDists );
+		__m512i* const inoutZMMNearestMeans = reinterpret_cast<__m512i*>( inoutBoxMeans->nearestMeans );
+		__mmask16 changed = 0;
+
+		for( uint zmmBoxIndex = 0; zmmBoxIndex < zmmBoxCount; ++zmmBoxIndex )
+			changed |= UpdateNearestMeanBlock( boxes, means, zmmBoxIndex, 0xFFFF, &inoutZMMMeanDists[zmmBoxIndex], &inoutZMMNearestMeans[zmmBoxIndex] );
+
+		if( handledBoxCount < boxes.count ) // tail
+		{
+			const __mmask16 tailMask = static_cast<__mmask16>( ( 1u << ( boxes.count - handledBoxCount ) ) - 1 );
+
+			changed |= UpdateNearestMeanBlock( boxes, means, zmmBoxCount, tailMask, &inoutZMMMeanDists[zmmBoxCount], &inoutZMMNearestMeans[zmmBoxCount] );
+		}
+
+		return changed == 0;
+	}
+
+	virtual float UpdateSeedDistances( const Boxes<D>& boxes, const Means<D>& candidates, uint firstCandidate, BoxMeans* inoutBoxMeans ) final
+	{
+		const uint zmmBoxCount = ZMMBoxCount( boxes.count );
+		const __m512* const zmmMasses = reinterpret_cast<const __m512*>( boxes.masses );
+		__m512* const inoutZMMMeanDists = reinterpret_cast<__m512*>( inoutBoxMeans->meanDists );
+		__m512i* const inoutZMMNearestMeans = reinterpret_cast<__m512i*>( inoutBoxMeans->nearestMeans );
+		const __m512 zero = _mm512_setzero_ps();
+		__m512 cost = zero;
+
+		for( uint zmmBoxIndex = 0; zmmBoxIndex < zmmBoxCount; ++zmmBoxIndex )
+		{
+			const uint laneCount = std::min( boxes.count - ( zmmBoxIndex << 4 ), 16u );
+			const __mmask16 laneMask = static_cast<__mmask16>( ( 1u << laneCount ) - 1 );
+			__m512 curDistance = inoutZMMMeanDists[zmmBoxIndex];
+			__m512i curNearest = inoutZMMNearestMeans[zmmBoxIndex];
+
+			for( uint candidateIndex = firstCandidate; candidateIndex < candidates.k; ++candidateIndex )
+			{
+				const __m512 candidateDistance = BoxToSingleMeanDistance( boxes, zmmBoxIndex, candidates, candidateIndex );
+				const __mmask16 lessThanDist = _mm512_mask_cmp_ps_mask( laneMask, candidateDistance, curDistance, _CMP_LT_OQ );
+
+				curDistance = _mm512_min_ps( candidateDistance, curDistance );
+				curNearest = _mm512_mask_blend_epi32( lessThanDist, curNearest, _mm512_set1_epi32( static_cast<int>( candidateIndex ) ) );
+			}
+
+			const __m512 outsideDistance = _mm512_max_ps( curDistance, zero );
+			const __m512 boxCost = _mm512_mul_ps( zmmMasses[zmmBoxIndex], _mm512_mul_ps( outsideDistance, outsideDistance ) );
+
+			inoutZMMMeanDists[zmmBoxIndex] = curDistance;
+			inoutZMMNearestMeans[zmmBoxIndex] = curNearest;
+			cost = _mm512_mask_add_ps( cost, laneMask, cost, boxCost );
+		}
+
+		return HAdd( cost );
+	}
+
+	// Same result as UpdateNearestMeans, skipping the distances the bounds show can't beat a box's current distance
+	virtual bool UpdateNearestMeansBounded( const Boxes<D>& boxes, const Means<D>& means, const MeanDrifts& drifts, BoxMeans* inoutBoxMeans ) final
+	{
+		const uint zmmBoxCount = ZMMBoxCount( boxes.count );
+		__m512* const inoutZMMMeanDists = reinterpret_cast<__m512*>( inoutBoxMeans->meanDists );
+		const __m512i* const zmmNearestMeans = reinterpret_cast<const __m512i*>( inoutBoxMeans->nearestMeans );
+		__m512* const inoutZMMAssignedBounds = reinterpret_cast<__m512*>( inoutBoxMeans->assignedBounds );
+		__m512* const inoutZMMOtherBounds = reinterpret_cast<__m512*>( inoutBoxMeans->otherBounds );
+		const __m512i maxDriftMean = _mm512_set1_epi32( static_cast<int>( drifts.maxDriftMean ) );
+		const __m512 maxDrift = _mm512_set1_ps( drifts.maxDrift );
+		const __m512 secondMaxDrift = _mm512_set1_ps( drifts.secondMaxDrift );
+		__mmask16 changed = 0;
+
+		for( uint zmmBoxIndex = 0; zmmBoxIndex < zmmBoxCount; ++zmmBoxIndex )
+		{
+			const uint laneCount = std::min( boxes.count - ( zmmBoxIndex << 4 ), 16u );
+			const __mmask16 laneMask = static_cast<__mmask16>( ( 1u << laneCount ) - 1 );
+			const __m512i nearest = zmmNearestMeans[zmmBoxIndex];
+			const __m512 assignedDrift = _mm512_mask_i32gather_ps( _mm512_setzero_ps(), laneMask, nearest, drifts.drifts, 4 );
+			const __m512 otherDrift = _mm512_mask_blend_ps( _mm512_cmpeq_epi32_mask( nearest, maxDriftMean ), maxDrift, secondMaxDrift );
+			const __m512 curDistance = inoutZMMMeanDists[zmmBoxIndex];
+			const __m512 assignedBound = _mm512_sub_ps( inoutZMMAssignedBounds[zmmBoxIndex], assignedDrift );
+			const __m512 otherBound = _mm512_sub_ps( inoutZMMOtherBounds[zmmBoxIndex], otherDrift );
+			const __mmask16 needAll = _mm512_mask_cmp_ps_mask( laneMask, otherBound, curDistance, _CMP_LT_OQ );
+			const __mmask16 needAssigned = _mm512_mask_cmp_ps_mask( laneMask, assignedBound, curDistance, _CMP_LT_OQ );
+
+			if( needAll )
+			{
+				changed |= UpdateNearestMeanBlockBounded( boxes, means, zmmBoxIndex, laneMask, inoutBoxMeans );
+			}
+			else if( needAssigned )
+			{
+				// Only the assigned mean could have come closer. Nearest stays put either way.
+				__m512 mean[D];
+
+				for( size_t d = 0; d < D; ++d )
+					mean[d] = _mm512_mask_i32gather_ps( _mm512_setzero_ps(), needAssigned, nearest, means.means[d], 4 );
+
+				const __m512 meanDistance = BoxToMeanDistance( boxes, zmmBoxIndex, mean );
+
+				changed |= _mm512_mask_cmp_ps_mask( needAssigned, meanDistance, curDistance, _CMP_LT_OQ );
+				inoutZMMMeanDists[zmmBoxIndex] = _mm512_mask_min_ps( curDistance, needAssigned, meanDistance, curDistance );
+				inoutZMMAssignedBounds[zmmBoxIndex] = _mm512_mask_blend_ps( needAssigned, assignedBound, DistanceLowerBound( meanDistance ) );
+				inoutZMMOtherBounds[zmmBoxIndex] = otherBound;
+			}
+			else
+			{
+				inoutZMMAssignedBounds[zmmBoxIndex] = assignedBound;
+				inoutZMMOtherBounds[zmmBoxIndex] = otherBound;
+			}
+		}
+
+		return changed == 0;
+	}
+
+	virtual void ComputeMeans( const Boxes<D>& boxes, const uint* partitions, Means<D>* outMeans ) final
+	{
+		const uint meanCount = outMeans->k;
+
+		uint partitionBegin = 0;
+
+		for( uint meanIndex = 0; meanIndex < meanCount; ++meanIndex )
+		{
+			const uint partitionEnd = partitions[meanIndex];
+			const float partitionMass = 1.0f / PartitionSum( boxes.masses, partitionBegin, partitionEnd );
+
+			for( size_t d = 0; d < D; ++d )
+				outMeans->means[d][meanIndex] = PartitionSum( boxes.weightedCenters[d], partitionBegin, partitionEnd ) * partitionMass;
+
+			partitionBegin = partitionEnd;
+		}
+	}
+
+	virtual void SumPartitions( const Boxes<D>& boxes, const uint* partitions, Means<D>* outWeightedSums, float* outMasses ) final
+	{
+		const uint meanCount = outWeightedSums->k;
+
+		uint partitionBegin = 0;
+
+		for( uint meanIndex = 0; meanIndex < meanCount; ++meanIndex )
+		{
+			const uint partitionEnd = partitions[meanIndex];
+
+			outMasses[meanIndex] = PartitionSum( boxes.masses, partitionBegin, partitionEnd );
+
+			for( size_t d = 0; d < D; ++d )
+				outWeightedSums->means[d][meanIndex] = PartitionSum( boxes.weightedCenters[d], partitionBegin, partitionEnd );
+
+			partitionBegin = partitionEnd;
+		}
+	}
+
+	virtual uint AlignBoxCount( uint boxCount ) final
+	{
+		return ( boxCount + 15 ) & ~15;
+	}
+};
@@ -23,6 +23,17 @@ struct BoxMeans
 {
 	uint *nearestMeans;
 	float *meanDists;
+	float *assignedBounds; // Lower bounds on the distance to nearestMeans, only kept by the bounded update
+	float *otherBounds; // Lower bounds on the distance to every other mean
+};
+
+// How far each mean moved in the last ComputeMeans, for the bounded update
+struct MeanDrifts
+{
+	const float *drifts;
+	float maxDrift;
+	uint maxDriftMean;
+	float secondMaxDrift;
 };
 
 template<size_t D>
@@ -41,6 +52,9 @@ struct BoxPartitionDriver
 	virtual void InitializeBoxes(Boxes<D> *inoutBoxes) = 0;
 	virtual void InitializeMeans(const Boxes<D> &boxes, Means<D> *outMeans, BoxMeans *outBoxMeans, uint *indices) = 0;
 	virtual bool UpdateNearestMeans(const Boxes<D> &boxes, const Means<D> &means, BoxMeans *inoutBoxMeans) = 0;
+	virtual float UpdateSeedDistances(const Boxes<D> &boxes, const Means<D> &candidates, uint firstCandidate, BoxMeans *inoutBoxMeans) = 0; // UpdateNearestMeans over candidates [firstCandidate, k), returning the sum of mass * max(distance, 0)^2
+	virtual bool UpdateNearestMeansBounded(const Boxes<D> &boxes, const Means<D> &means, const MeanDrifts &drifts, BoxMeans *inoutBoxMeans) = 0;
 	virtual void ComputeMeans(const Boxes<D> &boxes, const uint *partitions, Means<D> *outMeans) = 0;
+	virtual void SumPartitions(const Boxes<D> &boxes, const uint *partitions, Means<D> *outWeightedSums, float *outMasses) = 0; // ComputeMeans before the divide
 	virtual uint AlignBoxCount(uint boxCount) = 0;
 };
@@ -0,0 +1,330 @@
+#pragma once
+
+#include "box_partitioner_internal.h"
+#include "../Assert.h"
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+#include <type_traits>
+#include <cstdint>
+
+// Threads parked between jobs, so the k-means loop can fan out twice an iteration without creating threads each time.
+// One job runs at a time. A caller that finds the pool busy, say from another thread's tree build, runs its tasks inline.
+class PartitionWorkerPool
+{
+public:
+	explicit PartitionWorkerPool( unsigned workerCount )
+		: jobFunc( nullptr )
+		, jobContext( nullptr )
+		, jobTaskCount( 0 )
+		, nextTask( 0 )
+		, busyWorkers( 0 )
+		, generation( 0 )
+		, quit( false )
+	{
+		workers.reserve( workerCount );
+		for( unsigned workerIndex = 0; workerIndex < workerCount; ++workerIndex )
+			workers.emplace_back( [this]() { WorkerLoop(); } );
+	}
+
+	~PartitionWorkerPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock( mutex );
+			quit = true;
+		}
+
+		startCondition.notify_all();
+		for( std::thread& worker : workers )
+			worker.join();
+	}
+
+	PartitionWorkerPool( const PartitionWorkerPool& ) = delete;
+	PartitionWorkerPool& operator=( const PartitionWorkerPool& ) = delete;
+
+	// Runs TaskFunc( 0..taskCount-1 ) over the workers and the calling thread, returning once every task is done
+	template <typename Func>
+	void run( unsigned taskCount, Func&& TaskFunc )
+	{
+		typedef std::remove_reference_t<Func> func_type;
+		std::unique_lock<std::mutex> jobLock( jobMutex, std::try_to_lock );
+
+		if( !jobLock.owns_lock() || workers.empty() || taskCount < 2 )
+		{
+			for( unsigned taskIndex = 0; taskIndex < taskCount; ++taskIndex )
+				TaskFunc( taskIndex );
+
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock( mutex );
+
+			jobFunc = []( void* context, unsigned taskIndex ) { ( *static_cast<func_type*>( context ) )( taskIndex ); };
+			jobContext = const_cast<void*>( static_cast<const void*>( &TaskFunc ) );
+			jobTaskCount = taskCount;
+			nextTask.store( 0, std::memory_order_relaxed );
+			busyWorkers = static_cast<unsigned>( workers.size() );
+			++generation;
+		}
+
+		startCondition.notify_all();
+		RunTasks();
+
+		std::unique_lock<std::mutex> lock( mutex );
+		doneCondition.wait( lock, [this]() { return busyWorkers == 0; } );
+	}
+
+private:
+	std::vector<std::thread> workers;
+	std::mutex jobMutex;
+	std::mutex mutex;
+	std::condition_variable startCondition;
+	std::condition_variable doneCondition;
+	void ( *jobFunc )( void* context, unsigned taskIndex );
+	void* jobContext;
+	unsigned jobTaskCount;
+	std::atomic<unsigned> nextTask;
+	unsigned busyWorkers;
+	unsigned generation;
+	bool quit;
+
+	void RunTasks()
+	{
+		for( unsigned taskIndex = nextTask.fetch_add( 1 ); taskIndex < jobTaskCount; taskIndex = nextTask.fetch_add( 1 ) )
+			jobFunc( jobContext, taskIndex );
+	}
+
+	void WorkerLoop()
+	{
+		unsigned seenGeneration = 0;
+
+		for( ;; )
+		{
+			{
+				std::unique_lock<std::mutex> lock( mutex );
+
+				startCondition.wait( lock, [this, seenGeneration]() { return quit || generation != seenGeneration; } );
+				if( quit )
+					return;
+
+				seenGeneration = generation;
+			}
+
+			RunTasks();
+
+			bool lastWorker;
+			{
+				std::lock_guard<std::mutex> lock( mutex );
+				lastWorker = --busyWorkers == 0;
+			}
+
+			if( lastWorker )
+				doneCondition.notify_one();
+		}
+	}
+};
+
+// Splits the per-box k-means steps into fixed size chunks run on a PartitionWorkerPool, handing each chunk to a SIMD
+// driver. Chunk boundaries only depend on the box count and partial sums are reduced in chunk order, so the result is
+// the same however many threads there are and whichever chunk each one picks up. Farthest first seeding stays serial,
+// as it picks one mean at a time. k-means|| seeding goes wide through UpdateSeedDistances.
+template <size_t D>
+struct BoxPartitionDriver_Parallel : BoxPartitionDriver<D>
+{
+	static constexpr uint CHUNK_BOX_COUNT = 4096; // Multiple of every SIMD width, so chunks start 64 byte aligned
+
+	BoxPartitionDriver_Parallel( BoxPartitionDriver<D>* simdDriver, PartitionWorkerPool* pool )
+		: simdDriver( simdDriver )
+		, pool( pool )
+	{
+	}
+
+	virtual void MakeIndexList( unsigned* start, unsigned count, unsigned valStart ) final
+	{
+		simdDriver->MakeIndexList( start, count, valStart );
+	}
+
+	virtual void InitializeBoxes( Boxes<D>* inoutBoxes ) final
+	{
+		pool->run( ChunkCount( inoutBoxes->count ), [this, inoutBoxes]( unsigned chunkIndex )
+		{
+			Boxes<D> chunk = ChunkBoxes( *inoutBoxes, chunkIndex );
+
+			simdDriver->InitializeBoxes( &chunk );
+		} );
+	}
+
+	virtual void InitializeMeans( const Boxes<D>& boxes, Means<D>* outMeans, BoxMeans* outBoxMeans, uint* indices ) final
+	{
+		simdDriver->InitializeMeans( boxes, outMeans, outBoxMeans, indices );
+	}
+
+	virtual bool UpdateNearestMeans( const Boxes<D>& boxes, const Means<D>& means, BoxMeans* inoutBoxMeans ) final
+	{
+		const uint chunkCount = ChunkCount( boxes.count );
+
+		chunkConverged.resize( chunkCount );
+		pool->run( chunkCount, [&]( unsigned chunkIndex )
+		{
+			const Boxes<D> chunk = ChunkBoxes( boxes, chunkIndex );
+			BoxMeans chunkBoxMeans = ChunkBoxMeans( *inoutBoxMeans, chunkIndex );
+
+			chunkConverged[chunkIndex] = simdDriver->UpdateNearestMeans( chunk, means, &chunkBoxMeans );
+		} );
+
+		return std::all_of( chunkConverged.begin(), chunkConverged.end(), []( uint8_t converged ) { return converged != 0; } );
+	}
+
+	virtual float UpdateSeedDistances( const Boxes<D>& boxes, const Means<D>& candidates, uint firstCandidate, BoxMeans* inoutBoxMeans ) final
+	{
+		const uint chunkCount = ChunkCount( boxes.count );
+
+		chunkCosts.resize( chunkCount );
+		pool->run( chunkCount, [&]( unsigned chunkIndex )
+		{
+			const Boxes<D> chunk = ChunkBoxes( boxes, chunkIndex );
+			BoxMeans chunkBoxMeans = ChunkBoxMeans( *inoutBoxMeans, chunkIndex );
+
+			chunkCosts[chunkIndex] = simdDriver->UpdateSeedDistances( chunk, candidates, firstCandidate, &chunkBoxMeans );
+		} );
+
+		float cost = 0.0f;
+		for( float chunkCost : chunkCosts )
+			cost += chunkCost;
+
+		return cost;
+	}
+
+	virtual bool UpdateNearestMeansBounded( const Boxes<D>& boxes, const Means<D>& means, const MeanDrifts& drifts, BoxMeans* inoutBoxMeans ) final
+	{
+		const uint chunkCount = ChunkCount( boxes.count );
+
+		chunkConverged.resize( chunkCount );
+		pool->run( chunkCount, [&]( unsigned chunkIndex )
+		{
+			const Boxes<D> chunk = ChunkBoxes( boxes, chunkIndex );
+			BoxMeans chunkBoxMeans = ChunkBoxMeans( *inoutBoxMeans, chunkIndex );
+
+			chunkConverged[chunkIndex] = simdDriver->UpdateNearestMeansBounded( chunk, means, drifts, &chunkBoxMeans );
+		} );
+
+		return std::all_of( chunkConverged.begin(), chunkConverged.end(), []( uint8_t converged ) { return converged != 0; } );
+	}
+
+	virtual void ComputeMeans( const Boxes<D>& boxes, const uint* partitions, Means<D>* outMeans ) final
+	{
+		const uint meanCount = outMeans->k;
+
+		meanMasses.resize( meanCount );
+		SumPartitions( boxes, partitions, outMeans, meanMasses.data() );
+
+		for( uint meanIndex = 0; meanIndex < meanCount; ++meanIndex )
+		{
+			const float partitionMass = 1.0f / meanMasses[meanIndex];
+
+			for( size_t d = 0; d < D; ++d )
+				outMeans->means[d][meanIndex] *= partitionMass;
+		}
+	}
+
+	virtual void SumPartitions( const Boxes<D>& boxes, const uint* partitions, Means<D>* outWeightedSums, float* outMasses ) final
+	{
+		const uint meanCount = outWeightedSums->k;
+		const uint chunkCount = ChunkCount( boxes.count );
+		const size_t chunkSumsStride = meanCount * ( D + 1 );
+
+		chunkSums.resize( chunkCount * chunkSumsStride );
+		chunkPartitions.resize( chunkCount * meanCount );
+
+		pool->run( chunkCount, [&]( unsigned chunkIndex )
+		{
+			const Boxes<D> chunk = ChunkBoxes( boxes, chunkIndex );
+			const uint chunkBegin = chunkIndex * CHUNK_BOX_COUNT;
+			uint* const partitionEnds = &chunkPartitions[chunkIndex * meanCount];
+			float* const sums = &chunkSums[chunkIndex * chunkSumsStride];
+			Means<D> chunkWeightedSums{ meanCount };
+
+			for( uint meanIndex = 0; meanIndex < meanCount; ++meanIndex )
+				partitionEnds[meanIndex] = std::min( std::max( partitions[meanIndex], chunkBegin ), chunkBegin + chunk.count ) - chunkBegin;
+
+			for( size_t d = 0; d < D; ++d )
+				chunkWeightedSums.means[d] = sums + d * meanCount;
+
+			simdDriver->SumPartitions( chunk, partitionEnds, &chunkWeightedSums, sums + D * meanCount );
+		} );
+
+		for( uint meanIndex = 0; meanIndex < meanCount; ++meanIndex )
+		{
+			float mass = 0.0f;
+			float weightedSum[D] = {};
+
+			for( uint chunkIndex = 0; chunkIndex < chunkCount; ++chunkIndex )
+			{
+				const float* const sums = &chunkSums[chunkIndex * chunkSumsStride];
+
+				for( size_t d = 0; d < D; ++d )
+					weightedSum[d] += sums[d * meanCount + meanIndex];
+
+				mass += sums[D * meanCount + meanIndex];
+			}
+
+			for( size_t d = 0; d < D; ++d )
+				outWeightedSums->means[d][meanIndex] = weightedSum[d];
+
+			outMasses[meanIndex] = mass;
+		}
+	}
+
+	virtual uint AlignBoxCount( uint boxCount ) final
+	{
+		return simdDriver->AlignBoxCount( boxCount );
+	}
+
+private:
+	BoxPartitionDriver<D>* const simdDriver;
+	PartitionWorkerPool* const pool;
+	std::vector<float> chunkSums;
+	std::vector<float> chunkCosts;
+	std::vector<float> meanMasses;
+	std::vector<uint> chunkPartitions;
+	std::vector<uint8_t> chunkConverged;
+
+	static __forceinline uint ChunkCount( uint boxCount )
+	{
+		return ( boxCount + CHUNK_BOX_COUNT - 1 ) / CHUNK_BOX_COUNT;
+	}
+
+	static Boxes<D> ChunkBoxes( const Boxes<D>& boxes, uint chunkIndex )
+	{
+		const uint chunkBegin = chunkIndex * CHUNK_BOX_COUNT;
+		Boxes<D> chunk{ std::min( CHUNK_BOX_COUNT, boxes.count - chunkBegin ) };
+
+		for( size_t d = 0; d < D; ++d )
+		{
+			chunk.mins[d] = boxes.mins[d] + chunkBegin;
+			chunk.maxs[d] = boxes.maxs[d] + chunkBegin;
+			chunk.weightedCenters[d] = boxes.weightedCenters[d] + chunkBegin;
+		}
+
+		chunk.masses = boxes.masses + chunkBegin;
+
+		return chunk;
+	}
+
+	static BoxMeans ChunkBoxMeans( const BoxMeans& boxMeans, uint chunkIndex )
+	{
+		const uint chunkBegin = chunkIndex * CHUNK_BOX_COUNT;
+		BoxMeans chunk;
+
+		chunk.nearestMeans = boxMeans.nearestMeans + chunkBegin;
+		chunk.meanDists = boxMeans.meanDists + chunkBegin;
+		chunk.assignedBounds = boxMeans.assignedBounds ? boxMeans.assignedBounds + chunkBegin : nullptr;
+		chunk.otherBounds = boxMeans.otherBounds ? boxMeans.otherBounds + chunkBegin : nullptr;
+
+		return chunk;
+	}
+};
@@ -14,6 +14,33 @@ private:
 	// Computes the distance from the mean to the nearest point on the box.
 	// Result is negative if mean is inside the box.
 	static inline __m128 BoxToSingleMeanDistance( const Boxes<D>& boxes, uint sseBoxIndex, const Means<D>& means, uint meanIndex )
+	{
+		__m128 mean[D];
+
+		for( size_t d = 0; d < D; ++d )
+			mean[d] = _mm_set1_ps( means.means[d][meanIndex] );
+
+		return BoxToMeanDistance( boxes, sseBoxIndex, mean );
+	}
+
+	// Loads the 4 values of a block of boxes. The last block can be short, so it is copied out rather than read past the
+	// end of the caller's arrays, its missing lanes left 0.
+	static __forceinline __m128 LoadBoxLanes( const float* values, uint sseBoxIndex, uint boxCount )
+	{
+		const uint firstBox = sseBoxIndex << 2;
+
+		if( boxCount - firstBox >= 4 )
+			return _mm_loadu_ps( values + firstBox );
+
+		alignas( 16 ) float lanes[4] = {};
+
+		std::memcpy( lanes, values + firstBox, sizeof( float ) * ( boxCount - firstBox ) );
+
+		return _mm_load_ps( lanes );
+	}
+
+	// As BoxToSingleMeanDistance, with a mean per lane
+	static inline __m128 BoxToMeanDistance( const Boxes<D>& boxes, uint sseBoxIndex, const __m128 ( &mean )[D] )
 	{
 		// The equation max(min-mean, 0, mean-max) will return the distance for
 		// each axis to the bounding box, however, it will be 0 for touching or
@@ -28,11 +55,10 @@ private:
 
 		for( size_t d = 0; d < D; ++d )
 		{
-			const __m128 mean = _mm_set1_ps( means.means[d][meanIndex] );
-			const __m128 boxMin = _mm_loadu_ps( boxes.mins[d] + ( sseBoxIndex << 2 ) );
-			const __m128 boxMax = _mm_loadu_ps( boxes.maxs[d] + ( sseBoxIndex << 2 ) );
-			const __m128 minToMeanDist = _mm_sub_ps( boxMin, mean );
-			const __m128 meanToMaxDist = _mm_sub_ps( mean, boxMax );
+			const __m128 boxMin = LoadBoxLanes( boxes.mins[d], sseBoxIndex, boxes.count );
+			const __m128 boxMax = LoadBoxLanes( boxes.maxs[d], sseBoxIndex, boxes.count );
+			const __m128 minToMeanDist = _mm_sub_ps( boxMin, mean[d] );
+			const __m128 meanToMaxDist = _mm_sub_ps( mean[d], boxMax );
 			const __m128 minDistToSide = _mm_max_ps( minToMeanDist, meanToMaxDist ); // We use max, because these values are negative
 			const __m128 minDistToBox = _mm_max_ps( minDistToSide, zero );
 			const __m128 minDistToBoxSqr = _mm_mul_ps( minDistToBox, minDistToBox );
@@ -50,6 +76,12 @@ private:
 		return _mm_or_ps( dist, minSideDist );
 	}
 
+	// A computed distance nudged down by a few ulps, so rounding can't leave a bound above the true distance
+	static __forceinline __m128 DistanceLowerBound( __m128 distance )
+	{
+		return _mm_sub_ps( distance, _mm_mul_ps( _mm_andnot_ps( _mm_set1_ps( -0.0f ), distance ), _mm_set1_ps( 4.0f * FLT_EPSILON ) ) );
+	}
+
 	static inline float FltPartitionGather( const float* values, unsigned partitionBegin, unsigned partitionEnd, unsigned ssePartitionBegin, unsigned ssePartitionEnd )
 	{
 		float gather = 0.0f;
@@ -63,6 +95,57 @@ private:
 		return gather;
 	}
 
+	static __forceinline __m128 Select( __m128i mask, __m128 a, __m128 b )
+	{
+		return _mm_or_ps( _mm_and_ps( _mm_castsi128_ps( mask ), a ), _mm_andnot_ps( _mm_castsi128_ps( mask ), b ) );
+	}
+
+	static __forceinline __m128i Select( __m128i mask, __m128i a, __m128i b )
+	{
+		return _mm_or_si128( _mm_and_si128( mask, a ), _mm_andnot_si128( mask, b ) );
+	}
+
+	// The UpdateNearestMeans loop for one block, which also leaves exact bounds behind for the bounded update.
+	// Nearest only ever moves to the lowest index mean at the minimum distance, so the distance to the new nearest
+	// mean is the minimum and the closest other mean is the second minimum.
+	static inline __m128i UpdateNearestMeanBlockBounded( const Boxes<D>& boxes, const Means<D>& means, uint sseBoxIndex, __m128i laneMask, BoxMeans* inoutBoxMeans )
+	{
+		__m128* const sseMeanDists = reinterpret_cast<__m128*>( inoutBoxMeans->meanDists );
+		__m128i* const sseNearestMeans = reinterpret_cast<__m128i*>( inoutBoxMeans->nearestMeans );
+		const __m128i oldNearest = sseNearestMeans[sseBoxIndex];
+		__m128 curDistance = sseMeanDists[sseBoxIndex];
+		__m128i curNearest = oldNearest;
+		__m128 oldNearestDistance = _mm_setzero_ps();
+		__m128 minDistance = _mm_set1_ps( std::numeric_limits<float>::max() );
+		__m128 secondMinDistance = minDistance;
+		__m128i minMean = _mm_setzero_si128();
+		__m128i changed = _mm_setzero_si128();
+
+		for( uint meanIndex = 0; meanIndex < means.k; ++meanIndex )
+		{
+			const __m128i sseMeanIndex = _mm_set1_epi32( static_cast<int>( meanIndex ) );
+			const __m128 meanDistance = BoxToSingleMeanDistance( boxes, sseBoxIndex, means, meanIndex );
+			const __m128i lessThanDist = _mm_and_si128( laneMask, _mm_castps_si128( _mm_cmplt_ps( meanDistance, curDistance ) ) );
+			const __m128i lessThanMin = _mm_castps_si128( _mm_cmplt_ps( meanDistance, minDistance ) );
+
+			curDistance = _mm_min_ps( meanDistance, curDistance );
+			curNearest = Select( lessThanDist, sseMeanIndex, curNearest );
+			changed = _mm_or_si128( changed, lessThanDist );
+
+			oldNearestDistance = Select( _mm_cmpeq_epi32( oldNearest, sseMeanIndex ), meanDistance, oldNearestDistance );
+			secondMinDistance = Select( lessThanMin, minDistance, _mm_min_ps( meanDistance, secondMinDistance ) );
+			minDistance = _mm_min_ps( meanDistance, minDistance );
+			minMean = Select( lessThanMin, sseMeanIndex, minMean );
+		}
+
+		reinterpret_cast<__m128*>( inoutBoxMeans->assignedBounds )[sseBoxIndex] = DistanceLowerBound( Select( _mm_cmpeq_epi32( curNearest, oldNearest ), oldNearestDistance, minDistance ) );
+		reinterpret_cast<__m128*>( inoutBoxMeans->otherBounds )[sseBoxIndex] = DistanceLowerBound( Select( _mm_cmpeq_epi32( curNearest, minMean ), secondMinDistance, minDistance ) );
+		sseMeanDists[sseBoxIndex] = curDistance;
+		sseNearestMeans[sseBoxIndex] = curNearest;
+
+		return changed;
+	}
+
 	static __forceinline float HAdd( __m128 v )
 	{
 		__m128 shuf = _mm_shuffle_ps( v, v, _MM_SHUFFLE( 2, 3, 0, 1 ) ); // [ C D | B A ]
@@ -73,6 +156,30 @@ private:
 		return _mm_cvtss_f32( sums );
 	}
 
+	// Sums values over [partitionBegin, partitionEnd), four at a time over the aligned middle
+	static inline float PartitionSum( const float* values, uint partitionBegin, uint partitionEnd )
+	{
+		if( partitionEnd - partitionBegin <= 3 )
+		{
+			float sum = 0.0f;
+
+			for( uint boxIndex = partitionBegin; boxIndex < partitionEnd; ++boxIndex )
+				sum += values[boxIndex];
+
+			return sum;
+		}
+
+		const uint ssePartitionBegin = ( partitionBegin + 3 ) & ~3;
+		const uint ssePartitionEnd = partitionEnd & ~3;
+		const __m128* const sseValues = reinterpret_cast<const __m128*>( values );
+		__m128 sum = _mm_set_ss( FltPartitionGather( values, partitionBegin, partitionEnd, ssePartitionBegin, ssePartitionEnd ) );
+
+		for( uint sseBoxIndex = ssePartitionBegin >> 2; sseBoxIndex < ssePartitionEnd >> 2; ++sseBoxIndex )
+			sum = _mm_add_ps( sum, sseValues[sseBoxIndex] );
+
+		return HAdd( sum );
+	}
+
 	__forceinline uint SSEBoxCount( uint boxCount )
 	{
 		return AlignBoxCount( boxCount ) >> 2;
@@ -88,8 +195,8 @@ public:
 			alignas( 64 ) __m128i inc = _mm_set1_epi32( 4 );
 
 			std::iota( start, start + 4, valStart );
-			for( size_t sseIndex = 1; sseIndex < sseCount; ++sseIndex )
-				*sseIndexCur++ = _mm_add_epi32( sseIndexCur[-1], inc );
+			for( size_t sseIndex = 1; sseIndex < sseCount; ++sseIndex, ++sseIndexCur )
+				*sseIndexCur = _mm_add_epi32( sseIndexCur[-1], inc );
 
 			const unsigned completed = sseCount << 2;
 			start += completed;
@@ -113,14 +220,14 @@ public:
 
 			for( size_t x = 0; x < D - 1; ++x )
 			{
-				const __m128 xMin = _mm_loadu_ps( inoutBoxes->mins[x] + ( sseBoxIndex << 2 ) );
-				const __m128 xMax = _mm_loadu_ps( inoutBoxes->maxs[x] + ( sseBoxIndex << 2 ) );
+				const __m128 xMin = LoadBoxLanes( inoutBoxes->mins[x], sseBoxIndex, inoutBoxes->count );
+				const __m128 xMax = LoadBoxLanes( inoutBoxes->maxs[x], sseBoxIndex, inoutBoxes->count );
 				const __m128 xExtent = _mm_sub_ps( xMax, xMin );
 
 				for( size_t y = x + 1; y < D; ++y )
 				{
-					const __m128 yMin = _mm_loadu_ps( inoutBoxes->mins[y] + ( sseBoxIndex << 2 ) );
-					const __m128 yMax = _mm_loadu_ps( inoutBoxes->maxs[y] + ( sseBoxIndex << 2 ) );
+					const __m128 yMin = LoadBoxLanes( inoutBoxes->mins[y], sseBoxIndex, inoutBoxes->count );
+					const __m128 yMax = LoadBoxLanes( inoutBoxes->maxs[y], sseBoxIndex, inoutBoxes->count );
 					const __m128 yExtent = _mm_sub_ps( yMax, yMin );
 					const __m128 xyArea = _mm_mul_ps( xExtent, yExtent );
 
@@ -139,8 +246,8 @@ public:
 
 			for( uint sseBoxIndex = 0; sseBoxIndex < sseBoxCount; ++sseBoxIndex )
 			{
-				const __m128 min = _mm_loadu_ps( mins + ( sseBoxIndex << 2 ) );
-				const __m128 max = _mm_loadu_ps( maxs + ( sseBoxIndex << 2 ) );
+				const __m128 min = LoadBoxLanes( mins, sseBoxIndex, inoutBoxes->count );
+				const __m128 max = LoadBoxLanes( maxs, sseBoxIndex, inoutBoxes->count );
 				const __m128 perim = _mm_add_ps( max, min );
 				const __m128 halfMass = _mm_mul_ps( outMasses[sseBoxIndex], half );
 
@@ -274,63 +381,142 @@ public:
 		return cv[0] == ~0u && cv[1] == ~0u && cv[2] == ~0u && cv[3] == ~0u;
 	}
 
-	virtual void ComputeMeans( const Boxes<D>& boxes, const uint* partitions, Means<D>* outMeans ) final
+	// UpdateNearestMeans over the candidates added since firstCandidate. Also sums the seeding cost, where a box that
+	// holds its nearest candidate costs nothing.
+	virtual float UpdateSeedDistances( const Boxes<D>& boxes, const Means<D>& candidates, uint firstCandidate, BoxMeans* inoutBoxMeans ) final
 	{
-		const uint meanCount = outMeans->k;
-		const __m128* const sseBoxMasses = reinterpret_cast<const __m128*>( boxes.masses );
+		const uint sseBoxCount = SSEBoxCount( boxes.count );
+		const __m128* const sseMasses = reinterpret_cast<const __m128*>( boxes.masses );
+		__m128* const inoutSSEMeanDists = reinterpret_cast<__m128*>( inoutBoxMeans->meanDists );
+		__m128i* const inoutSSENearestMeans = reinterpret_cast<__m128i*>( inoutBoxMeans->nearestMeans );
+		const __m128 zero = _mm_setzero_ps();
+		__m128 cost = zero;
 
-		uint partitionBegin = 0;
+		for( uint sseBoxIndex = 0; sseBoxIndex < sseBoxCount; ++sseBoxIndex )
+		{
+			const __m128i laneMask = _mm_cmpgt_epi32( _mm_set1_epi32( static_cast<int>( boxes.count - ( sseBoxIndex << 2 ) ) ), _mm_set_epi32( 3, 2, 1, 0 ) );
+			__m128 curDistance = inoutSSEMeanDists[sseBoxIndex];
+			__m128i curNearest = inoutSSENearestMeans[sseBoxIndex];
 
-		for( uint meanIndex = 0; meanIndex < meanCount; ++meanIndex )
+			for( uint candidateIndex = firstCandidate; candidateIndex < candidates.k; ++candidateIndex )
+			{
+				const __m128i sseCandidateIndex = _mm_set1_epi32( static_cast<int>( candidateIndex ) );
+				const __m128 candidateDistance = BoxToSingleMeanDistance( boxes, sseBoxIndex, candidates, candidateIndex );
+				const __m128i lessThanDist = _mm_and_si128( laneMask, _mm_castps_si128( _mm_cmplt_ps( candidateDistance, curDistance ) ) );
+
+				curDistance = _mm_min_ps( candidateDistance, curDistance );
+				curNearest = Select( lessThanDist, sseCandidateIndex, curNearest );
+			}
+
+			const __m128 outsideDistance = _mm_max_ps( curDistance, zero );
+			const __m128 boxCost = _mm_mul_ps( sseMasses[sseBoxIndex], _mm_mul_ps( outsideDistance, outsideDistance ) );
+
+			inoutSSEMeanDists[sseBoxIndex] = curDistance;
+			inoutSSENearestMeans[sseBoxIndex] = curNearest;
+			cost = _mm_add_ps( cost, Select( laneMask, boxCost, zero ) );
+		}
+
+		return HAdd( cost );
+	}
+
+	// Same result as UpdateNearestMeans, skipping the distances the bounds show can't beat a box's current distance
+	virtual bool UpdateNearestMeansBounded( const Boxes<D>& boxes, const Means<D>& means, const MeanDrifts& drifts, BoxMeans* inoutBoxMeans ) final
+	{
+		const uint sseBoxCount = SSEBoxCount( boxes.count );
+		__m128* const inoutSSEMeanDists = reinterpret_cast<__m128*>( inoutBoxMeans->meanDists );
+		__m128* const inoutSSEAssignedBounds = reinterpret_cast<__m128*>( inoutBoxMeans->assignedBounds );
+		__m128* const inoutSSEOtherBounds = reinterpret_cast<__m128*>( inoutBoxMeans->otherBounds );
+		__m128i changed = _mm_setzero_si128();
+
+		for( uint sseBoxIndex = 0; sseBoxIndex < sseBoxCount; ++sseBoxIndex )
 		{
-			const uint partitionEnd = partitions[meanIndex];
-			
-			if( partitionEnd - partitionBegin <= 3 )
+			const uint laneCount = std::min( boxes.count - ( sseBoxIndex << 2 ), 4u );
+			const __m128i laneMask = _mm_cmpgt_epi32( _mm_set1_epi32( static_cast<int>( laneCount ) ), _mm_set_epi32( 3, 2, 1, 0 ) );
+			const uint* const nearestLanes = inoutBoxMeans->nearestMeans + ( sseBoxIndex << 2 );
+			alignas( 16 ) float assignedDrifts[4] = {};
+			alignas( 16 ) float otherDrifts[4] = {};
+
+			for( uint lane = 0; lane < laneCount; ++lane )
 			{
-				float partitionMass = 0.0f;
+				assignedDrifts[lane] = drifts.drifts[nearestLanes[lane]];
+				otherDrifts[lane] = nearestLanes[lane] == drifts.maxDriftMean ? drifts.secondMaxDrift : drifts.maxDrift;
+			}
 
-				for( uint boxIndex = partitionBegin; boxIndex < partitionEnd; ++boxIndex )
-					partitionMass += boxes.masses[boxIndex];
+			const __m128 curDistance = inoutSSEMeanDists[sseBoxIndex];
+			const __m128 assignedBound = _mm_sub_ps( inoutSSEAssignedBounds[sseBoxIndex], _mm_load_ps( assignedDrifts ) );
+			const __m128 otherBound = _mm_sub_ps( inoutSSEOtherBounds[sseBoxIndex], _mm_load_ps( otherDrifts ) );
+			const __m128i needAll = _mm_and_si128( laneMask, _mm_castps_si128( _mm_cmplt_ps( otherBound, curDistance ) ) );
+			const __m128i needAssigned = _mm_and_si128( laneMask, _mm_castps_si128( _mm_cmplt_ps( assignedBound, curDistance ) ) );
 
-				partitionMass = 1.0f / partitionMass;
+			if( _mm_movemask_epi8( needAll ) )
+			{
+				changed = _mm_or_si128( changed, UpdateNearestMeanBlockBounded( boxes, means, sseBoxIndex, laneMask, inoutBoxMeans ) );
+			}
+			else if( _mm_movemask_epi8( needAssigned ) )
+			{
+				// Only the assigned mean could have come closer. Nearest stays put either way.
+				__m128 mean[D];
 
 				for( size_t d = 0; d < D; ++d )
 				{
-					const float* const weightedCenters = boxes.weightedCenters[d];
-					float mean = 0.0f;
-					for( uint boxIndex = partitionBegin; boxIndex < partitionEnd; ++boxIndex )
-						mean += weightedCenters[boxIndex];
+					alignas( 16 ) float meanLanes[4] = {};
 
-					outMeans->means[d][meanIndex] = mean * partitionMass;
+					for( uint lane = 0; lane < laneCount; ++lane )
+						meanLanes[lane] = means.means[d][nearestLanes[lane]];
+
+					mean[d] = _mm_load_ps( meanLanes );
 				}
+
+				const __m128 meanDistance = BoxToMeanDistance( boxes, sseBoxIndex, mean );
+				const __m128i lessThanDist = _mm_and_si128( needAssigned, _mm_castps_si128( _mm_cmplt_ps( meanDistance, curDistance ) ) );
+
+				inoutSSEMeanDists[sseBoxIndex] = Select( needAssigned, _mm_min_ps( meanDistance, curDistance ), curDistance );
+				inoutSSEAssignedBounds[sseBoxIndex] = Select( needAssigned, DistanceLowerBound( meanDistance ), assignedBound );
+				inoutSSEOtherBounds[sseBoxIndex] = otherBound;
+				changed = _mm_or_si128( changed, lessThanDist );
 			}
 			else
 			{
-				uint ssePartitionBegin = (partitionBegin + 3) & ~3;
-				uint ssePartitionEnd = partitionEnd & ~3;
-				uint sseBoxBegin = ssePartitionBegin >> 2;
-				uint sseBoxEnd = ssePartitionEnd >> 2;
-				float partitionMass = FltPartitionGather( boxes.masses, partitionBegin, partitionEnd, ssePartitionBegin, ssePartitionEnd );
-				__m128 ssePartitionMass = _mm_set_ss( partitionMass );
+				inoutSSEAssignedBounds[sseBoxIndex] = assignedBound;
+				inoutSSEOtherBounds[sseBoxIndex] = otherBound;
+			}
+		}
 
-				for ( uint sseBoxIndex = sseBoxBegin; sseBoxIndex < sseBoxEnd; ++sseBoxIndex )
-					ssePartitionMass = _mm_add_ps( ssePartitionMass, sseBoxMasses[sseBoxIndex] );
+		return _mm_movemask_epi8( changed ) == 0;
+	}
 
-				partitionMass = 1.0f / HAdd( ssePartitionMass );
+	virtual void ComputeMeans( const Boxes<D>& boxes, const uint* partitions, Means<D>* outMeans ) final
+	{
+		const uint meanCount = outMeans->k;
 
-				for ( size_t d = 0; d < D; ++d )
-				{
-					const float* const weightedCenters = boxes.weightedCenters[d];
-					const __m128* const sseWeightedCenters = reinterpret_cast<const __m128*>(weightedCenters);
-					float mean = FltPartitionGather( weightedCenters, partitionBegin, partitionEnd, ssePartitionBegin, ssePartitionEnd );
-					__m128 sseMean = _mm_set_ss( mean );
+		uint partitionBegin = 0;
 
-					for ( uint sseBoxIndex = sseBoxBegin; sseBoxIndex < sseBoxEnd; ++sseBoxIndex )
-						sseMean = _mm_add_ps( sseMean, sseWeightedCenters[sseBoxIndex] );
+		for( uint meanIndex = 0; meanIndex < meanCount; ++meanIndex )
+		{
+			const uint partitionEnd = partitions[meanIndex];
+			const float partitionMass = 1.0f / PartitionSum( boxes.masses, partitionBegin, partitionEnd );
 
-					outMeans->means[d][meanIndex] = HAdd( sseMean ) * partitionMass;
-				}
-			}
+			for( size_t d = 0; d < D; ++d )
+				outMeans->means[d][meanIndex] = PartitionSum( boxes.weightedCenters[d], partitionBegin, partitionEnd ) * partitionMass;
+
+			partitionBegin = partitionEnd;
+		}
+	}
+
+	virtual void SumPartitions( const Boxes<D>& boxes, const uint* partitions, Means<D>* outWeightedSums, float* outMasses ) final
+	{
+		const uint meanCount = outWeightedSums->k;
+
+		uint partitionBegin = 0;
+
+		for( uint meanIndex = 0; meanIndex < meanCount; ++meanIndex )
+		{
+			const uint partitionEnd = partitions[meanIndex];
+
+			outMasses[meanIndex] = PartitionSum( boxes.masses, partitionBegin, partitionEnd );
+
+			for( size_t d = 0; d < D; ++d )
+				outWeightedSums->means[d][meanIndex] = PartitionSum( boxes.weightedCenters[d], partitionBegin, partitionEnd );
 
 			partitionBegin = partitionEnd;
 		}
@@ -0,0 +1,258 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+
+// Optional secondary bounds for spatial_tree leaves. If T has a const member secondary_bound() returning one of these
+// (or anything with the same interface), tree queries test it after the leaf's box passes and before the callback.
+namespace spatial_bounds
+{
+	namespace detail
+	{
+		// Slab test of start + dir*[0, tMax] against a box. Zero direction components are handled explicitly so
+		// rays starting on a slab boundary don't produce NaNs.
+		template <size_t D>
+		static bool SegmentBox( const float* start, const float* dir, float tMax, const float* mins, const float* maxs, float epsilon )
+		{
+			float tEnter = 0.0f;
+			float tExit = tMax;
+
+			for( size_t d = 0; d < D; ++d )
+			{
+				const float slabMin = mins[d] - epsilon;
+				const float slabMax = maxs[d] + epsilon;
+
+				if( dir[d] == 0.0f )
+				{
+					if( start[d] < slabMin || start[d] > slabMax )
+						return false;
+				}
+				else
+				{
+					const float invDir = 1.0f / dir[d];
+					const float t0 = ( slabMin - start[d] ) * invDir;
+					const float t1 = ( slabMax - start[d] ) * invDir;
+
+					tEnter = std::max( tEnter, std::min( t0, t1 ) );
+					tExit = std::min( tExit, std::max( t0, t1 ) );
+
+					if( tExit < tEnter )
+						return false;
+				}
+			}
+
+			return true;
+		}
+	}
+
+	template <size_t D>
+	struct sphere
+	{
+		float center[D];
+		float radius;
+
+		bool overlaps( const float* queryMins, const float* queryMaxs, float epsilon ) const
+		{
+			const float r = radius + epsilon;
+			float distSqr = 0.0f;
+
+			for( size_t d = 0; d < D; ++d )
+			{
+				const float delta = center[d] - std::min( std::max( center[d], queryMins[d] ), queryMaxs[d] );
+				distSqr += delta * delta;
+			}
+
+			return distSqr <= r * r;
+		}
+
+		bool intersects( const float* start, const float* dir, float tMax, float epsilon ) const
+		{
+			const float r = radius + epsilon;
+			float dirLenSqr = 0.0f;
+			float proj = 0.0f;
+			float distSqr = 0.0f;
+
+			for( size_t d = 0; d < D; ++d )
+			{
+				proj += ( center[d] - start[d] ) * dir[d];
+				dirLenSqr += dir[d] * dir[d];
+			}
+
+			const float t = dirLenSqr > 0.0f ? std::min( std::max( proj / dirLenSqr, 0.0f ), tMax ) : 0.0f;
+
+			for( size_t d = 0; d < D; ++d )
+			{
+				const float delta = start[d] + dir[d] * t - center[d];
+				distSqr += delta * delta;
+			}
+
+			return distSqr <= r * r;
+		}
+
+		// plane is the normal followed by the offset, dot( normal, x ) = plane[D]
+		bool intersects_plane( const float* plane, float epsilon ) const
+		{
+			float dist = -plane[D];
+
+			for( size_t d = 0; d < D; ++d )
+				dist += plane[d] * center[d];
+
+			return std::abs( dist ) <= radius + epsilon;
+		}
+	};
+
+	template <size_t D>
+	struct obb
+	{
+		float center[D];
+		float axes[D][D]; // Orthonormal, axes[a] is local axis a in world space
+		float halfExtents[D];
+
+		// Separating axis test on the face normals of both boxes. Edge cross products are skipped, so rare false
+		// positives are possible in 3D, but never false negatives.
+		bool overlaps( const float* queryMins, const float* queryMaxs, float epsilon ) const
+		{
+			float queryCenter[D];
+			float queryHalfExtents[D];
+
+			for( size_t d = 0; d < D; ++d )
+			{
+				float r = 0.0f;
+
+				for( size_t a = 0; a < D; ++a )
+					r += std::abs( axes[a][d] ) * halfExtents[a];
+
+				if( center[d] + r < queryMins[d] - epsilon || center[d] - r > queryMaxs[d] + epsilon )
+					return false;
+
+				queryCenter[d] = ( queryMins[d] + queryMaxs[d] ) * 0.5f;
+				queryHalfExtents[d] = ( queryMaxs[d] - queryMins[d] ) * 0.5f;
+			}
+
+			for( size_t a = 0; a < D; ++a )
+			{
+				float dist = 0.0f;
+				float r = halfExtents[a] + epsilon;
+
+				for( size_t d = 0; d < D; ++d )
+				{
+					dist += axes[a][d] * ( queryCenter[d] - center[d] );
+					r += std::abs( axes[a][d] ) * queryHalfExtents[d];
+				}
+
+				if( std::abs( dist ) > r )
+					return false;
+			}
+
+			return true;
+		}
+
+		bool intersects( const float* start, const float* dir, float tMax, float epsilon ) const
+		{
+			float localStart[D];
+			float localDir[D];
+			float localMins[D];
+
+			for( size_t a = 0; a < D; ++a )
+			{
+				localStart[a] = 0.0f;
+				localDir[a] = 0.0f;
+				localMins[a] = -halfExtents[a];
+
+				for( size_t d = 0; d < D; ++d )
+				{
+					localStart[a] += axes[a][d] * ( start[d] - center[d] );
+					localDir[a] += axes[a][d] * dir[d];
+				}
+			}
+
+			return detail::SegmentBox<D>( localStart, localDir, tMax, localMins, halfExtents, epsilon );
+		}
+
+		bool intersects_plane( const float* plane, float epsilon ) const
+		{
+			float dist = -plane[D];
+			float r = epsilon;
+
+			for( size_t a = 0; a < D; ++a )
+			{
+				float axisDot = 0.0f;
+
+				for( size_t d = 0; d < D; ++d )
+					axisDot += plane[d] * axes[a][d];
+
+				r += std::abs( axisDot ) * halfExtents[a];
+				dist += plane[a] * center[a];
+			}
+
+			return std::abs( dist ) <= r;
+		}
+	};
+
+	// Union of up to MAX_BOXES axis aligned boxes, for long compound shapes with lots of empty space between parts
+	template <size_t D, size_t MAX_BOXES>
+	struct boxes
+	{
+		unsigned count;
+		float mins[MAX_BOXES][D];
+		float maxs[MAX_BOXES][D];
+
+		bool overlaps( const float* queryMins, const float* queryMaxs, float epsilon ) const
+		{
+			for( unsigned boxIndex = 0; boxIndex < count; ++boxIndex )
+			{
+				bool overlap = true;
+
+				for( size_t d = 0; d < D && overlap; ++d )
+					overlap = maxs[boxIndex][d] >= queryMins[d] - epsilon && mins[boxIndex][d] <= queryMaxs[d] + epsilon;
+
+				if( overlap )
+					return true;
+			}
+
+			return false;
+		}
+
+		bool intersects( const float* start, const float* dir, float tMax, float epsilon ) const
+		{
+			for( unsigned boxIndex = 0; boxIndex < count; ++boxIndex )
+				if( detail::SegmentBox<D>( start, dir, tMax, mins[boxIndex], maxs[boxIndex], epsilon ) )
+					return true;
+
+			return false;
+		}
+
+		bool intersects_plane( const float* plane, float epsilon ) const
+		{
+			for( unsigned boxIndex = 0; boxIndex < count; ++boxIndex )
+			{
+				float dist = -plane[D];
+				float r = epsilon;
+
+				for( size_t d = 0; d < D; ++d )
+				{
+					const float halfExtent = ( maxs[boxIndex][d] - mins[boxIndex][d] ) * 0.5f;
+
+					dist += plane[d] * ( mins[boxIndex][d] + halfExtent );
+					r += std::abs( plane[d] ) * halfExtent;
+				}
+
+				if( std::abs( dist ) <= r )
+					return true;
+			}
+
+			return false;
+		}
+	};
+
+	template <typename T, typename = void>
+	struct has_secondary_bound : std::false_type {};
+
+	template <typename T>
+	struct has_secondary_bound<T, std::void_t<decltype( std::declval<const T&>().secondary_bound() )>> : std::true_type {};
+
+	template <typename T>
+	static constexpr bool has_secondary_bound_v = has_secondary_bound<T>::value;
+}
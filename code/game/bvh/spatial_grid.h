@@ -0,0 +1,815 @@
+#pragma once
+
+#include "spatial_tree_common.h"
+#include "../Assert.h"
+#include <vector>
+#include <cfloat>
+
+// Uniform grid with the same query interface as spatial_tree, for lots of small, similarly sized objects in a bounded
+// world. Every entry lives in exactly one cell, the one holding its center (clamped to the grid), so nothing is ever
+// reported twice. Query ranges grow by the largest half extent inserted so far to catch entries reaching in from
+// neighbouring cells, so objects should be small relative to the cell size. Insert, update and remove are O(1) through
+// the returned handle. Cells keep their bounds SoA and are tested 4 entries at a time.
+template <typename T, size_t D = 2>
+class spatial_grid
+{
+public:
+	typedef T value_type;
+	typedef unsigned handle;
+	static const size_t dimensions = D;
+	static const handle invalid_handle = ~0u;
+
+	spatial_grid( const float ( &worldMins )[D], const float ( &worldMaxs )[D], float cellSize )
+		: invCellSize( 1.0f / cellSize )
+		, freeSlot( invalid_handle )
+		, count( 0 )
+	{
+		size_t cellCount = 1;
+
+		assertfmt( cellSize > 0.0f, "Grid cell size must be positive" );
+
+		for( size_t d = 0; d < D; ++d )
+		{
+			assertfmt( worldMins[d] < worldMaxs[d], "Grid has invalid bounds" );
+
+			origin[d] = worldMins[d];
+			this->cellSize[d] = cellSize;
+			cellDims[d] = std::max( static_cast<unsigned>( std::ceil( ( worldMaxs[d] - worldMins[d] ) * invCellSize ) ), 1u );
+			cellStrides[d] = static_cast<unsigned>( cellCount );
+			maxHalfExtents[d] = 0.0f;
+			cellCount *= cellDims[d];
+		}
+
+		cells.resize( cellCount );
+	}
+
+	handle insert( const T& val, const float ( &newMins )[D], const float ( &newMaxs )[D] )
+	{
+		return Insert( val, newMins, newMaxs );
+	}
+
+	handle insert( T&& val, const float ( &newMins )[D], const float ( &newMaxs )[D] )
+	{
+		return Insert( std::move( val ), newMins, newMaxs );
+	}
+
+	// BoundsGen is void(const T&, float (&outMins)[D], float (&outMaxs)[D]). No handles come back, so use the single
+	// insert for anything that will be updated or removed later.
+	template <typename Iter, typename BoundsGen>
+	void insert( Iter valStart, Iter valEnd, BoundsGen Bounds )
+	{
+		for( ; valStart != valEnd; ++valStart )
+		{
+			float curMins[D];
+			float curMaxs[D];
+
+			Bounds( *valStart, curMins, curMaxs );
+			Insert( *valStart, curMins, curMaxs );
+		}
+	}
+
+	// Moves an entry to new bounds. Only touches the old and new cell.
+	void update( handle entry, const float ( &newMins )[D], const float ( &newMaxs )[D] )
+	{
+		const unsigned newCellIndex = CellOf( newMins, newMaxs );
+		Slot* const slot = &slots[entry];
+
+		assertfmt( slot->cell != invalid_handle, "Updating a removed grid entry" );
+
+		if( slot->cell == newCellIndex )
+		{
+			Cell* const cell = &cells[newCellIndex];
+
+			for( size_t d = 0; d < D; ++d )
+			{
+				assertfmt( newMins[d] <= newMaxs[d], "Object has invalid bounds" );
+				cell->mins[d][slot->index] = newMins[d];
+				cell->maxs[d][slot->index] = newMaxs[d];
+			}
+
+			GrowExtents( newMins, newMaxs );
+		}
+		else
+		{
+			T val = std::move( cells[slot->cell].values[slot->index] );
+
+			EraseEntry( slot->cell, slot->index );
+			AppendEntry( entry, newCellIndex, std::move( val ), newMins, newMaxs );
+		}
+	}
+
+	void remove( handle entry )
+	{
+		Slot* const slot = &slots[entry];
+
+		assertfmt( slot->cell != invalid_handle, "Removing a removed grid entry" );
+
+		EraseEntry( slot->cell, slot->index );
+
+		slot->cell = invalid_handle;
+		slot->index = freeSlot;
+		freeSlot = entry;
+		--count;
+	}
+
+	__forceinline T& operator[]( handle entry )
+	{
+		return cells[slots[entry].cell].values[slots[entry].index];
+	}
+
+	__forceinline const T& operator[]( handle entry ) const
+	{
+		return cells[slots[entry].cell].values[slots[entry].index];
+	}
+
+	// Also resets the half extent used to grow query ranges
+	void clear()
+	{
+		for( Cell& cell : cells )
+		{
+			cell.values.clear();
+			cell.handles.clear();
+
+			for( size_t d = 0; d < D; ++d )
+			{
+				cell.mins[d].clear();
+				cell.maxs[d].clear();
+			}
+		}
+
+		for( size_t d = 0; d < D; ++d )
+			maxHalfExtents[d] = 0.0f;
+
+		slots.clear();
+		freeSlot = invalid_handle;
+		count = 0;
+	}
+
+	__forceinline bool empty() const
+	{
+		return count == 0;
+	}
+
+	__forceinline size_t size() const
+	{
+		return count;
+	}
+
+	void bounds( float* outMins, float* outMaxs ) const
+	{
+		for( size_t d = 0; d < D; ++d )
+		{
+			outMins[d] = FLT_MAX;
+			outMaxs[d] = -FLT_MAX;
+		}
+
+		for( const Cell& cell : cells )
+		{
+			for( size_t d = 0; d < D; ++d )
+			{
+				for( float cellMin : cell.mins[d] )
+					outMins[d] = std::min( outMins[d], cellMin );
+
+				for( float cellMax : cell.maxs[d] )
+					outMaxs[d] = std::max( outMaxs[d], cellMax );
+			}
+		}
+	}
+
+	// Visitor is either R(const T&) or R(const T&, const float (&mins)[D], const float (&maxs)[D]). If R is bool, returning false early outs.
+	template <typename Visitor>
+	void iterate( Visitor VisitFunc ) const
+	{
+		Iterate( this, VisitFunc );
+	}
+
+	// Visitor is either R(T&) or R(T&, const float (&mins)[D], const float (&maxs)[D])
+	template <typename Visitor>
+	void iterate( Visitor VisitFunc )
+	{
+		Iterate( this, VisitFunc );
+	}
+
+	// Query is either R(const T&) or R(const T&, const float (&mins)[D], const float (&maxs)[D]). If R is bool, returning false early outs.
+	template <typename Query>
+	void query( const float* queryMins, const float* queryMaxs, Query QueryFunc ) const
+	{
+		BoxQuery( this, queryMins, queryMaxs, 0.0f, QueryFunc );
+	}
+
+	// Query is either R(T&) or R(T&, const float (&mins)[D], const float (&maxs)[D]). If R is bool, returning false early outs.
+	template <typename Query>
+	void query( const float* queryMins, const float* queryMaxs, Query QueryFunc )
+	{
+		BoxQuery( this, queryMins, queryMaxs, 0.0f, QueryFunc );
+	}
+
+	// Query is either R(const T&) or R(const T&, const float (&mins)[D], const float (&maxs)[D]). If R is bool, returning false early outs.
+	template <typename Query>
+	void query_epsilon( const float* queryMins, const float* queryMaxs, float epsilon, Query QueryFunc ) const
+	{
+		BoxQuery( this, queryMins, queryMaxs, epsilon, QueryFunc );
+	}
+
+	// Query is either R(T&) or R(T&, const float (&mins)[D], const float (&maxs)[D]). If R is bool, returning false early outs.
+	template <typename Query>
+	void query_epsilon( const float* queryMins, const float* queryMaxs, float epsilon, Query QueryFunc )
+	{
+		BoxQuery( this, queryMins, queryMaxs, epsilon, QueryFunc );
+	}
+
+	// Query is either R(T&) or R(T&, const float (&mins)[D], const float (&maxs)[D]). If R is bool, returning false early outs.
+	template<typename Query>
+	void segment_query( const float* start, const float* end, Query QueryFunc )
+	{
+		SegmentQuery( this, start, end, 0.0f, QueryFunc );
+	}
+
+	// Query is either R(const T&) or R(const T&, const float (&mins)[D], const float (&maxs)[D]). If R is bool, returning false early outs.
+	template<typename Query>
+	void segment_query( const float* start, const float* end, Query QueryFunc ) const
+	{
+		SegmentQuery( this, start, end, 0.0f, QueryFunc );
+	}
+
+	// Query is either R(T&) or R(T&, const float (&mins)[D], const float (&maxs)[D]). If R is bool, returning false early outs.
+	template<typename Query>
+	void segment_query_epsilon( const float* start, const float* end, float epsilon, Query QueryFunc )
+	{
+		SegmentQuery( this, start, end, epsilon, QueryFunc );
+	}
+
+	// Query is either R(const T&) or R(const T&, const float (&mins)[D], const float (&maxs)[D]). If R is bool, returning false early outs.
+	template<typename Query>
+	void segment_query_epsilon( const float* start, const float* end, float epsilon, Query QueryFunc ) const
+	{
+		SegmentQuery( this, start, end, epsilon, QueryFunc );
+	}
+
+	// Query is either R(T&) or R(T&, const float (&mins)[D], const float (&maxs)[D]). If R is bool, returning false early outs.
+	template<typename Query>
+	void ray_query( const float* start, const float* dir, Query QueryFunc )
+	{
+		RayQuery<false>( this, start, dir, 0.0f, QueryFunc );
+	}
+
+	// Query is either R(const T&) or R(const T&, const float (&mins)[D], const float (&maxs)[D]). If R is bool, returning false early outs.
+	template<typename Query>
+	void ray_query( const float* start, const float* dir, Query QueryFunc ) const
+	{
+		RayQuery<false>( this, start, dir, 0.0f, QueryFunc );
+	}
+
+	// Query is either R(T&) or R(T&, const float (&mins)[D], const float (&maxs)[D]). If R is bool, returning false early outs.
+	template<typename Query>
+	void ray_query_epsilon( const float* start, const float* dir, float epsilon, Query QueryFunc )
+	{
+		RayQuery<false>( this, start, dir, epsilon, QueryFunc );
+	}
+
+	// Query is either R(const T&) or R(const T&, const float (&mins)[D], const float (&maxs)[D]). If R is bool, returning false early outs.
+	template<typename Query>
+	void ray_query_epsilon( const float* start, const float* dir, float epsilon, Query QueryFunc ) const
+	{
+		RayQuery<false>( this, start, dir, epsilon, QueryFunc );
+	}
+
+	// Clipper is either R(T&, T&) or R(T&, T&, const float (&lhsMins)[D], const float (&lhsMaxs)[D], const float (&rhsMins)[D], const float (&rhsMaxs)[D]). If R is bool, returning false early outs.
+	template <typename Clipper>
+	void self_clip_epsilon( float epsilon, Clipper ClipFunc )
+	{
+		SelfClip( this, epsilon, ClipFunc );
+	}
+
+	// Clipper is either R(const T&, const T&) or R(const T&, const T&, const float (&lhsMins)[D], const float (&lhsMaxs)[D], const float (&rhsMins)[D], const float (&rhsMaxs)[D]). If R is bool, returning false early outs.
+	template <typename Clipper>
+	void self_clip_epsilon( float epsilon, Clipper ClipFunc ) const
+	{
+		SelfClip( this, epsilon, ClipFunc );
+	}
+
+	// Clipper is either R(T&, T&) or R(T&, T&, const float (&lhsMins)[D], const float (&lhsMaxs)[D], const float (&rhsMins)[D], const float (&rhsMaxs)[D]). If R is bool, returning false early outs.
+	template <typename Clipper>
+	void self_clip( Clipper ClipFunc )
+	{
+		SelfClip( this, 0.0f, ClipFunc );
+	}
+
+	// Clipper is either R(const T&, const T&) or R(const T&, const T&, const float (&lhsMins)[D], const float (&lhsMaxs)[D], const float (&rhsMins)[D], const float (&rhsMaxs)[D]). If R is bool, returning false early outs.
+	template <typename Clipper>
+	void self_clip( Clipper ClipFunc ) const
+	{
+		SelfClip( this, 0.0f, ClipFunc );
+	}
+
+private:
+	struct Cell
+	{
+		std::vector<T> values;
+		std::vector<handle> handles;
+		std::vector<float> mins[D];
+		std::vector<float> maxs[D];
+	};
+
+	// Live slots point at a cell entry, free slots have cell == invalid_handle and index is the next free slot
+	struct Slot
+	{
+		unsigned cell;
+		unsigned index;
+	};
+
+	float origin[D];
+	float cellSize[D];
+	float invCellSize;
+	unsigned cellDims[D];
+	unsigned cellStrides[D];
+	float maxHalfExtents[D];
+
+	std::vector<Cell> cells;
+	std::vector<Slot> slots;
+	handle freeSlot;
+	size_t count;
+
+	template <typename V>
+	handle Insert( V&& val, const float ( &newMins )[D], const float ( &newMaxs )[D] )
+	{
+		handle entry;
+
+		if( freeSlot != invalid_handle )
+		{
+			entry = freeSlot;
+			freeSlot = slots[entry].index;
+		}
+		else
+		{
+			entry = static_cast<handle>( slots.size() );
+			slots.emplace_back();
+		}
+
+		AppendEntry( entry, CellOf( newMins, newMaxs ), std::forward<V>( val ), newMins, newMaxs );
+		++count;
+
+		return entry;
+	}
+
+	template <typename V>
+	void AppendEntry( handle entry, unsigned cellIndex, V&& val, const float ( &newMins )[D], const float ( &newMaxs )[D] )
+	{
+		Cell* const cell = &cells[cellIndex];
+		Slot* const slot = &slots[entry];
+
+		slot->cell = cellIndex;
+		slot->index = static_cast<unsigned>( cell->values.size() );
+
+		cell->values.emplace_back( std::forward<V>( val ) );
+		cell->handles.push_back( entry );
+
+		for( size_t d = 0; d < D; ++d )
+		{
+			assertfmt( newMins[d] <= newMaxs[d], "Object has invalid bounds" );
+			cell->mins[d].push_back( newMins[d] );
+			cell->maxs[d].push_back( newMaxs[d] );
+		}
+
+		GrowExtents( newMins, newMaxs );
+	}
+
+	// Swaps the cell's last entry into the hole
+	void EraseEntry( unsigned cellIndex, unsigned entryIndex )
+	{
+		Cell* const cell = &cells[cellIndex];
+		const unsigned lastIndex = static_cast<unsigned>( cell->values.size() - 1 );
+
+		if( entryIndex != lastIndex )
+		{
+			const handle moved = cell->handles[lastIndex];
+
+			cell->values[entryIndex] = std::move( cell->values[lastIndex] );
+			cell->handles[entryIndex] = moved;
+
+			for( size_t d = 0; d < D; ++d )
+			{
+				cell->mins[d][entryIndex] = cell->mins[d][lastIndex];
+				cell->maxs[d][entryIndex] = cell->maxs[d][lastIndex];
+			}
+
+			slots[moved].index = entryIndex;
+		}
+
+		cell->values.pop_back();
+		cell->handles.pop_back();
+
+		for( size_t d = 0; d < D; ++d )
+		{
+			cell->mins[d].pop_back();
+			cell->maxs[d].pop_back();
+		}
+	}
+
+	void GrowExtents( const float ( &newMins )[D], const float ( &newMaxs )[D] )
+	{
+		for( size_t d = 0; d < D; ++d )
+			maxHalfExtents[d] = std::max( maxHalfExtents[d], ( newMaxs[d] - newMins[d] ) * 0.5f );
+	}
+
+	__forceinline unsigned CellCoord( float pos, size_t d ) const
+	{
+		const float cellPos = ( pos - origin[d] ) * invCellSize;
+
+		return static_cast<unsigned>( std::min( std::max( cellPos, 0.0f ), static_cast<float>( cellDims[d] - 1 ) ) );
+	}
+
+	unsigned CellOf( const float ( &entryMins )[D], const float ( &entryMaxs )[D] ) const
+	{
+		unsigned cellIndex = 0;
+
+		for( size_t d = 0; d < D; ++d )
+			cellIndex += CellCoord( ( entryMins[d] + entryMaxs[d] ) * 0.5f, d ) * cellStrides[d];
+
+		return cellIndex;
+	}
+
+	// Inclusive range of cells whose entries may overlap the box
+	void CellRange( const float* rangeMins, const float* rangeMaxs, float epsilon, unsigned ( *outLo )[D], unsigned ( *outHi )[D] ) const
+	{
+		for( size_t d = 0; d < D; ++d )
+		{
+			( *outLo )[d] = CellCoord( rangeMins[d] - epsilon - maxHalfExtents[d], d );
+			( *outHi )[d] = CellCoord( rangeMaxs[d] + epsilon + maxHalfExtents[d], d );
+		}
+	}
+
+	// Loose bounds of everything stored in a cell. Border cells also hold whatever was clamped in from outside the grid.
+	void CellBounds( const unsigned ( &coord )[D], float ( *outMins )[D], float ( *outMaxs )[D] ) const
+	{
+		for( size_t d = 0; d < D; ++d )
+		{
+			( *outMins )[d] = coord[d] == 0 ? -INFINITY : origin[d] + coord[d] * cellSize[d] - maxHalfExtents[d];
+			( *outMaxs )[d] = coord[d] == cellDims[d] - 1 ? INFINITY : origin[d] + ( coord[d] + 1 ) * cellSize[d] + maxHalfExtents[d];
+		}
+	}
+
+	// Calls CellFunc( cellIndex, coord ) for every cell in [lo, hi]. Returns false if CellFunc early outs.
+	template <typename CellFunc>
+	bool ForEachCell( const unsigned ( &lo )[D], const unsigned ( &hi )[D], CellFunc&& CellCallback ) const
+	{
+		unsigned coord[D];
+
+		for( size_t d = 0; d < D; ++d )
+			coord[d] = lo[d];
+
+		for( ;; )
+		{
+			unsigned cellIndex = 0;
+			size_t d;
+
+			for( d = 0; d < D; ++d )
+				cellIndex += coord[d] * cellStrides[d];
+
+			if( !CellCallback( cellIndex, static_cast<const unsigned( & )[D]>( coord ) ) )
+				return false;
+
+			for( d = 0; d < D; ++d )
+			{
+				if( coord[d] < hi[d] )
+				{
+					++coord[d];
+					break;
+				}
+
+				coord[d] = lo[d];
+			}
+
+			if( d == D )
+				return true;
+		}
+	}
+
+	static __forceinline __m128 LoadBatch( const std::vector<float>& vals, unsigned batchStart, unsigned entryCount )
+	{
+		if( batchStart + 4 <= entryCount )
+			return _mm_loadu_ps( vals.data() + batchStart );
+
+		alignas( 16 ) float tail[4] = {};
+
+		for( unsigned entryIndex = batchStart; entryIndex < entryCount; ++entryIndex )
+			tail[entryIndex - batchStart] = vals[entryIndex];
+
+		return _mm_load_ps( tail );
+	}
+
+	// Runs BatchTest over the cell's entries from firstEntry on, 4 at a time, and calls EntryCallback( entryIndex ) for
+	// every set lane. Returns false if EntryCallback early outs.
+	template <typename CellT, typename BatchFunc, typename EntryFunc>
+	static bool ForEachEntryHit( CellT* cell, unsigned firstEntry, BatchFunc&& BatchTest, EntryFunc&& EntryCallback )
+	{
+		const unsigned entryCount = static_cast<unsigned>( cell->values.size() );
+
+		for( unsigned batchStart = firstEntry; batchStart < entryCount; batchStart += 4 )
+		{
+			int hits = _mm_movemask_ps( BatchTest( *cell, batchStart, entryCount ) );
+
+			if( entryCount - batchStart < 4 )
+				hits &= ( 1 << ( entryCount - batchStart ) ) - 1;
+
+			for( unsigned lane = 0; hits; ++lane, hits >>= 1 )
+				if( ( hits & 1 ) && !EntryCallback( batchStart + lane ) )
+					return false;
+		}
+
+		return true;
+	}
+
+	static __forceinline __m128 BoxBatch( const Cell& cell, unsigned batchStart, unsigned entryCount, const __m128 ( &sseQueryMins )[D], const __m128 ( &sseQueryMaxs )[D] )
+	{
+		__m128 sseHits = _mm_castsi128_ps( _mm_set1_epi32( -1 ) );
+
+		for( size_t d = 0; d < D; ++d )
+		{
+			const __m128 sseMinOk = _mm_cmpge_ps( LoadBatch( cell.maxs[d], batchStart, entryCount ), sseQueryMins[d] );
+			const __m128 sseMaxOk = _mm_cmple_ps( LoadBatch( cell.mins[d], batchStart, entryCount ), sseQueryMaxs[d] );
+
+			sseHits = _mm_and_ps( sseHits, _mm_and_ps( sseMinOk, sseMaxOk ) );
+		}
+
+		return sseHits;
+	}
+
+	// Same slab test as the tree's GatherRayIntersections
+	template <bool ClampEnd>
+	static __forceinline __m128 RayBatch( const Cell& cell, unsigned batchStart, unsigned entryCount, const float* start, const float* invDir, float epsilon )
+	{
+		const __m128 sseEpsilon = _mm_set1_ps( epsilon );
+		__m128 sseTMin = _mm_setzero_ps();
+		__m128 sseTMax = _mm_set1_ps( ClampEnd ? 1.0f : INFINITY );
+
+		for( size_t d = 0; d < D; ++d )
+		{
+			const __m128 sseStart = _mm_set1_ps( start[d] );
+			const __m128 sseInvDir = _mm_set1_ps( invDir[d] );
+			const __m128 sseMins = _mm_sub_ps( LoadBatch( cell.mins[d], batchStart, entryCount ), sseEpsilon );
+			const __m128 sseMaxs = _mm_add_ps( LoadBatch( cell.maxs[d], batchStart, entryCount ), sseEpsilon );
+			const __m128 sseTEnter = _mm_mul_ps( _mm_sub_ps( sseMins, sseStart ), sseInvDir );
+			const __m128 sseTExit = _mm_mul_ps( _mm_sub_ps( sseMaxs, sseStart ), sseInvDir );
+
+			sseTMin = _mm_max_ps( _mm_min_ps( sseTEnter, sseTExit ), sseTMin );
+			sseTMax = _mm_min_ps( _mm_max_ps( sseTEnter, sseTExit ), sseTMax );
+		}
+
+		return _mm_cmpge_ps( sseTMax, sseTMin );
+	}
+
+	template <typename CellT>
+	static __forceinline void GatherBounds( CellT* cell, unsigned entryIndex, float ( *outMins )[D], float ( *outMaxs )[D] )
+	{
+		for( size_t d = 0; d < D; ++d )
+		{
+			( *outMins )[d] = cell->mins[d][entryIndex];
+			( *outMaxs )[d] = cell->maxs[d][entryIndex];
+		}
+	}
+
+	template <typename QueryFunc, typename CellT>
+	static __forceinline bool InvokeQuery( QueryFunc& QueryCallback, CellT* cell, unsigned entryIndex )
+	{
+		using namespace spatial_tree_common;
+
+		if constexpr ( func_traits<QueryFunc>::arity == 3 )
+		{
+			float entryMins[D];
+			float entryMaxs[D];
+
+			GatherBounds( cell, entryIndex, &entryMins, &entryMaxs );
+
+			if constexpr ( std::is_same_v<func_traits<QueryFunc>::return_type, bool> )
+				return QueryCallback( cell->values[entryIndex], entryMins, entryMaxs );
+			else
+				QueryCallback( cell->values[entryIndex], entryMins, entryMaxs );
+		}
+		else
+		{
+			if constexpr ( std::is_same_v<func_traits<QueryFunc>::return_type, bool> )
+				return QueryCallback( cell->values[entryIndex] );
+			else
+				QueryCallback( cell->values[entryIndex] );
+		}
+
+		return true;
+	}
+
+	template <typename ClipFunc, typename CellT>
+	static __forceinline bool InvokeClip( ClipFunc& ClipCallback, CellT* lhsCell, unsigned lhsIndex, CellT* rhsCell, unsigned rhsIndex )
+	{
+		using namespace spatial_tree_common;
+
+		if constexpr ( func_traits<ClipFunc>::arity == 6 )
+		{
+			float lhsMins[D];
+			float lhsMaxs[D];
+			float rhsMins[D];
+			float rhsMaxs[D];
+
+			GatherBounds( lhsCell, lhsIndex, &lhsMins, &lhsMaxs );
+			GatherBounds( rhsCell, rhsIndex, &rhsMins, &rhsMaxs );
+
+			if constexpr ( std::is_same_v<func_traits<ClipFunc>::return_type, bool> )
+				return ClipCallback( lhsCell->values[lhsIndex], rhsCell->values[rhsIndex], lhsMins, lhsMaxs, rhsMins, rhsMaxs );
+			else
+				ClipCallback( lhsCell->values[lhsIndex], rhsCell->values[rhsIndex], lhsMins, lhsMaxs, rhsMins, rhsMaxs );
+		}
+		else
+		{
+			if constexpr ( std::is_same_v<func_traits<ClipFunc>::return_type, bool> )
+				return ClipCallback( lhsCell->values[lhsIndex], rhsCell->values[rhsIndex] );
+			else
+				ClipCallback( lhsCell->values[lhsIndex], rhsCell->values[rhsIndex] );
+		}
+
+		return true;
+	}
+
+	// Grid is spatial_grid or const spatial_grid, so callbacks get T& or const T& to match
+	template <typename Grid, typename VisitFunc>
+	static void Iterate( Grid* grid, VisitFunc& VisitCallback )
+	{
+		for( auto& cell : grid->cells )
+			for( unsigned entryIndex = 0; entryIndex < cell.values.size(); ++entryIndex )
+				if( !InvokeQuery( VisitCallback, &cell, entryIndex ) )
+					return;
+	}
+
+	template <typename Grid, typename QueryFunc>
+	static void BoxQuery( Grid* grid, const float* queryMins, const float* queryMaxs, float epsilon, QueryFunc& QueryCallback )
+	{
+		unsigned lo[D];
+		unsigned hi[D];
+		__m128 sseQueryMins[D];
+		__m128 sseQueryMaxs[D];
+
+		for( size_t d = 0; d < D; ++d )
+		{
+			sseQueryMins[d] = _mm_set1_ps( queryMins[d] - epsilon );
+			sseQueryMaxs[d] = _mm_set1_ps( queryMaxs[d] + epsilon );
+		}
+
+		grid->CellRange( queryMins, queryMaxs, epsilon, &lo, &hi );
+		grid->ForEachCell( lo, hi, [&]( unsigned cellIndex, const unsigned ( & )[D] )
+		{
+			auto* const cell = &grid->cells[cellIndex];
+
+			return ForEachEntryHit( cell, 0, [&]( const Cell& batchCell, unsigned batchStart, unsigned entryCount )
+			{
+				return BoxBatch( batchCell, batchStart, entryCount, sseQueryMins, sseQueryMaxs );
+			}, [&]( unsigned entryIndex )
+			{
+				return InvokeQuery( QueryCallback, cell, entryIndex );
+			} );
+		} );
+	}
+
+	// Walks the lines of cells along axis 0 inside the ray's bounding range. The ray's t range within a line's loose
+	// bounds on the other axes gives the span of axis 0 cells it can touch, so only the ray's footprint is visited.
+	template <bool ClampEnd, typename Grid, typename QueryFunc>
+	static void RayQuery( Grid* grid, const float* start, const float* dir, float epsilon, QueryFunc& QueryCallback )
+	{
+		const float tMax = ClampEnd ? 1.0f : INFINITY;
+		float invDir[D];
+		float rangeMins[D];
+		float rangeMaxs[D];
+		unsigned lo[D];
+		unsigned hi[D];
+
+		for( size_t d = 0; d < D; ++d )
+		{
+			const float end = dir[d] == 0.0f ? start[d] : start[d] + dir[d] * tMax;
+
+			invDir[d] = 1.0f / dir[d];
+			rangeMins[d] = std::min( start[d], end );
+			rangeMaxs[d] = std::max( start[d], end );
+		}
+
+		grid->CellRange( rangeMins, rangeMaxs, epsilon, &lo, &hi );
+		hi[0] = lo[0];
+
+		grid->ForEachCell( lo, hi, [&]( unsigned lineIndex, const unsigned ( &coord )[D] )
+		{
+			float lineMins[D];
+			float lineMaxs[D];
+			float tEnter = 0.0f;
+			float tExit = tMax;
+
+			grid->CellBounds( coord, &lineMins, &lineMaxs );
+
+			for( size_t d = 1; d < D; ++d )
+			{
+				const float slabMin = lineMins[d] - epsilon;
+				const float slabMax = lineMaxs[d] + epsilon;
+
+				if( dir[d] == 0.0f )
+				{
+					if( start[d] < slabMin || start[d] > slabMax )
+						return true;
+				}
+				else
+				{
+					const float t0 = ( slabMin - start[d] ) * invDir[d];
+					const float t1 = ( slabMax - start[d] ) * invDir[d];
+
+					tEnter = std::max( tEnter, std::min( t0, t1 ) );
+					tExit = std::min( tExit, std::max( t0, t1 ) );
+				}
+			}
+
+			if( tExit < tEnter )
+				return true;
+
+			const float enterPos = dir[0] == 0.0f ? start[0] : start[0] + dir[0] * tEnter;
+			const float exitPos = dir[0] == 0.0f ? start[0] : start[0] + dir[0] * tExit;
+			const unsigned firstCell = grid->CellCoord( std::min( enterPos, exitPos ) - epsilon - grid->maxHalfExtents[0], 0 );
+			const unsigned lastCell = grid->CellCoord( std::max( enterPos, exitPos ) + epsilon + grid->maxHalfExtents[0], 0 );
+
+			for( unsigned cellIndex = lineIndex + firstCell - coord[0]; cellIndex <= lineIndex + lastCell - coord[0]; ++cellIndex )
+			{
+				auto* const cell = &grid->cells[cellIndex];
+
+				const bool keepGoing = ForEachEntryHit( cell, 0, [&]( const Cell& batchCell, unsigned batchStart, unsigned entryCount )
+				{
+					return RayBatch<ClampEnd>( batchCell, batchStart, entryCount, start, invDir, epsilon );
+				}, [&]( unsigned entryIndex )
+				{
+					return InvokeQuery( QueryCallback, cell, entryIndex );
+				} );
+
+				if( !keepGoing )
+					return false;
+			}
+
+			return true;
+		} );
+	}
+
+	template <typename Grid, typename QueryFunc>
+	static void SegmentQuery( Grid* grid, const float* start, const float* end, float epsilon, QueryFunc& QueryCallback )
+	{
+		float dir[D];
+
+		for( size_t d = 0; d < D; ++d )
+			dir[d] = end[d] - start[d];
+
+		RayQuery<true>( grid, start, dir, epsilon, QueryCallback );
+	}
+
+	// Each entry is tested against the rest of its own cell after itself and every later cell in its range, so each
+	// overlapping pair is reported once
+	template <typename Grid, typename ClipFunc>
+	static void SelfClip( Grid* grid, float epsilon, ClipFunc& ClipCallback )
+	{
+		const unsigned cellCount = static_cast<unsigned>( grid->cells.size() );
+
+		for( unsigned cellIndex = 0; cellIndex < cellCount; ++cellIndex )
+		{
+			auto* const cell = &grid->cells[cellIndex];
+			const unsigned entryCount = static_cast<unsigned>( cell->values.size() );
+
+			for( unsigned entryIndex = 0; entryIndex < entryCount; ++entryIndex )
+			{
+				float entryMins[D];
+				float entryMaxs[D];
+				unsigned lo[D];
+				unsigned hi[D];
+				__m128 sseQueryMins[D];
+				__m128 sseQueryMaxs[D];
+
+				GatherBounds( cell, entryIndex, &entryMins, &entryMaxs );
+
+				for( size_t d = 0; d < D; ++d )
+				{
+					sseQueryMins[d] = _mm_set1_ps( entryMins[d] - epsilon );
+					sseQueryMaxs[d] = _mm_set1_ps( entryMaxs[d] + epsilon );
+				}
+
+				grid->CellRange( entryMins, entryMaxs, epsilon, &lo, &hi );
+
+				const bool keepGoing = grid->ForEachCell( lo, hi, [&]( unsigned otherCellIndex, const unsigned ( & )[D] )
+				{
+					if( otherCellIndex < cellIndex )
+						return true;
+
+					auto* const otherCell = &grid->cells[otherCellIndex];
+					const unsigned firstOther = otherCellIndex == cellIndex ? entryIndex + 1 : 0;
+
+					return ForEachEntryHit( otherCell, firstOther, [&]( const Cell& batchCell, unsigned batchStart, unsigned otherCount )
+					{
+						return BoxBatch( batchCell, batchStart, otherCount, sseQueryMins, sseQueryMaxs );
+					}, [&]( unsigned otherIndex )
+					{
+						return InvokeClip( ClipCallback, cell, entryIndex, otherCell, otherIndex );
+					} );
+				} );
+
+				if( !keepGoing )
+					return;
+			}
+		}
+	}
+};
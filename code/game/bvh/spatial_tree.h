@@ -4,6 +4,7 @@
 #include "box_partitioner.h"
 #include "Assert.h"
 #include <iterator>
+#include <vector>
 
 #ifndef DEBUG_CONTAINERS
 #if defined( DEBUG ) || defined( _DEBUG )
@@ -13,6 +14,8 @@
 #endif //#else //#if defined(DEBUG) || defined(_DEBUG)
 #endif //#ifndef DEBUG_CONTAINERS
 
+// D runs 1 to 4. At 4, index swept bounds with time on the last axis, scaled so a unit of time is about as far as
+// things move in it, and query with the time window as the last axis' range.
 template <typename T, size_t D = 3, size_t MAX_NODES = 16>
 class spatial_tree
 {
@@ -30,6 +33,7 @@ private:
 
 	unsigned char containsLeaves;
 	unsigned char childCount;
+	unsigned char pooledChildren; // Children live in a compact() block, sized exactly to childCount
 
 	union
 	{
@@ -60,17 +64,45 @@ public:
 		MAX_VECTOR_ALIGNMENT = 64,
 	};
 
+	// Partition means kept from one build and replayed to the next, so a tree rebuilt every frame from a coherent scene
+	// starts each node's k-means where the last frame's ended instead of seeding from scratch. Nodes are matched up by
+	// the order they're built in, which holds as long as the tree keeps roughly the same shape. A mismatch only costs
+	// iterations.
+	class build_seeds
+	{
+	public:
+		void clear()
+		{
+			nodeSeeds.clear();
+		}
+
+	private:
+		friend class spatial_tree;
+
+		struct NodeSeed
+		{
+			float means[D][MAX_NODES];
+			unsigned k;
+			bool valid;
+		};
+
+		std::vector<NodeSeed> nodeSeeds;
+		size_t nextSeed = 0;
+	};
+
 	spatial_tree()
 		: mins{}
 		, maxs{}
 		, containsLeaves( 0 )
 		, childCount( 0 )
+		, pooledChildren( 0 )
 		, children( { nullptr } )
 	{
 	}
 
+	// method is how every node's leaves are partitioned, see PartitionMethod. Balanced bounds the depth for clustered leaves.
 	template <typename Iter, typename BoundsGen>
-	spatial_tree( Iter start, Iter end, BoundsGen BoundsGenerator )
+	spatial_tree( Iter start, Iter end, BoundsGen BoundsGenerator, build_seeds* seeds = nullptr, PartitionMethod method = PartitionMethod::Exhaustive )
 		: spatial_tree()
 	{
 		using namespace spatial_tree_common;
@@ -97,23 +129,15 @@ public:
 			leafMaxs[d] = WorkMemAlloc<float>( leafCount, &workMemPtr );
 		}
 
-		for( unsigned leafIndex = 0; start != end; ++start, ++leafIndex )
-		{
-			float curMins[D];
-			float curMaxs[D];
+		GatherLeaves( start, end, std::forward<BoundsGen>( BoundsGenerator ), leafPtrs, leafMins, leafMaxs );
 
-			leafPtrs[leafIndex] = get_temporary_address( *start );
-			BoundsGenerator( *start, curMins, curMaxs );
+		if( seeds )
+			seeds->nextSeed = 0;
 
-			for( unsigned d = 0; d < D; ++d )
-			{
-				assertfmt( curMins[d] <= curMaxs[d], "Object has invalid bounds" );
-				leafMins[d][leafIndex] = curMins[d];
-				leafMaxs[d][leafIndex] = curMaxs[d];
-			}
-		}
+		LoadNode( this, leafPtrs, leafMins, leafMaxs, leafCount, workMemPtr, seeds, method );
 
-		LoadNode( this, leafPtrs, leafMins, leafMaxs, leafCount, workMemPtr );
+		if( seeds )
+			seeds->nodeSeeds.resize( seeds->nextSeed );
 
 		size_t workMemUsed = static_cast<size_t>( (char*)workMemPtr - (char*)workMem );
 		assert( workMemUsed <= workMemSize );
@@ -123,8 +147,10 @@ public:
 	spatial_tree( spatial_tree&& rhs )
 		: childCount( rhs.childCount )
 		, containsLeaves( rhs.containsLeaves )
+		, pooledChildren( rhs.pooledChildren )
 	{
 		rhs.childCount = 0;
+		rhs.pooledChildren = 0;
 
 		children.data = rhs.children.data;
 		rhs.children.data = nullptr;
@@ -138,6 +164,7 @@ public:
 
 	spatial_tree( const spatial_tree& rhs )
 		: childCount( 0 )
+		, pooledChildren( 0 )
 		, children( { 0 } )
 	{
 		*this = rhs;
@@ -146,6 +173,7 @@ public:
 	template <typename Tree>
 	spatial_tree( const Tree& rhs )
 		: childCount( 0 )
+		, pooledChildren( 0 )
 		, children( { 0 } )
 	{
 		*this = rhs;
@@ -164,6 +192,7 @@ public:
 
 			childCount = rhs.childCount;
 			containsLeaves = rhs.containsLeaves;
+			pooledChildren = rhs.pooledChildren;
 			children.data = rhs.children.data;
 
 			for( size_t d = 0; d < D; ++d )
@@ -173,6 +202,7 @@ public:
 			}
 
 			rhs.childCount = 0;
+			rhs.pooledChildren = 0;
 			rhs.children.data = nullptr;
 		}
 
@@ -256,12 +286,51 @@ public:
 			Split( newMins, newMaxs, &val );
 	}
 
+	// Distributes the new leaves top down through the existing branches, only re-partitioning leaf nodes which overflow.
 	template <typename Iter, typename BoundsGen>
 	void insert( Iter valStart, Iter valEnd, BoundsGen Bounds )
 	{
-		spatial_tree bulkTree( valStart, valEnd, Bounds );
+		using namespace spatial_tree_common;
+		typedef typename std::iterator_traits<Iter>::reference IterRef;
+		static const bool IterIsRValue = std::is_rvalue_reference_v<IterRef>;
+		typedef typename std::conditional<IterIsRValue, T, const T>::type LT;
+
+		const unsigned leafCount = static_cast<unsigned>( valEnd - valStart );
+
+		if( leafCount == 0 )
+			return;
+
+		if( childCount == 0 )
+		{
+			*this = spatial_tree( valStart, valEnd, std::forward<BoundsGen>( Bounds ) );
+			return;
+		}
+
+		const size_t scratchSize = BulkInsertScratchSize<LT>( leafCount );
+		size_t workMemSize;
+		void* const workMem = AllocWorkMem( leafCount, &workMemSize, scratchSize );
+		void* workMemPtr = workMem;
+
+		float* leafMins[D];
+		float* leafMaxs[D];
+		LT** leafPtrs = WorkMemAlloc<LT*>( leafCount, &workMemPtr );
+
+		for( unsigned d = 0; d < D; ++d )
+		{
+			leafMins[d] = WorkMemAlloc<float>( leafCount, &workMemPtr );
+			leafMaxs[d] = WorkMemAlloc<float>( leafCount, &workMemPtr );
+		}
+
+		GatherLeaves( valStart, valEnd, std::forward<BoundsGen>( Bounds ), leafPtrs, leafMins, leafMaxs );
 
-		merge( std::move( bulkTree ) );
+		void* const scratchMem = workMemPtr;
+		workMemPtr = reinterpret_cast<char*>( workMemPtr ) + scratchSize;
+
+		BulkInsert_r( this, leafPtrs, leafMins, leafMaxs, leafCount, scratchMem, workMemPtr );
+
+		size_t workMemUsed = static_cast<size_t>( (char*)workMemPtr - (char*)workMem );
+		assert( workMemUsed <= workMemSize );
+		FreeWorkMem( workMem );
 	}
 
 	template <typename Tree>
@@ -348,6 +417,22 @@ public:
 		tree_op::Query( this, queryMins, queryMaxs, epsilon, std::forward<Query>( QueryFunc ) );
 	}
 	
+	// Subtree is R(spatial_tree&), called instead of visiting the leaves of any subtree lying entirely inside the query box.
+	// Query is either R(T&) or R(T&, const float (&mins)[D], const float (&maxs)[D]) for the remaining leaves. If R is bool, returning false early outs.
+	template <typename Subtree, typename Query>
+	void query_subtrees( const float* queryMins, const float* queryMaxs, Subtree SubtreeFunc, Query QueryFunc )
+	{
+		tree_op::SubtreeQuery( this, queryMins, queryMaxs, 0.0f, std::forward<Subtree>( SubtreeFunc ), std::forward<Query>( QueryFunc ) );
+	}
+
+	// Subtree is R(const spatial_tree&), called instead of visiting the leaves of any subtree lying entirely inside the query box.
+	// Query is either R(const T&) or R(const T&, const float (&mins)[D], const float (&maxs)[D]) for the remaining leaves. If R is bool, returning false early outs.
+	template <typename Subtree, typename Query>
+	void query_subtrees( const float* queryMins, const float* queryMaxs, Subtree SubtreeFunc, Query QueryFunc ) const
+	{
+		tree_op::SubtreeQuery( *this, queryMins, queryMaxs, 0.0f, std::forward<Subtree>( SubtreeFunc ), std::forward<Query>( QueryFunc ) );
+	}
+
 	// Query is either R(T&) or R(T&, const float (&mins)[D], const float (&maxs)[D]). If R is bool, returning false early outs.
 	template<typename Query>
 	void segment_query( const float* start, const float* end, Query QueryFunc )
@@ -405,28 +490,28 @@ public:
 	}
 	
 	// Query is either R(T&) or R(T&, const float (&mins)[3], const float (&maxs)[3]). If R is bool, returning false early outs.
-	template<typename Query, typename = std::enable_if_t<D == 3>>
+	template<typename Query, size_t DD = D, typename = std::enable_if_t<DD == 3>>
 	void planar_query( const float ( &plane )[4], Query QueryFunc )
 	{
 		tree_op::PlanarQuery( this, plane, 0.0f, std::forward<Query>( QueryFunc ) );
 	}
 	
 	// Query is either R(const T&) or R(const T&, const float (&mins)[3], const float (&maxs)[3]). If R is bool, returning false early outs.
-	template<typename Query, typename = std::enable_if_t<D == 3>>
+	template<typename Query, size_t DD = D, typename = std::enable_if_t<DD == 3>>
 	void planar_query( const float ( &plane )[4], Query QueryFunc ) const
 	{
 		tree_op::PlanarQuery( *this, plane, 0.0f, std::forward<Query>( QueryFunc ) );
 	}
 	
 	// Query is either R(T&) or R(T&, const float (&mins)[3], const float (&maxs)[3]). If R is bool, returning false early outs.
-	template<typename Query, typename = std::enable_if_t<D == 3>>
+	template<typename Query, size_t DD = D, typename = std::enable_if_t<DD == 3>>
 	void planar_query_epsilon( const float ( &plane )[4], float epsilon, Query QueryFunc )
 	{
 		tree_op::PlanarQuery( this, plane, epsilon, std::forward<Query>( QueryFunc ) );
 	}
 	
 	// Query is either R(const T&) or R(const T&, const float (&mins)[3], const float (&maxs)[3]). If R is bool, returning false early outs.
-	template<typename Query, typename = std::enable_if_t<D == 3>>
+	template<typename Query, size_t DD = D, typename = std::enable_if_t<DD == 3>>
 	void planar_query_epsilon( const float ( &plane )[4], float epsilon, Query QueryFunc ) const
 	{
 		tree_op::PlanarQuery( *this, plane, epsilon, std::forward<Query>( QueryFunc ) );
@@ -536,6 +621,32 @@ public:
 		return tree_op::Size( *this );
 	}
 
+	// Rewrites every child array into a single block in depth first order, restoring traversal locality after many
+	// inserts and merges. Leaves are moved in place, so tree shape and iteration order are unchanged. Nodes modified
+	// afterwards fall back to regular allocations. Returns the number of bytes reclaimed.
+	size_t compact()
+	{
+		if( !childCount )
+			return 0;
+
+		const size_t alignment = PoolArrayAlignment();
+		size_t oldBytes = 0;
+		size_t newBytes = PoolRoundUp( sizeof( NodePool ) );
+
+		CompactMeasure_r( this, &oldBytes, &newBytes );
+
+		NodePool* const pool = reinterpret_cast<NodePool*>( _aligned_malloc( newBytes, alignment ) );
+		char* cursor = reinterpret_cast<char*>( pool ) + PoolRoundUp( sizeof( NodePool ) );
+
+		pool->liveArrays = 0;
+		pool->size = newBytes;
+
+		Compact_r( this, pool, &cursor );
+
+		assert( static_cast<size_t>( cursor - reinterpret_cast<char*>( pool ) ) == newBytes );
+		return oldBytes > newBytes ? oldBytes - newBytes : 0;
+	}
+
 	__forceinline const spatial_tree& subtree( unsigned childIndex ) const
 	{
 		return children.branches[childIndex];
@@ -570,24 +681,77 @@ private:
 	__forceinline void AllocateLeaves( unsigned /*count*/ )
 	{
 		children.leaves = new LeafStorage[MAX_NODES];
+		pooledChildren = 0;
 	}
 
 	__forceinline void AllocateBranches( unsigned /*count*/ )
 	{
 		children.branches = new spatial_tree[MAX_NODES];
+		pooledChildren = 0;
 	}
 
 	void FreeChildren()
 	{
-		if( containsLeaves )
+		if( pooledChildren )
+		{
+			if( !containsLeaves )
+			{
+				for( unsigned childIndex = 0; childIndex < childCount; ++childIndex )
+					children.branches[childIndex].~spatial_tree();
+			}
+
+			ReleasePoolArray( children.data );
+		}
+		else if( containsLeaves )
 			delete[] children.leaves;
 		else
 			delete[] children.branches;
 
 		childCount = 0;
+		pooledChildren = 0;
 		children.data = nullptr;
 	}
 
+	// Pooled child arrays have no spare slots. Call before adding a child.
+	__forceinline void ReserveChild()
+	{
+		if( pooledChildren )
+			UnpoolChildren();
+	}
+
+	void UnpoolChildren()
+	{
+		void* const pooledArray = children.data;
+
+		if( containsLeaves )
+		{
+			LeafStorage* const leaves = new LeafStorage[MAX_NODES];
+
+			for( unsigned childIndex = 0; childIndex < childCount; ++childIndex )
+			{
+				new( leaves + childIndex ) T( std::move( leaf( childIndex ) ) );
+				DestructLeaf( childIndex );
+			}
+
+			children.leaves = leaves;
+		}
+		else
+		{
+			spatial_tree* const branches = new spatial_tree[MAX_NODES];
+
+			for( unsigned childIndex = 0; childIndex < childCount; ++childIndex )
+			{
+				branches[childIndex] = std::move( children.branches[childIndex] );
+				reinterpret_cast<spatial_tree*>( pooledArray )[childIndex].~spatial_tree();
+			}
+
+			children.branches = branches;
+		}
+
+		pooledChildren = 0;
+		ReleasePoolArray( pooledArray );
+	}
+
 	void DestructAndFreeChildren()
 	{
 		if( containsLeaves )
@@ -650,6 +814,7 @@ private:
 		{
 			if( rhs->leaf_branch() && childCount + rhs->child_count() <= MAX_NODES )
 			{
+				ReserveChild();
 				for( uint rhsChildIndex = 0; rhsChildIndex < rhs->child_count(); ++rhsChildIndex )
 				{
 					ConstructLeaf( childCount, std::move( rhs->leaf( rhsChildIndex ) ) );
@@ -690,6 +855,7 @@ private:
 				mergeIndex = static_cast<unsigned>( maxOverlapPtr - overlapPercent );
 			else if( childCount < MAX_NODES )
 			{
+				ReserveChild();
 				spatial_tree* const newBranch = &children.branches[childCount];
 
 				*newBranch = std::move( *rhs );
@@ -752,6 +918,7 @@ private:
 			if( childCount >= MAX_NODES )
 				return false;
 
+			ReserveChild();
 			ConstructLeaf( childCount, std::move( *val ) );
 			for( size_t d = 0; d < D; ++d )
 			{
@@ -802,6 +969,7 @@ private:
 					return false;
 				else
 				{
+					ReserveChild();
 					spatial_tree* const newBranch = &children.branches[childCount];
 
 					newBranch->containsLeaves = 1;
@@ -901,6 +1069,241 @@ private:
 		FreeWorkMem( workMem );
 	}
 
+	template <typename Iter, typename BoundsGen, typename LT>
+	static void GatherLeaves( Iter start, Iter end, BoundsGen BoundsGenerator, LT** outLeafPtrs, float * ( &outLeafMins )[D], float * ( &outLeafMaxs )[D] )
+	{
+		for( unsigned leafIndex = 0; start != end; ++start, ++leafIndex )
+		{
+			float curMins[D];
+			float curMaxs[D];
+
+			outLeafPtrs[leafIndex] = get_temporary_address( *start );
+			BoundsGenerator( *start, curMins, curMaxs );
+
+			for( unsigned d = 0; d < D; ++d )
+			{
+				assertfmt( curMins[d] <= curMaxs[d], "Object has invalid bounds" );
+				outLeafMins[d][leafIndex] = curMins[d];
+				outLeafMaxs[d][leafIndex] = curMaxs[d];
+			}
+		}
+	}
+
+	template <typename LT>
+	static size_t BulkInsertScratchSize( unsigned leafCount )
+	{
+		size_t scratchSize = sizeof( unsigned ) * leafCount; // Destination child per leaf
+		scratchSize += sizeof( LT* ) * leafCount; // Reorder buffer for leaf pointers
+		scratchSize += sizeof( float ) * D * leafCount * 2; // Reorder buffer for leaf mins and maxs
+		scratchSize += alignof( unsigned ) + alignof( LT* ) + alignof( float ) * D * 2; // Alignment fudge factor
+
+		return scratchSize;
+	}
+
+	// Rebuilds a full leaf node out of its current leaves plus the new ones
+	template <typename LT>
+	static void RepartitionLeaves( spatial_tree* node, LT** newLeafPtrs, float * ( &newLeafMins )[D], float * ( &newLeafMaxs )[D], unsigned newLeafCount )
+	{
+		using namespace spatial_tree_common;
+		const unsigned oldLeafCount = node->childCount;
+		const unsigned leafCount = oldLeafCount + newLeafCount;
+
+		size_t workMemSize;
+		void* const workMem = AllocWorkMem( leafCount, &workMemSize );
+		void* workMemPtr = workMem;
+		LT** leafPtrs = WorkMemAlloc<LT*>( leafCount, &workMemPtr );
+		float* leafMins[D];
+		float* leafMaxs[D];
+
+		for( unsigned leafIndex = 0; leafIndex < oldLeafCount; ++leafIndex )
+			leafPtrs[leafIndex] = &node->leaf( leafIndex );
+
+		std::memcpy( leafPtrs + oldLeafCount, newLeafPtrs, sizeof( LT* ) * newLeafCount );
+
+		for( unsigned d = 0; d < D; ++d )
+		{
+			leafMins[d] = WorkMemAlloc<float>( leafCount, &workMemPtr );
+			leafMaxs[d] = WorkMemAlloc<float>( leafCount, &workMemPtr );
+
+			std::memcpy( leafMins[d], node->mins[d], sizeof( float ) * oldLeafCount );
+			std::memcpy( leafMaxs[d], node->maxs[d], sizeof( float ) * oldLeafCount );
+			std::memcpy( leafMins[d] + oldLeafCount, newLeafMins[d], sizeof( float ) * newLeafCount );
+			std::memcpy( leafMaxs[d] + oldLeafCount, newLeafMaxs[d], sizeof( float ) * newLeafCount );
+		}
+
+		spatial_tree newTree;
+		LoadNode( &newTree, leafPtrs, leafMins, leafMaxs, leafCount, workMemPtr );
+
+		*node = std::move( newTree );
+
+		size_t workMemUsed = static_cast<size_t>( (char*)workMemPtr - (char*)workMem );
+		assert( workMemUsed <= workMemSize );
+		FreeWorkMem( workMem );
+	}
+
+	template <typename LT>
+	static void BulkInsert_r( spatial_tree* node, LT** leafPtrs, float * ( &leafMins )[D], float * ( &leafMaxs )[D], unsigned leafCount, void* scratchMem, void* workMem )
+	{
+		using namespace spatial_tree_common;
+		static const size_t SSE_MAX_NODES = ( MAX_NODES + 3 ) & ~3;
+		static const unsigned ORPHAN_BUCKET = MAX_NODES;
+
+		if( node->containsLeaves )
+		{
+			if( node->childCount + leafCount > MAX_NODES )
+			{
+				RepartitionLeaves( node, leafPtrs, leafMins, leafMaxs, leafCount );
+			}
+			else
+			{
+				node->ReserveChild();
+				for( unsigned leafIndex = 0; leafIndex < leafCount; ++leafIndex, ++node->childCount )
+				{
+					node->ConstructLeaf( node->childCount, std::move( *leafPtrs[leafIndex] ) );
+
+					for( size_t d = 0; d < D; ++d )
+					{
+						node->mins[d][node->childCount] = leafMins[d][leafIndex];
+						node->maxs[d][node->childCount] = leafMaxs[d][leafIndex];
+					}
+				}
+			}
+
+			return;
+		}
+
+		const unsigned oldChildCount = node->childCount;
+		const unsigned freeChildCount = static_cast<unsigned>( MAX_NODES - oldChildCount );
+		const float* childMins[D];
+		const float* childMaxs[D];
+		void* scratchPtr = scratchMem;
+		unsigned* const leafBuckets = WorkMemAlloc<unsigned>( leafCount, &scratchPtr );
+		unsigned bucketOffsets[MAX_NODES + 2] = {};
+
+		for( size_t d = 0; d < D; ++d )
+		{
+			childMins[d] = node->mins[d];
+			childMaxs[d] = node->maxs[d];
+		}
+
+		// Pick a destination child for every new leaf. Leaves which overlap no child are orphans, and will get new
+		// children of their own if there is room.
+		for( unsigned leafIndex = 0; leafIndex < leafCount; ++leafIndex )
+		{
+			alignas( 16 ) float enlargement[SSE_MAX_NODES];
+			alignas( 16 ) unsigned overlaps[SSE_MAX_NODES];
+			float curMins[D];
+			float curMaxs[D];
+			unsigned bestChildIndex = 0;
+			bool overlapsAny = false;
+
+			for( size_t d = 0; d < D; ++d )
+			{
+				curMins[d] = leafMins[d][leafIndex];
+				curMaxs[d] = leafMaxs[d][leafIndex];
+			}
+
+			InsertionCosts<D, MAX_NODES>( curMins, curMaxs, oldChildCount, childMins, childMaxs, &enlargement, &overlaps );
+
+			for( unsigned childIndex = 0; childIndex < oldChildCount; ++childIndex )
+			{
+				overlapsAny = overlapsAny || overlaps[childIndex];
+
+				if( enlargement[childIndex] < enlargement[bestChildIndex] )
+					bestChildIndex = childIndex;
+			}
+
+			leafBuckets[leafIndex] = ( overlapsAny || !freeChildCount ) ? bestChildIndex : ORPHAN_BUCKET;
+			++bucketOffsets[leafBuckets[leafIndex] + 1];
+		}
+
+		for( unsigned bucket = 1; bucket < MAX_NODES + 2; ++bucket )
+			bucketOffsets[bucket] += bucketOffsets[bucket - 1];
+
+		// Counting scatter so each child's leaves are contiguous
+		{
+			unsigned writeOffsets[MAX_NODES + 1];
+			LT** const sortedPtrs = WorkMemAlloc<LT*>( leafCount, &scratchPtr );
+			float* sortedMins[D];
+			float* sortedMaxs[D];
+
+			for( size_t d = 0; d < D; ++d )
+			{
+				sortedMins[d] = WorkMemAlloc<float>( leafCount, &scratchPtr );
+				sortedMaxs[d] = WorkMemAlloc<float>( leafCount, &scratchPtr );
+			}
+
+			std::memcpy( writeOffsets, bucketOffsets, sizeof( writeOffsets ) );
+
+			for( unsigned leafIndex = 0; leafIndex < leafCount; ++leafIndex )
+			{
+				const unsigned dest = writeOffsets[leafBuckets[leafIndex]]++;
+
+				sortedPtrs[dest] = leafPtrs[leafIndex];
+				for( size_t d = 0; d < D; ++d )
+				{
+					sortedMins[d][dest] = leafMins[d][leafIndex];
+					sortedMaxs[d][dest] = leafMaxs[d][leafIndex];
+				}
+			}
+
+			std::memcpy( leafPtrs, sortedPtrs, sizeof( LT* ) * leafCount );
+			for( size_t d = 0; d < D; ++d )
+			{
+				std::memcpy( leafMins[d], sortedMins[d], sizeof( float ) * leafCount );
+				std::memcpy( leafMaxs[d], sortedMaxs[d], sizeof( float ) * leafCount );
+			}
+		}
+
+		for( unsigned childIndex = 0; childIndex < oldChildCount; ++childIndex )
+		{
+			const unsigned leafBegin = bucketOffsets[childIndex];
+			const unsigned childLeafCount = bucketOffsets[childIndex + 1] - leafBegin;
+
+			if( childLeafCount )
+			{
+				spatial_tree* const child = &node->subtree( childIndex );
+				float* childLeafMins[D], *childLeafMaxs[D];
+
+				for( size_t d = 0; d < D; ++d )
+				{
+					childLeafMins[d] = leafMins[d] + leafBegin;
+					childLeafMaxs[d] = leafMaxs[d] + leafBegin;
+				}
+
+				BulkInsert_r( child, leafPtrs + leafBegin, childLeafMins, childLeafMaxs, childLeafCount, scratchMem, workMem );
+
+				for( size_t d = 0; d < D; ++d )
+					AxialMinMax( child->mins[d], child->maxs[d], child->childCount, &node->mins[d][childIndex], &node->maxs[d][childIndex] );
+			}
+		}
+
+		const unsigned orphanBegin = bucketOffsets[ORPHAN_BUCKET];
+		const unsigned orphanCount = leafCount - orphanBegin;
+
+		if( orphanCount )
+		{
+			const unsigned k = std::min( freeChildCount, orphanCount );
+			unsigned partitions[MAX_NODES];
+			LT** const orphanPtrs = leafPtrs + orphanBegin;
+			float* orphanMins[D], *orphanMaxs[D];
+
+			for( size_t d = 0; d < D; ++d )
+			{
+				orphanMins[d] = leafMins[d] + orphanBegin;
+				orphanMaxs[d] = leafMaxs[d] + orphanBegin;
+			}
+
+			if( k > 1 )
+				PartitionLeaves( k, orphanPtrs, orphanMins, orphanMaxs, orphanCount, &partitions, workMem );
+			else
+				partitions[0] = orphanCount;
+
+			node->ReserveChild();
+			node->childCount += static_cast<unsigned char>( LoadPartitions( node, oldChildCount, k, partitions, orphanPtrs, orphanMins, orphanMaxs, workMem ) );
+		}
+	}
+
 	template <typename LT>
 	static void LoadLeafs( spatial_tree* node, LT** leafPtrs, float * ( &leafMins )[D], float * ( &leafMaxs )[D], unsigned leafCount )
 	{
@@ -926,16 +1329,43 @@ private:
 		}
 	}
 
+	// Partitions the leaves into at most k groups, reordering leafPtrs, leafMins and leafMaxs to match. Returns the number of non-empty partitions.
 	template <typename LT>
-	static void LoadBranches( spatial_tree* node, LT** leafPtrs, float * ( &leafMins )[D], float * ( &leafMaxs )[D], unsigned leafCount, void* workMem )
+	static unsigned PartitionLeaves( unsigned k, LT** leafPtrs, float * ( &leafMins )[D], float * ( &leafMaxs )[D], unsigned leafCount, unsigned ( *outPartitions )[MAX_NODES], void* workMem, build_seeds* seeds = nullptr, PartitionMethod method = PartitionMethod::Exhaustive )
 	{
 		using namespace spatial_tree_common;
-		unsigned partitions[MAX_NODES];
+		static const unsigned boundedMinK = 16;
+		static const unsigned boundedMinLeafCount = 4096;
 		void* workMemPtr = workMem;
 		unsigned* const indices = WorkMemAlloc<unsigned>( leafCount + MAX_VECTOR_ALIGNMENT / sizeof( unsigned ), &workMemPtr, MAX_VECTOR_ALIGNMENT );
-		void* const partWorkMem = workMemPtr;
+		BoxPartitioner<D>& partitioner = BuildPartitioner();
+
+		// Bounded gives the same partitions as Exhaustive, and from about 16 means over a few thousand leaves the distances
+		// it skips are worth more than keeping its bounds
+		if( method == PartitionMethod::Exhaustive && k >= boundedMinK && leafCount >= boundedMinLeafCount )
+			method = PartitionMethod::Bounded;
 
-		PartitionBoxes( MAX_NODES, leafMins, leafMaxs, leafCount, indices, partitions, partWorkMem );
+		if( seeds )
+		{
+			if( seeds->nextSeed == seeds->nodeSeeds.size() )
+				seeds->nodeSeeds.push_back( {} );
+
+			typename build_seeds::NodeSeed* const seed = &seeds->nodeSeeds[seeds->nextSeed++];
+			float* seedMeans[D];
+
+			for( size_t d = 0; d < D; ++d )
+				seedMeans[d] = seed->means[d];
+
+			PartitionSeeds partitionSeeds{ seedMeans, seed->valid && seed->k == k };
+
+			partitioner.Partition( k, leafMins, leafMaxs, leafCount, indices, *outPartitions, method, &partitionSeeds );
+			seed->k = k;
+			seed->valid = partitionSeeds.valid;
+		}
+		else
+		{
+			partitioner.Partition( k, leafMins, leafMaxs, leafCount, indices, *outPartitions, method );
+		}
 
 		bool* const swapped = WorkMemAlloc<bool>( leafCount, &workMemPtr );
 		std::memset( swapped, 0, sizeof( bool ) * leafCount );
@@ -959,34 +1389,28 @@ private:
 		}
 
 		unsigned leafBegin = 0;
-		unsigned childCount = 0;
-		for( unsigned partitionIndex = 0; partitionIndex < MAX_NODES; ++partitionIndex )
+		unsigned partitionCount = 0;
+		for( unsigned partitionIndex = 0; partitionIndex < k; ++partitionIndex )
 		{
-			const unsigned leafEnd = partitions[partitionIndex];
+			const unsigned leafEnd = ( *outPartitions )[partitionIndex];
 
 			if( leafBegin != leafEnd )
 			{
-				++childCount;
+				++partitionCount;
 				leafBegin = leafEnd;
 			}
 		}
 
-		if( childCount <= 1 )
-		{
-			const unsigned leavesPerChild = static_cast<unsigned>( std::max( MAX_NODES, ( leafCount + ( MAX_NODES - 1 ) ) / MAX_NODES ) );
-			childCount = static_cast<unsigned>( std::min( MAX_NODES, ( leafCount + ( MAX_NODES - 1 ) ) / MAX_NODES ) );
-
-			for( unsigned partitionIndex = 0; partitionIndex < MAX_NODES; ++partitionIndex )
-				partitions[partitionIndex] = std::min( leavesPerChild * ( partitionIndex + 1 ), leafCount );
-		}
-
-		node->containsLeaves = 0;
-		node->AllocateBranches( childCount );
-		node->childCount = static_cast<uint8_t>( childCount );
+		return partitionCount;
+	}
 
-		leafBegin = 0;
-		unsigned childIndex = 0;
-		for( size_t partitionIndex = 0; partitionIndex < MAX_NODES; ++partitionIndex )
+	// Loads each non-empty partition into its own child, starting at firstChildIndex. Returns the number of children loaded.
+	template <typename LT>
+	static unsigned LoadPartitions( spatial_tree* node, unsigned firstChildIndex, unsigned k, const unsigned ( &partitions )[MAX_NODES], LT** leafPtrs, float * ( &leafMins )[D], float * ( &leafMaxs )[D], void* workMem, build_seeds* seeds = nullptr, PartitionMethod method = PartitionMethod::Exhaustive )
+	{
+		unsigned leafBegin = 0;
+		unsigned childIndex = firstChildIndex;
+		for( size_t partitionIndex = 0; partitionIndex < k; ++partitionIndex )
 		{
 			const unsigned leafEnd = partitions[partitionIndex];
 
@@ -1001,39 +1425,187 @@ private:
 					childMaxPtrs[d] = leafMaxs[d] + leafBegin;
 				}
 
-				LoadTree_r( node, childIndex, leafPtrs + leafBegin, childMinPtrs, childMaxPtrs, childLeafCount, workMem );
+				LoadTree_r( node, childIndex, leafPtrs + leafBegin, childMinPtrs, childMaxPtrs, childLeafCount, workMem, seeds, method );
 
 				leafBegin = leafEnd;
 				++childIndex;
 			}
 		}
+
+		return childIndex - firstChildIndex;
 	}
 
 	template <typename LT>
-	static void LoadNode( spatial_tree* node, LT** leafPtrs, float * ( &leafMins )[D], float * ( &leafMaxs )[D], unsigned leafCount, void* workMem )
+	static void LoadBranches( spatial_tree* node, LT** leafPtrs, float * ( &leafMins )[D], float * ( &leafMaxs )[D], unsigned leafCount, void* workMem, build_seeds* seeds, PartitionMethod method )
+	{
+		unsigned partitions[MAX_NODES];
+		unsigned childCount = PartitionLeaves( MAX_NODES, leafPtrs, leafMins, leafMaxs, leafCount, &partitions, workMem, seeds, method );
+
+		if( childCount <= 1 )
+		{
+			const unsigned leavesPerChild = static_cast<unsigned>( std::max( MAX_NODES, ( leafCount + ( MAX_NODES - 1 ) ) / MAX_NODES ) );
+			childCount = static_cast<unsigned>( std::min( MAX_NODES, ( leafCount + ( MAX_NODES - 1 ) ) / MAX_NODES ) );
+
+			for( unsigned partitionIndex = 0; partitionIndex < MAX_NODES; ++partitionIndex )
+				partitions[partitionIndex] = std::min( leavesPerChild * ( partitionIndex + 1 ), leafCount );
+		}
+
+		node->containsLeaves = 0;
+		node->AllocateBranches( childCount );
+		node->childCount = static_cast<uint8_t>( childCount );
+
+		LoadPartitions( node, 0, MAX_NODES, partitions, leafPtrs, leafMins, leafMaxs, workMem, seeds, method );
+	}
+
+	template <typename LT>
+	static void LoadNode( spatial_tree* node, LT** leafPtrs, float * ( &leafMins )[D], float * ( &leafMaxs )[D], unsigned leafCount, void* workMem, build_seeds* seeds = nullptr, PartitionMethod method = PartitionMethod::Exhaustive )
 	{
 		if( leafCount <= MAX_NODES )
 			LoadLeafs( node, leafPtrs, leafMins, leafMaxs, leafCount );
 		else
-			LoadBranches( node, leafPtrs, leafMins, leafMaxs, leafCount, workMem );
+			LoadBranches( node, leafPtrs, leafMins, leafMaxs, leafCount, workMem, seeds, method );
 	}
 
 	template <typename LT>
-	static void LoadTree_r( spatial_tree* parent, unsigned myIndex, LT** leafPtrs, float * ( &leafMins )[D], float * ( &leafMaxs )[D], unsigned leafCount, void* workMem )
+	static void LoadTree_r( spatial_tree* parent, unsigned myIndex, LT** leafPtrs, float * ( &leafMins )[D], float * ( &leafMaxs )[D], unsigned leafCount, void* workMem, build_seeds* seeds, PartitionMethod method )
 	{
 		using namespace spatial_tree_common;
 		spatial_tree* me = &parent->subtree( myIndex );
-		LoadNode( me, leafPtrs, leafMins, leafMaxs, leafCount, workMem );
+		LoadNode( me, leafPtrs, leafMins, leafMaxs, leafCount, workMem, seeds, method );
 
 		for( unsigned d = 0; d < D; ++d )
 			AxialMinMax( me->mins[d], me->maxs[d], me->childCount, &parent->mins[d][myIndex], &parent->maxs[d][myIndex] );
 	}
 
-	static void* AllocWorkMem( unsigned leafCount, size_t *alloc_size )
+	struct NodePool
+	{
+		size_t liveArrays;
+		size_t size;
+	};
+
+	static constexpr size_t PoolArrayAlignment()
+	{
+		return std::max( { alignof( spatial_tree ), alignof( LeafStorage ), sizeof( NodePool* ) } );
+	}
+
+	static constexpr size_t PoolRoundUp( size_t bytes )
+	{
+		return ( bytes + ( PoolArrayAlignment() - 1 ) ) & ~( PoolArrayAlignment() - 1 );
+	}
+
+	// Each pooled array is preceded by a back pointer to its pool. The pool is freed once its last array is released.
+	template <typename U>
+	static U* PoolAllocArray( NodePool* pool, unsigned count, char** cursor )
+	{
+		char* const array = *cursor + PoolArrayAlignment();
+
+		*reinterpret_cast<NodePool**>( array - sizeof( NodePool* ) ) = pool;
+		*cursor = array + PoolRoundUp( sizeof( U ) * count );
+		++pool->liveArrays;
+
+		return reinterpret_cast<U*>( array );
+	}
+
+	static void ReleasePoolArray( void* array )
+	{
+		NodePool* const pool = *reinterpret_cast<NodePool**>( reinterpret_cast<char*>( array ) - sizeof( NodePool* ) );
+
+		if( --pool->liveArrays == 0 )
+			_aligned_free( pool );
+	}
+
+	static void CompactMeasure_r( const spatial_tree* node, size_t* inoutOldBytes, size_t* inoutNewBytes )
+	{
+		const size_t elementSize = node->containsLeaves ? sizeof( LeafStorage ) : sizeof( spatial_tree );
+
+		if( node->pooledChildren )
+		{
+			// Charge each live array its share of the old pool, so any holes left in it count as reclaimed
+			const NodePool* const pool = *reinterpret_cast<NodePool* const*>( reinterpret_cast<const char*>( node->children.data ) - sizeof( NodePool* ) );
+			*inoutOldBytes += pool->size / pool->liveArrays;
+		}
+		else
+			*inoutOldBytes += elementSize * MAX_NODES;
+
+		*inoutNewBytes += PoolArrayAlignment() + PoolRoundUp( elementSize * node->childCount );
+
+		if( !node->containsLeaves )
+		{
+			for( unsigned childIndex = 0; childIndex < node->childCount; ++childIndex )
+				CompactMeasure_r( &node->children.branches[childIndex], inoutOldBytes, inoutNewBytes );
+		}
+	}
+
+	static void Compact_r( spatial_tree* node, NodePool* pool, char** cursor )
+	{
+		const unsigned nodeChildCount = node->childCount;
+		void* const oldArray = node->children.data;
+		const bool wasPooled = node->pooledChildren;
+
+		if( node->containsLeaves )
+		{
+			LeafStorage* const leaves = PoolAllocArray<LeafStorage>( pool, nodeChildCount, cursor );
+
+			for( unsigned childIndex = 0; childIndex < nodeChildCount; ++childIndex )
+			{
+				new( leaves + childIndex ) T( std::move( node->leaf( childIndex ) ) );
+				node->DestructLeaf( childIndex );
+			}
+
+			node->children.leaves = leaves;
+
+			if( wasPooled )
+				ReleasePoolArray( oldArray );
+			else
+				delete[] reinterpret_cast<LeafStorage*>( oldArray );
+		}
+		else
+		{
+			spatial_tree* const branches = PoolAllocArray<spatial_tree>( pool, nodeChildCount, cursor );
+			spatial_tree* const oldBranches = reinterpret_cast<spatial_tree*>( oldArray );
+
+			for( unsigned childIndex = 0; childIndex < nodeChildCount; ++childIndex )
+				new( branches + childIndex ) spatial_tree( std::move( oldBranches[childIndex] ) );
+
+			node->children.branches = branches;
+
+			if( wasPooled )
+			{
+				for( unsigned childIndex = 0; childIndex < nodeChildCount; ++childIndex )
+					oldBranches[childIndex].~spatial_tree();
+
+				ReleasePoolArray( oldArray );
+			}
+			else
+				delete[] oldBranches;
+		}
+
+		node->pooledChildren = 1;
+
+		if( !node->containsLeaves )
+		{
+			for( unsigned childIndex = 0; childIndex < nodeChildCount; ++childIndex )
+				Compact_r( &node->children.branches[childIndex], pool, cursor );
+		}
+	}
+
+	// Kept per thread and across builds. Every partition in a build is at most leafCount boxes, so reserving that up front
+	// leaves the nodes nothing to allocate.
+	static BoxPartitioner<D>& BuildPartitioner()
+	{
+		thread_local BoxPartitioner<D> partitioner;
+
+		return partitioner;
+	}
+
+	static void* AllocWorkMem( unsigned leafCount, size_t *alloc_size, size_t extraSize = 0 )
 	{
 		using namespace spatial_tree_common;
-		size_t workMemSize = ComputePartitionBoxesWorkMemSize<D>( leafCount );
-		workMemSize += sizeof( unsigned ) * leafCount; // Holder for indices during build
+		BuildPartitioner().Reserve( leafCount );
+
+		size_t workMemSize = extraSize;
+		workMemSize += sizeof( unsigned ) * leafCount + MAX_VECTOR_ALIGNMENT * 2; // Holder for indices during build, padded and aligned
+		workMemSize += sizeof( bool ) * leafCount; // Holder for swapped flags while applying the partition
 		workMemSize += workMemSize >> 3; // Fudge factor for inter-node alignments
 		workMemSize += sizeof( T* ) * leafCount; // Holds leaf pointers
 		workMemSize += sizeof( float ) * D * leafCount * 2; // Holds leaf mins and maxs
@@ -6,6 +6,7 @@
 #include <stack>
 #include <limits>
 #include "../Assert.h"
+#include "spatial_bounds.h"
 
 #ifdef max
 #undef max
@@ -232,6 +233,56 @@ static void BoxDistancesSqr( const float* myMins, const float* myMaxs, unsigned
 	}
 }
 
+// Computes how much each child's surface area would grow if it absorbed the given box, and whether the box already
+// overlaps that child. Output arrays are padded to a multiple of 4 so the SSE stores stay in bounds.
+template <size_t D, size_t MAX_NODES>
+static void InsertionCosts( const float* myMins, const float* myMaxs, unsigned count, const float * ( &mins )[D], const float * ( &maxs )[D],
+							float ( *outEnlargement )[( MAX_NODES + 3 ) & ~3], unsigned ( *outOverlaps )[( MAX_NODES + 3 ) & ~3] )
+{
+	static const size_t MAX_X = D - 1;
+	const unsigned sseCount = ( count + 3 ) >> 2;
+	__m128* const sseOutEnlargement = reinterpret_cast<__m128*>( *outEnlargement );
+	__m128* const sseOutOverlaps = reinterpret_cast<__m128*>( *outOverlaps );
+
+	for( unsigned sseBoxIndex = 0; sseBoxIndex < sseCount; ++sseBoxIndex )
+	{
+		__m128 sseUnionSA = _mm_setzero_ps();
+		__m128 sseChildSA = _mm_setzero_ps();
+		__m128 sseOverlaps = _mm_castsi128_ps( _mm_set1_epi32( 0xFFFFFFFF ) );
+
+		for( size_t x = 0; x < D; ++x )
+		{
+			const __m128 sseMyXMin = _mm_set1_ps( myMins[x] );
+			const __m128 sseMyXMax = _mm_set1_ps( myMaxs[x] );
+			const __m128 sseXMin = _mm_loadu_ps( mins[x] + ( sseBoxIndex << 2 ) );
+			const __m128 sseXMax = _mm_loadu_ps( maxs[x] + ( sseBoxIndex << 2 ) );
+			const __m128 sseXExtent = _mm_sub_ps( sseXMax, sseXMin );
+			const __m128 sseUnionXExtent = _mm_sub_ps( _mm_max_ps( sseXMax, sseMyXMax ), _mm_min_ps( sseXMin, sseMyXMin ) );
+
+			sseOverlaps = _mm_and_ps( sseOverlaps, _mm_and_ps( _mm_cmpge_ps( sseXMax, sseMyXMin ), _mm_cmple_ps( sseXMin, sseMyXMax ) ) );
+
+			if( x >= MAX_X )
+				continue;
+
+			for( size_t y = x + 1; y < D; ++y )
+			{
+				const __m128 sseMyYMin = _mm_set1_ps( myMins[y] );
+				const __m128 sseMyYMax = _mm_set1_ps( myMaxs[y] );
+				const __m128 sseYMin = _mm_loadu_ps( mins[y] + ( sseBoxIndex << 2 ) );
+				const __m128 sseYMax = _mm_loadu_ps( maxs[y] + ( sseBoxIndex << 2 ) );
+				const __m128 sseYExtent = _mm_sub_ps( sseYMax, sseYMin );
+				const __m128 sseUnionYExtent = _mm_sub_ps( _mm_max_ps( sseYMax, sseMyYMax ), _mm_min_ps( sseYMin, sseMyYMin ) );
+
+				sseChildSA = _mm_add_ps( sseChildSA, _mm_mul_ps( sseXExtent, sseYExtent ) );
+				sseUnionSA = _mm_add_ps( sseUnionSA, _mm_mul_ps( sseUnionXExtent, sseUnionYExtent ) );
+			}
+		}
+
+		sseOutEnlargement[sseBoxIndex] = _mm_sub_ps( sseUnionSA, sseChildSA );
+		sseOutOverlaps[sseBoxIndex] = sseOverlaps;
+	}
+}
+
 template <size_t D, size_t MAX_NODES>
 static void PercentOverlap( float mySurfaceArea, const float* myMins, const float* myMaxs, unsigned count, const float* rhsSurfaceAreas, const float * ( &mins )[D], const float * ( &maxs )[D],
 							float ( *outOverlap )[MAX_NODES] )
@@ -298,6 +349,40 @@ struct TreeInterface
 		}
 	}
 
+	// Also flags children lying entirely inside the query box
+	template <typename Tree>
+	static void GatherIntersections( const Tree& node, const float* queryMins, const float* queryMaxs, float epsilon, unsigned( *outIntersections )[MAX_NODES], unsigned( *outContained )[MAX_NODES] )
+	{
+		const unsigned sseChildCount = ( node.child_count() + 3 ) >> 2;
+		const __m128 sseEpsilon = _mm_set1_ps( epsilon );
+		__m128* const sseOutInts = reinterpret_cast<__m128*>( outIntersections );
+		__m128* const sseOutContained = reinterpret_cast<__m128*>( outContained );
+
+		std::memset( *outIntersections, 0xFFFFFFFF, sizeof( *outIntersections ) );
+		std::memset( *outContained, 0xFFFFFFFF, sizeof( *outContained ) );
+
+		for( size_t d = 0; d < D; ++d )
+		{
+			const __m128 sseQueryMins = _mm_sub_ps( _mm_set1_ps( queryMins[d] ), sseEpsilon );
+			const __m128 sseQueryMaxs = _mm_add_ps( _mm_set1_ps( queryMaxs[d] ), sseEpsilon );
+			const __m128* const sseChildMins = reinterpret_cast<const __m128*>( node.child_mins( d ) );
+			const __m128* const sseChildMaxs = reinterpret_cast<const __m128*>( node.child_maxs( d ) );
+
+			for( unsigned sseChildIndex = 0; sseChildIndex < sseChildCount; ++sseChildIndex )
+			{
+				const __m128 sseMaxGEMin = _mm_cmpge_ps( sseChildMaxs[sseChildIndex], sseQueryMins );
+				const __m128 sseMinLEMax = _mm_cmple_ps( sseChildMins[sseChildIndex], sseQueryMaxs );
+				const __m128 sseMinGEMin = _mm_cmpge_ps( sseChildMins[sseChildIndex], sseQueryMins );
+				const __m128 sseMaxLEMax = _mm_cmple_ps( sseChildMaxs[sseChildIndex], sseQueryMaxs );
+				const __m128 sseChildInt = _mm_and_ps( sseMaxGEMin, sseMinLEMax );
+				const __m128 sseChildContained = _mm_and_ps( sseMinGEMin, sseMaxLEMax );
+
+				sseOutInts[sseChildIndex] = _mm_and_ps( sseOutInts[sseChildIndex], sseChildInt );
+				sseOutContained[sseChildIndex] = _mm_and_ps( sseOutContained[sseChildIndex], sseChildContained );
+			}
+		}
+	}
+
 	// ClampEnd true = segment intersections
 	template<bool ClampEnd, typename Tree>
 	static void GatherRayIntersections( const Tree &node, const float *start, const float *invDir, float epsilon, unsigned ( *outIntersections )[MAX_NODES] )
@@ -352,7 +437,7 @@ struct TreeInterface
 		}
 	}
 
-	template <typename Tree, typename = std::enable_if_t<D==3>>
+	template <typename Tree, size_t DD = D, typename = std::enable_if_t<DD == 3>>
 	static void GatherPlanarIntersections( const Tree& node, const float (&plane)[4], float epsilon, unsigned( *outIntersections )[MAX_NODES] )
 	{
 		static const unsigned sseMaxNodes = (MAX_NODES + 3) >> 2;
@@ -660,8 +745,9 @@ struct TreeInterface
 		}
 	}
 
+	// Returns false if VisitCallback early outs
 	template <typename Tree, typename VisitFunc>
-	static void IterateLeaves( Tree* root, VisitFunc VisitCallback )
+	static bool IterateLeavesBase( Tree* root, VisitFunc &&VisitCallback )
 	{
 		std::stack<Tree*> nodeStack;
 
@@ -678,17 +764,17 @@ struct TreeInterface
 			{
 				for ( unsigned childIndex = 0; childIndex < childCount; ++childIndex )
 				{
-					if constexpr ( func_traits<VisitFunc>::arity == 3 )
+					if constexpr ( func_traits<std::decay_t<VisitFunc>>::arity == 3 )
 					{
 						float mins[D];
 						float maxs[D];
 						
 						GatherChildMinMaxs( *node, childIndex, &mins, &maxs );
 
-						if constexpr ( std::is_same_v<func_traits<VisitFunc>::return_type, bool> )
+						if constexpr ( std::is_same_v<func_traits<std::decay_t<VisitFunc>>::return_type, bool> )
 						{
 							if ( !VisitCallback( node->leaf( childIndex ), mins, maxs ) )
-								return;
+								return false;
 						}
 						else
 						{
@@ -698,10 +784,10 @@ struct TreeInterface
 					else
 					{
 						
-						if constexpr ( std::is_same_v<func_traits<VisitFunc>::return_type, bool> )
+						if constexpr ( std::is_same_v<func_traits<std::decay_t<VisitFunc>>::return_type, bool> )
 						{
 							if ( !VisitCallback( node->leaf( childIndex ) ) )
-								return;
+								return false;
 						}
 						else
 						{
@@ -716,6 +802,14 @@ struct TreeInterface
 					nodeStack.push( &node->subtree( childIndex ) );
 			}
 		}
+
+		return true;
+	}
+
+	template <typename Tree, typename VisitFunc>
+	static void IterateLeaves( Tree* root, VisitFunc VisitCallback )
+	{
+		IterateLeavesBase( root, VisitCallback );
 	}
 
 	template <typename Tree, typename VisitFunc>
@@ -737,9 +831,37 @@ struct TreeInterface
 		}
 	}
 
-	template <typename Tree, typename IntersectFunc, typename QueryFunc>
-	static void QueryBase( Tree* root, float epsilon, IntersectFunc &&IntersectCallback, QueryFunc &&QueryCallback )
+	static __forceinline bool LeafOverlaps( const T& leaf, const float* queryMins, const float* queryMaxs, float epsilon )
 	{
+		if constexpr ( spatial_bounds::has_secondary_bound_v<T> )
+			return leaf.secondary_bound().overlaps( queryMins, queryMaxs, epsilon );
+		else
+			return true;
+	}
+
+	static __forceinline bool LeafIntersects( const T& leaf, const float* start, const float* dir, float tMax, float epsilon )
+	{
+		if constexpr ( spatial_bounds::has_secondary_bound_v<T> )
+			return leaf.secondary_bound().intersects( start, dir, tMax, epsilon );
+		else
+			return true;
+	}
+
+	static __forceinline bool LeafIntersectsPlane( const T& leaf, const float ( &plane )[4], float epsilon )
+	{
+		if constexpr ( spatial_bounds::has_secondary_bound_v<T> )
+			return leaf.secondary_bound().intersects_plane( plane, epsilon );
+		else
+			return true;
+	}
+
+	// LeafTestFunc is bool(const T&), the refined test against a leaf's secondary bound once its box passes.
+	// IntersectFunc may take a 4th parameter, unsigned (*outContainsChild)[MAX_NODES]. Children it flags are accepted
+	// without further tests: leaves skip LeafTestFunc and branches go whole to SubtreeFunc, bool(Tree&) (false early outs).
+	template <typename Tree, typename IntersectFunc, typename LeafTestFunc, typename SubtreeFunc, typename QueryFunc>
+	static void QueryBase( Tree* root, float epsilon, IntersectFunc &&IntersectCallback, LeafTestFunc &&LeafTestCallback, SubtreeFunc &&SubtreeCallback, QueryFunc &&QueryCallback )
+	{
+		static const bool EarlyAccept = func_traits<std::decay_t<IntersectFunc>>::arity == 4;
 		std::stack<Tree*> nodeStack;
 
 		nodeStack.push( root );
@@ -749,23 +871,34 @@ struct TreeInterface
 			Tree* const node = nodeStack.top();
 			const unsigned childCount = node->child_count();
 			alignas( 16 ) unsigned intersectsChild[MAX_NODES];
+			alignas( 16 ) unsigned containsChild[MAX_NODES];
 
 			nodeStack.pop();
 
-			IntersectCallback( *node, epsilon, &intersectsChild );
+			if constexpr ( EarlyAccept )
+				IntersectCallback( *node, epsilon, &intersectsChild, &containsChild );
+			else
+				IntersectCallback( *node, epsilon, &intersectsChild );
 
 			if( node->leaf_branch() )
 			{
 				for( unsigned childIndex = 0; childIndex < childCount; ++childIndex )
 				{
-					if ( intersectsChild[childIndex] )
+					bool accept = intersectsChild[childIndex];
+
+					if constexpr ( EarlyAccept )
+						accept = accept && ( containsChild[childIndex] || LeafTestCallback( node->leaf( childIndex ) ) );
+					else
+						accept = accept && LeafTestCallback( node->leaf( childIndex ) );
+
+					if ( accept )
 					{
 						if constexpr ( func_traits<QueryFunc>::arity == 3 )
 						{
 							float mins[D];
 							float maxs[D];
 
-							GatherChildMinMaxs( node, childIndex, &mins, &maxs );
+							GatherChildMinMaxs( *node, childIndex, &mins, &maxs );
 
 							if constexpr ( std::is_same_v<func_traits<QueryFunc>::return_type, bool> )
 							{
@@ -795,25 +928,48 @@ struct TreeInterface
 			else
 			{
 				for( unsigned childIndex = 0; childIndex < childCount; ++childIndex )
+				{
+					if constexpr ( EarlyAccept )
+					{
+						if( containsChild[childIndex] )
+						{
+							if( !SubtreeCallback( node->subtree( childIndex ) ) )
+								return;
+
+							continue;
+						}
+					}
+
 					if( intersectsChild[childIndex] )
 						nodeStack.push( &node->subtree( childIndex ) );
+				}
 			}
 		}
 	}
 
-	template <typename Tree, typename IntersectFunc, typename QueryFunc>
-	static void QueryBase( const Tree& root, float epsilon, IntersectFunc IntersectCallback, QueryFunc QueryCallback )
+	// Contained subtrees are emitted leaf by leaf through QueryFunc
+	template <typename Tree, typename IntersectFunc, typename LeafTestFunc, typename QueryFunc>
+	static void QueryBase( Tree* root, float epsilon, IntersectFunc &&IntersectCallback, LeafTestFunc &&LeafTestCallback, QueryFunc &&QueryCallback )
+	{
+		QueryBase( root, epsilon, std::forward<IntersectFunc>( IntersectCallback ), std::forward<LeafTestFunc>( LeafTestCallback ), [&QueryCallback] ( Tree& subtree )
+		{
+			return IterateLeavesBase( &subtree, QueryCallback );
+		}, std::forward<QueryFunc>( QueryCallback ) );
+	}
+
+	template <typename Tree, typename IntersectFunc, typename LeafTestFunc, typename QueryFunc>
+	static void QueryBase( const Tree& root, float epsilon, IntersectFunc IntersectCallback, LeafTestFunc LeafTestCallback, QueryFunc QueryCallback )
 	{
 		if constexpr ( func_traits<QueryFunc>::arity == 3 )
 		{
-			QueryBase( const_cast<Tree*>(&root), epsilon, std::forward<IntersectFunc>( IntersectCallback ), [&QueryCallback] ( T& leaf, const float ( &mins )[3], const float( &maxs )[3] )
+			QueryBase( const_cast<Tree*>(&root), epsilon, std::forward<IntersectFunc>( IntersectCallback ), std::forward<LeafTestFunc>( LeafTestCallback ), [&QueryCallback] ( T& leaf, const float ( &mins )[3], const float( &maxs )[3] )
 			{
 				QueryCallback( const_cast<const T&>(leaf), mins, maxs );
 			} );
 		}
 		else
 		{
-			QueryBase( const_cast<Tree*>( &root ), epsilon, std::forward<IntersectFunc>(IntersectCallback), [&QueryCallback]( T& leaf )
+			QueryBase( const_cast<Tree*>( &root ), epsilon, std::forward<IntersectFunc>(IntersectCallback), std::forward<LeafTestFunc>( LeafTestCallback ), [&QueryCallback]( T& leaf )
 			{
 				QueryCallback( const_cast<const T&>( leaf ) );
 			} );
@@ -823,50 +979,112 @@ struct TreeInterface
 	template <typename Tree, typename QueryFunc>
 	static void Query( Tree* root, const float* queryMins, const float* queryMaxs, float epsilon, QueryFunc QueryCallback )
 	{
-		QueryBase( root, epsilon, [=] ( const Tree &node, float epsilon, unsigned ( *outIntersectsChild )[MAX_NODES] )
+		QueryBase( root, epsilon, [=] ( const Tree &node, float epsilon, unsigned ( *outIntersectsChild )[MAX_NODES], unsigned ( *outContainsChild )[MAX_NODES] )
 		{
-			GatherIntersections( node, queryMins, queryMaxs, epsilon, outIntersectsChild );
+			GatherIntersections( node, queryMins, queryMaxs, epsilon, outIntersectsChild, outContainsChild );
+		}, [=] ( const T& leaf )
+		{
+			return LeafOverlaps( leaf, queryMins, queryMaxs, epsilon );
 		}, std::forward<QueryFunc>( QueryCallback ) );
 	}
 
 	template <typename Tree, typename QueryFunc>
 	static void Query( const Tree& root, const float* queryMins, const float* queryMaxs, float epsilon, QueryFunc QueryCallback )
 	{
-		QueryBase( root, epsilon, [=] ( const Tree &node, float epsilon, unsigned ( *outIntersectsChild )[MAX_NODES] )
+		QueryBase( root, epsilon, [=] ( const Tree &node, float epsilon, unsigned ( *outIntersectsChild )[MAX_NODES], unsigned ( *outContainsChild )[MAX_NODES] )
+		{
+			GatherIntersections( node, queryMins, queryMaxs, epsilon, outIntersectsChild, outContainsChild );
+		}, [=] ( const T& leaf )
+		{
+			return LeafOverlaps( leaf, queryMins, queryMaxs, epsilon );
+		}, std::forward<QueryFunc>( QueryCallback ) );
+	}
+
+	// SubtreeFunc is R(Tree&), called with every subtree lying entirely inside the query box. If R is bool, returning false early outs.
+	template <typename Tree, typename SubtreeFunc, typename QueryFunc>
+	static void SubtreeQuery( Tree* root, const float* queryMins, const float* queryMaxs, float epsilon, SubtreeFunc SubtreeCallback, QueryFunc QueryCallback )
+	{
+		QueryBase( root, epsilon, [=] ( const Tree &node, float epsilon, unsigned ( *outIntersectsChild )[MAX_NODES], unsigned ( *outContainsChild )[MAX_NODES] )
+		{
+			GatherIntersections( node, queryMins, queryMaxs, epsilon, outIntersectsChild, outContainsChild );
+		}, [=] ( const T& leaf )
 		{
-			GatherIntersections( node, queryMins, queryMaxs, epsilon, outIntersectsChild );
+			return LeafOverlaps( leaf, queryMins, queryMaxs, epsilon );
+		}, [&SubtreeCallback] ( Tree& subtree )
+		{
+			if constexpr ( std::is_same_v<func_traits<SubtreeFunc>::return_type, bool> )
+				return SubtreeCallback( subtree );
+			else
+			{
+				SubtreeCallback( subtree );
+				return true;
+			}
 		}, std::forward<QueryFunc>( QueryCallback ) );
 	}
 
+	template <typename Tree, typename SubtreeFunc, typename QueryFunc>
+	static void SubtreeQuery( const Tree& root, const float* queryMins, const float* queryMaxs, float epsilon, SubtreeFunc SubtreeCallback, QueryFunc QueryCallback )
+	{
+		auto ConstSubtreeCallback = [&SubtreeCallback] ( Tree& subtree )
+		{
+			return SubtreeCallback( const_cast<const Tree&>( subtree ) );
+		};
+
+		if constexpr ( func_traits<QueryFunc>::arity == 3 )
+		{
+			SubtreeQuery( const_cast<Tree*>( &root ), queryMins, queryMaxs, epsilon, ConstSubtreeCallback, [&QueryCallback] ( T& leaf, const float ( &mins )[D], const float ( &maxs )[D] )
+			{
+				return QueryCallback( const_cast<const T&>( leaf ), mins, maxs );
+			} );
+		}
+		else
+		{
+			SubtreeQuery( const_cast<Tree*>( &root ), queryMins, queryMaxs, epsilon, ConstSubtreeCallback, [&QueryCallback] ( T& leaf )
+			{
+				return QueryCallback( const_cast<const T&>( leaf ) );
+			} );
+		}
+	}
+
 	template<typename Tree, typename QueryFunc>
 	static void SegmentQuery( Tree *root, const float *start, const float *end, float epsilon, QueryFunc QueryCallback )
 	{
+		float dir[D];
 		float invDir[D];
 
 		for ( unsigned d = 0; d < D; ++d )
 		{
-			invDir[d] = 1.0f / (end[d] - start[d]);
+			dir[d] = end[d] - start[d];
+			invDir[d] = 1.0f / dir[d];
 		}
 
 		QueryBase( root, epsilon, [&] ( const Tree &node, float epsilon, unsigned ( *outIntersectsChild )[MAX_NODES] )
 		{
 			GatherRayIntersections<true>( node, start, invDir, epsilon, outIntersectsChild );
+		}, [&] ( const T& leaf )
+		{
+			return LeafIntersects( leaf, start, dir, 1.0f, epsilon );
 		}, std::forward<QueryFunc>( QueryCallback ) );
 	}
 
 	template<typename Tree, typename QueryFunc>
 	static void SegmentQuery( const Tree &root, const float *start, const float *end, float epsilon, QueryFunc QueryCallback )
 	{
+		float dir[D];
 		float invDir[D];
 
 		for ( unsigned d = 0; d < D; ++d )
 		{
-			invDir[d] = 1.0f / (end[d] - start[d]);
+			dir[d] = end[d] - start[d];
+			invDir[d] = 1.0f / dir[d];
 		}
 
 		QueryBase( root, epsilon, [&] ( const Tree &node, float epsilon, unsigned ( *outIntersectsChild )[MAX_NODES] )
 		{
 			GatherRayIntersections<true>( node, start, invDir, epsilon, outIntersectsChild );
+		}, [&] ( const T& leaf )
+		{
+			return LeafIntersects( leaf, start, dir, 1.0f, epsilon );
 		}, std::forward<QueryFunc>( QueryCallback ) );
 	}
 
@@ -883,6 +1101,9 @@ struct TreeInterface
 		QueryBase( root, epsilon, [&] ( const Tree &node, float epsilon, unsigned ( *outIntersectsChild )[MAX_NODES] )
 		{
 			GatherRayIntersections<false>( node, start, invDir, epsilon, outIntersectsChild );
+		}, [&] ( const T& leaf )
+		{
+			return LeafIntersects( leaf, start, dir, INFINITY, epsilon );
 		}, std::forward<QueryFunc>( QueryCallback ) );
 	}
 
@@ -899,24 +1120,33 @@ struct TreeInterface
 		QueryBase( root, epsilon, [&] ( const Tree &node, float epsilon, unsigned ( *outIntersectsChild )[MAX_NODES] )
 		{
 			GatherRayIntersections<false>( node, start, invDir, epsilon, outIntersectsChild );
+		}, [&] ( const T& leaf )
+		{
+			return LeafIntersects( leaf, start, dir, INFINITY, epsilon );
 		}, std::forward<QueryFunc>( QueryCallback ) );
 	}
 
-	template<typename Tree, typename QueryFunc, typename = std::enable_if_t<D == 3>>
+	template<typename Tree, typename QueryFunc, size_t DD = D, typename = std::enable_if_t<DD == 3>>
 	static void PlanarQuery( Tree *root, const float ( &plane )[4], float epsilon, QueryFunc QueryCallback )
 	{
 		QueryBase( root, epsilon, [&] ( const Tree &node, float epsilon, unsigned ( *outIntersectsChild )[MAX_NODES] )
 		{
 			GatherPlanarIntersections( node, plane, epsilon, outIntersectsChild );
+		}, [&] ( const T& leaf )
+		{
+			return LeafIntersectsPlane( leaf, plane, epsilon );
 		}, std::forward<QueryFunc>( QueryCallback ) );
 	}
 
-	template<typename Tree, typename QueryFunc, typename = std::enable_if_t<D == 3>>
+	template<typename Tree, typename QueryFunc, size_t DD = D, typename = std::enable_if_t<DD == 3>>
 	static void PlanarQuery( const Tree &root, const float ( &plane )[4], float epsilon, QueryFunc QueryCallback )
 	{
 		QueryBase( root, epsilon, [&] ( const Tree &node, float epsilon, unsigned ( *outIntersectsChild )[MAX_NODES] )
 		{
 			GatherPlanarIntersections( node, plane, epsilon, outIntersectsChild );
+		}, [&] ( const T& leaf )
+		{
+			return LeafIntersectsPlane( leaf, plane, epsilon );
 		}, std::forward<QueryFunc>( QueryCallback ) );
 	}
 
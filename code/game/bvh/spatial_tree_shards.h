@@ -0,0 +1,129 @@
+#pragma once
+
+#include "spatial_tree.h"
+#include "box_partitioner_parallel.h"
+#include <vector>
+#include <thread>
+#include <iterator>
+#include <algorithm>
+
+// Lets several threads add leaves to one spatial_tree in the same frame without locking. Each writer owns a shard and
+// appends to it freely. At the sync point, flush() builds a tree per shard in parallel, reduces them with pairwise
+// parallel merges and merges the result into the target, all on a worker pool the shards keep for their lifetime. A shard
+// must only be written by one thread at a time, and flush() must not overlap any insert.
+template <typename T, size_t D = 3, size_t MAX_NODES = 16>
+class spatial_tree_shards
+{
+public:
+	typedef spatial_tree<T, D, MAX_NODES> tree_type;
+
+	explicit spatial_tree_shards( unsigned shardCount )
+		: shards( shardCount )
+		, pool( std::min( shardCount, std::max( std::thread::hardware_concurrency(), 1u ) ) - 1 )
+	{
+		assert( shardCount > 0 );
+	}
+
+	__forceinline unsigned shard_count() const
+	{
+		return static_cast<unsigned>( shards.size() );
+	}
+
+	void insert( unsigned shardIndex, const T& val, const float ( &mins )[D], const float ( &maxs )[D] )
+	{
+		Shard* const shard = &shards[shardIndex];
+
+		shard->values.push_back( val );
+		PushBounds( shard, mins, maxs );
+	}
+
+	void insert( unsigned shardIndex, T&& val, const float ( &mins )[D], const float ( &maxs )[D] )
+	{
+		Shard* const shard = &shards[shardIndex];
+
+		shard->values.push_back( std::move( val ) );
+		PushBounds( shard, mins, maxs );
+	}
+
+	size_t size() const
+	{
+		size_t count = 0;
+
+		for( const Shard& shard : shards )
+			count += shard.values.size();
+
+		return count;
+	}
+
+	// Moves everything staged so far into target and empties the shards. The calling thread takes part in the work.
+	void flush( tree_type* target )
+	{
+		std::vector<tree_type> trees( shards.size() );
+
+		pool.run( static_cast<unsigned>( shards.size() ), [this, &trees]( unsigned shardIndex )
+		{
+			BuildShard( &shards[shardIndex], &trees[shardIndex] );
+		} );
+
+		for( unsigned stride = 1; stride < trees.size(); stride <<= 1 )
+		{
+			const unsigned pairCount = static_cast<unsigned>( ( trees.size() + ( stride << 1 ) - 1 ) / ( stride << 1 ) );
+
+			pool.run( pairCount, [stride, &trees]( unsigned pairIndex )
+			{
+				const size_t lhsIndex = static_cast<size_t>( pairIndex ) * ( stride << 1 );
+				const size_t rhsIndex = lhsIndex + stride;
+
+				if( rhsIndex < trees.size() )
+					trees[lhsIndex].merge( std::move( trees[rhsIndex] ) );
+			} );
+		}
+
+		target->merge( std::move( trees[0] ) );
+	}
+
+private:
+	// Padded to a cache line so writers on neighbouring shards don't false share
+	struct alignas( 64 ) Shard
+	{
+		std::vector<T> values;
+		std::vector<float> mins[D];
+		std::vector<float> maxs[D];
+	};
+
+	std::vector<Shard> shards;
+	PartitionWorkerPool pool; // The shard builds partition on the partitioner's own pool, or inline while it's busy
+
+	static void PushBounds( Shard* shard, const float ( &mins )[D], const float ( &maxs )[D] )
+	{
+		for( size_t d = 0; d < D; ++d )
+		{
+			assertfmt( mins[d] <= maxs[d], "Object has invalid bounds" );
+			shard->mins[d].push_back( mins[d] );
+			shard->maxs[d].push_back( maxs[d] );
+		}
+	}
+
+	static void BuildShard( Shard* shard, tree_type* outTree )
+	{
+		T* const values = shard->values.data();
+
+		*outTree = tree_type( std::make_move_iterator( shard->values.begin() ), std::make_move_iterator( shard->values.end() ), [shard, values]( const T& val, float ( &outMins )[D], float ( &outMaxs )[D] )
+		{
+			const size_t valIndex = static_cast<size_t>( &val - values );
+
+			for( size_t d = 0; d < D; ++d )
+			{
+				outMins[d] = shard->mins[d][valIndex];
+				outMaxs[d] = shard->maxs[d][valIndex];
+			}
+		} );
+
+		shard->values.clear();
+		for( size_t d = 0; d < D; ++d )
+		{
+			shard->mins[d].clear();
+			shard->maxs[d].clear();
+		}
+	}
+};
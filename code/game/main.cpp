@@ -56,6 +56,7 @@ namespace
 		ImGuiContext* gui;
 		ImFont* titleFont;
 		ImFont* menuFont;
+		ImFont* debugFont;
 		ALLEGRO_JOYSTICK* js;
 
 		uint helperId;
@@ -84,6 +85,7 @@ namespace
 		float snowMeter = SNOW_METER_START;
 
 		State state = State::MAIN_MENU;
+		bool showPassTimings = false;
 	};
 
 	bool InitAllegro()
@@ -468,6 +470,44 @@ namespace
 			break;
 		}
 
+		if (state->showPassTimings)
+		{
+			static const char* const passNames[] = { "Scene", "Downsample", "Blur", "Output" };
+			static_assert(sizeof(passNames) / sizeof(passNames[0]) == static_cast<uint>(gfx::RenderPass::COUNT), "A name per gfx::RenderPass");
+			gfx::PassTimings timings;
+
+			gfx::GetPassTimings(state->game->gfx, &timings);
+
+			ImGui::PushFont(state->debugFont);
+			ImGui::SetNextWindowPos(ImVec2(10.0f, 10.0f), ImGuiCond_FirstUseEver);
+			ImGui::Begin("GPU Pass Timings", &state->showPassTimings, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoNav);
+
+			ImGui::Text("Last %u frames at %.0f%% resolution, in ms", timings.frameCount, timings.renderScale * 100.0f);
+			ImGui::Separator();
+			ImGui::Columns(5, "passTimings", false);
+			ImGui::SetColumnWidth(0, 100.0f);
+			ImGui::Text("Pass"); ImGui::NextColumn();
+			ImGui::Text("Last"); ImGui::NextColumn();
+			ImGui::Text("Min"); ImGui::NextColumn();
+			ImGui::Text("Avg"); ImGui::NextColumn();
+			ImGui::Text("p99"); ImGui::NextColumn();
+
+			for (uint pass = 0; pass < static_cast<uint>(gfx::RenderPass::COUNT); ++pass)
+			{
+				const gfx::PassTiming& timing = timings.passes[pass];
+
+				ImGui::Text("%s", passNames[pass]); ImGui::NextColumn();
+				ImGui::Text("%.3f", timing.lastMs); ImGui::NextColumn();
+				ImGui::Text("%.3f", timing.minMs); ImGui::NextColumn();
+				ImGui::Text("%.3f", timing.avgMs); ImGui::NextColumn();
+				ImGui::Text("%.3f", timing.p99Ms); ImGui::NextColumn();
+			}
+
+			ImGui::Columns(1);
+			ImGui::End();
+			ImGui::PopFont();
+		}
+
 		ImGui::Render();
 	}
 
@@ -487,7 +527,6 @@ namespace
 					state->state = State::SHUTDOWN;
 				break;
 				case ALLEGRO_EVENT_DISPLAY_RESIZE:
-					al_acknowledge_resize(evt.display.source);
 					gfx::Resize(state->game->gfx, static_cast<uint>(evt.display.width), static_cast<uint>(evt.display.height));
 				break;
 				case ALLEGRO_EVENT_JOYSTICK_BUTTON_DOWN:
@@ -540,6 +579,10 @@ namespace
 							}
 						break;
 
+						case ALLEGRO_KEY_F3:
+							state->showPassTimings = !state->showPassTimings;
+						break;
+
 						case ALLEGRO_KEY_SPACE:
 							if (state->state == State::RUNNING)
 							{
@@ -620,63 +663,56 @@ namespace
 		}
 	}
 
-	const phy::Transform* GetTransform(const std::vector<uint>& objIds, const std::vector<phy::Transform>& transforms, uint objectId)
+	// Returns objIds.size() if objectId has no transform
+	size_t GetTransformIndex(const std::vector<uint>& objIds, uint objectId)
 	{
-		auto objIdIt = std::find(objIds.begin(), objIds.end(), objectId);
-
-		if (objIdIt != objIds.end())
-			return transforms.data() + (objIdIt - objIds.begin());
-
-		return nullptr;
+		return std::find(objIds.begin(), objIds.end(), objectId) - objIds.begin();
 	}
 
 	static void UpdatePositions(GameState* state)
 	{
 		Game* const game = state->game;
-		std::vector<phy::Transform> objTransforms;
+		phy::Transforms objTransforms;
 		std::vector<uint> updatedObjs;
 
 		phy::GatherTransforms(*game->phy, &updatedObjs, &objTransforms);
-		assert(updatedObjs.size() == objTransforms.size());
+		assert(updatedObjs.size() == objTransforms.x.size());
 
 		if (!updatedObjs.empty())
 		{
-			std::vector<glm::mat4> gfxTransforms;
-			const phy::Transform* const helperT = GetTransform(updatedObjs, objTransforms, state->helperId);
-			const phy::Transform* const playerT = GetTransform(updatedObjs, objTransforms, state->playerId);
+			const size_t playerIndex = GetTransformIndex(updatedObjs, state->playerId);
 
-			if (playerT)
-				state->playerPos = glm::vec2(playerT->x, playerT->y);
+			if (playerIndex < updatedObjs.size())
+				state->playerPos = glm::vec2(objTransforms.x[playerIndex], objTransforms.y[playerIndex]);
 
 			for(size_t objIndex = 0; objIndex<updatedObjs.size(); ++objIndex)
 			{
 				const uint objId = updatedObjs[objIndex];
-				const phy::Transform& phyT = objTransforms[objIndex];
-				glm::mat4* const outT = &gfxTransforms.emplace_back();
+				const glm::vec2 phyPos(objTransforms.x[objIndex], objTransforms.y[objIndex]);
 				auto flakeIt = std::find(state->snowflakeIds.data(), state->snowflakeIds.data() + state->snowflakeCount, objId);
 				auto ballIt = std::find(state->activeSnowballIds.data(), state->activeSnowballIds.data() + state->snowballCount, objId);
 				auto fireIt = std::find(state->fireballIds.data(), state->fireballIds.data() + state->fireballCount, objId);
 
 				if (fireIt < state->fireballIds.data() + state->fireballCount)
 				{
-					aud::UpdateVolume(state->game->aud, *fireIt, XToVol(phyT.x));
+					aud::UpdateVolume(state->game->aud, *fireIt, XToVol(phyPos.x));
 
-					if (fabs(phyT.x) <= FIREBALL_RADIUS)
+					if (fabs(phyPos.x) <= FIREBALL_RADIUS)
 					{
 						const float snowBottom = SNOWMAN_BOT_Y - SNOWMAN_BOT_RADIUS;
 						const float snowTop = SNOWMAN_TOP_Y + SNOWMAN_TOP_RADIUS;
 						const float snowCur = (snowTop - snowBottom) * (state->snowMeter / state->maxSnow) + snowBottom;
 
-						if (phyT.y <= snowCur + 1.0 + FIREBALL_RADIUS)
+						if (phyPos.y <= snowCur + 1.0 + FIREBALL_RADIUS)
 						{
 							UpdateSnowmeter(state, -state->maxSnow / 3.0f);
 							game->dyingObjects.emplace_back(*fireIt);
 							*fireIt = state->fireballIds[--state->fireballCount];
 
-							aud::PlayTrackDetached(state->game->aud, AudioTrack::SIZZLE, false, 1.0f, XToPan(phyT.x));
+							aud::PlayTrackDetached(state->game->aud, AudioTrack::SIZZLE, false, 1.0f, XToPan(phyPos.x));
 						}
 					}
-					else if (phyT.y < -BOUNDS_HALF_HEIGHT + FIREBALL_RADIUS)
+					else if (phyPos.y < -BOUNDS_HALF_HEIGHT + FIREBALL_RADIUS)
 					{
 						game->dyingObjects.emplace_back(*fireIt);
 						*fireIt = state->fireballIds[--state->fireballCount];
@@ -685,7 +721,7 @@ namespace
 
 				if (ballIt < state->activeSnowballIds.data() + state->snowballCount)
 				{
-					if (phyT.y < -BOUNDS_HALF_HEIGHT + SNOWBALL_RADIUS + 0.01f)
+					if (phyPos.y < -BOUNDS_HALF_HEIGHT + SNOWBALL_RADIUS + 0.01f)
 					{
 						game->dyingObjects.emplace_back(*ballIt);
 						*ballIt = state->activeSnowballIds[--state->snowballCount];
@@ -694,17 +730,16 @@ namespace
 
 				if (flakeIt < state->snowflakeIds.data() + state->snowflakeCount)
 				{
-					if (phyT.y < -BOUNDS_HALF_HEIGHT + SNOWFLAKE_RADIUS)
+					if (phyPos.y < -BOUNDS_HALF_HEIGHT + SNOWFLAKE_RADIUS)
 					{
 						game->dyingObjects.emplace_back(*flakeIt);
 						*flakeIt = state->snowflakeIds[--state->snowflakeCount];
 					}
 				}
 
-				*outT = glm::translate(glm::mat4(1.0f), glm::vec3(phyT.x, phyT.y, 0.0f)) * glm::eulerAngleZ(phyT.rot);
 			}
 
-			gfx::UpdateModels(game->gfx, updatedObjs, gfxTransforms);
+			gfx::UpdateModels(game->gfx, updatedObjs, objTransforms.x.data(), objTransforms.y.data(), objTransforms.rot.data());
 		}
 	}
 
@@ -842,6 +877,7 @@ int main(int argc, char* argv[])
 					
 					state.titleFont = io.Fonts->AddFontFromMemoryCompressedBase85TTF(font::TitleFont_compressed_data_base85, 80.0f);
 					state.menuFont = io.Fonts->AddFontFromMemoryCompressedBase85TTF(font::MenuFont_compressed_data_base85, 50.0f);
+					state.debugFont = io.Fonts->AddFontDefault();
 
 					io.BackendPlatformName = io.BackendRendererName = "imgui_impl_allegro5";
 
@@ -939,12 +975,15 @@ int main(int argc, char* argv[])
 				
 				aud::PlayTrackDetached(state.game->aud, AudioTrack::THEME, true, 0.1f);
 				
+				// Creates the ImGui font texture and shaders while this thread still has the context
+				ImGui_ImplOpenGL3_NewFrame();
+				gfx::StartRenderThread(state.game->gfx, display);
+
 				state.frameCount = 1; // start at 1 to not fire all periodics immediately
 				while (state.state != State::SHUTDOWN)
 				{
 					ProcessEvents(eventQueue, &state);
 
-					ImGui_ImplOpenGL3_NewFrame();
 					ImGui::NewFrame();
 
 					Update_GUI(display, &state);
@@ -958,12 +997,11 @@ int main(int argc, char* argv[])
 						++state.frameCount;
 					}
 
-					gfx::Update(state.game->gfx);
-					ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-					al_flip_display();
+					gfx::Update(state.game->gfx, ImGui::GetDrawData());
 					game::CleanDeadObjects(state.game);
 				}
 
+				gfx::StopRenderThread(state.game->gfx);
 				game::Shutdown(state.game);
 				ImGui_ImplOpenGL3_Shutdown();
 				ImGui::DestroyContext();